@@ -0,0 +1,40 @@
+#include "assetloader.h"
+
+using namespace std;
+
+AssetLoader::AssetLoader(int numThreads) :
+	numJobs(0), numDone(0), progressFunc(NULL), pool(numThreads) {
+	
+}
+
+void AssetLoader::add(const char* name, void (*load)(), void (*upload)()) {
+	Job job;
+	job.name = name;
+	job.load = load;
+	job.upload = upload;
+	numJobs++;
+	pool.run([this, job]() {
+		job.load();
+		lock_guard<std::mutex> lock(mutex);
+		finished.push_back(job);
+	});
+}
+
+int AssetLoader::poll() {
+	deque<Job> jobs;
+	{
+		lock_guard<std::mutex> lock(mutex);
+		jobs.swap(finished);
+	}
+	
+	for(size_t i = 0; i < jobs.size(); i++) {
+		if (jobs[i].upload != NULL) {
+			jobs[i].upload();
+		}
+		numDone++;
+		if (progressFunc != NULL) {
+			progressFunc(jobs[i].name, numDone, numJobs);
+		}
+	}
+	return (int)jobs.size();
+}
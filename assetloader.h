@@ -0,0 +1,58 @@
+#ifndef ASSET_LOADER_H_INCLUDED
+#define ASSET_LOADER_H_INCLUDED
+
+#include <deque>
+#include <mutex>
+
+#include "threadpool.h"
+
+/* Loads assets in the background.  Each asset is loaded in two steps: a load
+ * function, which runs on a worker thread and does the file I/O and decoding,
+ * and an optional upload function, which runs on the thread that calls poll()
+ * and does the work that needs OpenGL (creating textures and so on).  Since
+ * the GL context belongs to the GLUT thread, poll() should be called from a
+ * GLUT callback.
+ */
+class AssetLoader {
+	public:
+		//Called on the polling thread each time an asset finishes loading
+		typedef void (*ProgressFunc)(const char* name, int numDone, int total);
+	private:
+		struct Job {
+			const char* name;
+			void (*load)();
+			void (*upload)();
+		};
+		
+		std::mutex mutex;
+		std::deque<Job> finished; //Jobs whose load function has returned
+		int numJobs;
+		int numDone; //The number of jobs that have been uploaded
+		ProgressFunc progressFunc;
+		ThreadPool pool; //Last, so the workers stop before the rest goes away
+	public:
+		//Starts numThreads worker threads (or one per hardware thread if 0)
+		explicit AssetLoader(int numThreads = 0);
+		
+		void setProgressFunc(ProgressFunc func) {
+			progressFunc = func;
+		}
+		
+		//Queues an asset.  name must stay valid until the asset is loaded.
+		void add(const char* name, void (*load)(), void (*upload)() = NULL);
+		//Runs the upload functions of the assets whose load functions have
+		//finished.  Returns the number of assets that finished.
+		int poll();
+		
+		//Returns whether every queued asset has been loaded and uploaded
+		bool done() const {
+			return numDone == numJobs;
+		}
+		
+		//Returns the fraction of the queued assets that are done
+		float progress() const {
+			return numJobs == 0 ? 1.0f : (float)numDone / numJobs;
+		}
+};
+
+#endif
@@ -0,0 +1,2202 @@
+/* Benchmarks for the CPU-side parts of the game.  Run with no arguments to run
+ * every benchmark, or pass the names of the ones to run, e.g.
+ * "motocross_bench bmp".
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "assetloader.h"
+#include "bikemesh.h"
+#include "camera.h"
+#include "flowfield.h"
+#include "glstate.h"
+#include "imageloader.h"
+#include "lockstep.h"
+#include "mat4f.h"
+#include "md2model.h"
+#include "particles.h"
+#include "physics.h"
+#include "raycast.h"
+#include "renderqueue.h"
+#include "riders.h"
+#include "scenegraph.h"
+#include "sim.h"
+#include "simhistory.h"
+#include "simthread.h"
+#include "softraster.h"
+#include "terrain.h"
+#include "terrainlight.h"
+#include "terrainmesh.h"
+#include "text3d.h"
+#include "texture.h"
+#include "threadpool.h"
+#include "triplebuffer.h"
+#include "water.h"
+
+using namespace std;
+
+namespace {
+	//How many checks have failed.  main exits with 1 if any have.
+	int numFailed = 0;
+	
+	//Prints whether a check passed, and counts it if it didn't
+	bool printCheck(const char* label, bool ok) {
+		printf("  %-28s %9s\n", label, ok ? "yes" : "NO");
+		numFailed += ok ? 0 : 1;
+		return ok;
+	}
+	
+	//Returns the time in seconds since an arbitrary point
+	double now() {
+		return chrono::duration<double>(
+			chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	
+	//Stores a little-endian integer of the given number of bytes
+	void putInt(vector<char> &bytes, int offset, unsigned int value, int n) {
+		for(int i = 0; i < n; i++) {
+			bytes[offset + i] = (char)((value >> (8 * i)) & 0xFF);
+		}
+	}
+	
+	//Builds an uncompressed 24- or 32-bit bitmap filled with a gradient
+	vector<char> syntheticBMP(int width, int height, int bitsPerPixel) {
+		int bytesPerRow = ((width * bitsPerPixel + 31) / 32) * 4;
+		int size = 54 + bytesPerRow * height;
+		vector<char> bytes(size, 0);
+		bytes[0] = 'B';
+		bytes[1] = 'M';
+		putInt(bytes, 2, size, 4);
+		putInt(bytes, 10, 54, 4);
+		putInt(bytes, 14, 40, 4);
+		putInt(bytes, 18, width, 4);
+		putInt(bytes, 22, height, 4);
+		putInt(bytes, 26, 1, 2);
+		putInt(bytes, 28, bitsPerPixel, 2);
+		for(int y = 0; y < height; y++) {
+			for(int x = 0; x < width * bitsPerPixel / 8; x++) {
+				bytes[54 + bytesPerRow * y + x] = (char)(x + y);
+			}
+		}
+		return bytes;
+	}
+	
+	//Decodes the bitmap repeatedly and prints the throughput in MB/s
+	void runBMP(const char* label, const vector<char> &bytes) {
+		int iterations = 0;
+		double start = now();
+		double elapsed;
+		do {
+			Image* image = loadBMPFromMemory(&bytes[0], (int)bytes.size());
+			if (image == NULL) {
+				printf("  %-28s failed to decode\n", label);
+				return;
+			}
+			delete image;
+			iterations++;
+			elapsed = now() - start;
+		} while (elapsed < 0.5);
+		
+		printf("  %-28s %9.1f MB/s\n",
+			   label,
+			   bytes.size() * (double)iterations / elapsed / 1e6);
+	}
+	
+	void benchBMP() {
+		const char* files[] = {"heightmap.bmp", "blockybalboa.bmp"};
+		for(int i = 0; i < 2; i++) {
+			ifstream input(files[i], ifstream::binary);
+			vector<char> bytes((istreambuf_iterator<char>(input)),
+							   istreambuf_iterator<char>());
+			runBMP(files[i], bytes);
+		}
+		
+		runBMP("synthetic 4096x4096x24", syntheticBMP(4096, 4096, 24));
+		runBMP("synthetic 4096x4096x32", syntheticBMP(4096, 4096, 32));
+		runBMP("synthetic 4095x4095x24", syntheticBMP(4095, 4095, 24));
+	}
+	
+	//Builds the mipmap chain repeatedly and prints the throughput in MB/s of
+	//level 0 pixels
+	void runMipmaps(const char* label, const Image* image) {
+		int iterations = 0;
+		double start = now();
+		double elapsed;
+		do {
+			vector<Image*> levels = buildMipmaps(image);
+			for(size_t i = 0; i < levels.size(); i++) {
+				delete levels[i];
+			}
+			iterations++;
+			elapsed = now() - start;
+		} while (elapsed < 0.5);
+		
+		printf("  %-28s %9.1f MB/s %9.3f ms\n",
+			   label,
+			   image->width * image->height * 3.0 * iterations / elapsed / 1e6,
+			   elapsed * 1000 / iterations);
+	}
+	
+	//Returns an image whose pixels are random bytes
+	Image* randomImage(int width, int height, SimRandom &random) {
+		char* pixels = new char[width * height * 3];
+		for(int i = 0; i < width * height * 3; i++) {
+			pixels[i] = (char)(random.next() >> 24);
+		}
+		return new Image(pixels, width, height);
+	}
+	
+	/* Returns whether the mipmap chain of the image goes down to 1x1, halving
+	 * each size (but not below 1) at every level, with each pixel the
+	 * rounded average of its 2x2 box and the last row or column repeated
+	 * where the level above is odd
+	 */
+	bool checkMipmaps(const Image* image) {
+		vector<Image*> levels = buildMipmaps(image);
+		int expected = 0;
+		for(int size = max(image->width, image->height); size > 1; size /= 2) {
+			expected++;
+		}
+		bool ok = (int)levels.size() == expected;
+		
+		const Image* above = image;
+		for(size_t i = 0; i < levels.size() && ok; i++) {
+			const Image* level = levels[i];
+			ok = level->width == max(above->width / 2, 1) &&
+				level->height == max(above->height / 2, 1);
+			const unsigned char* src = (const unsigned char*)above->pixels;
+			const unsigned char* dest = (const unsigned char*)level->pixels;
+			for(int y = 0; y < level->height && ok; y++) {
+				for(int x = 0; x < level->width && ok; x++) {
+					int xs[2] = {2 * x, min(2 * x + 1, above->width - 1)};
+					int ys[2] = {2 * y, min(2 * y + 1, above->height - 1)};
+					for(int c = 0; c < 3; c++) {
+						int sum = 2;
+						for(int j = 0; j < 4; j++) {
+							sum += src[(ys[j / 2] * above->width + xs[j % 2]) * 3 + c];
+						}
+						ok = ok && dest[(y * level->width + x) * 3 + c] == sum / 4;
+					}
+				}
+			}
+			above = level;
+		}
+		ok = ok && above->width == 1 && above->height == 1;
+		
+		for(size_t i = 0; i < levels.size(); i++) {
+			delete levels[i];
+		}
+		return ok;
+	}
+	
+	void benchMipmaps() {
+		//A 2x2 image of known pixels halves to their rounded average, with no
+		//overflow for bright pixels
+		const unsigned char block[12] = {10, 20, 255, 11, 21, 255,
+										 12, 22, 255, 13, 24, 254};
+		char* pixels = new char[12];
+		memcpy(pixels, block, 12);
+		Image* image = new Image(pixels, 2, 2);
+		Image* half = halveImage(image);
+		const unsigned char* average = (const unsigned char*)half->pixels;
+		printCheck("2x2 average",
+				   half->width == 1 && half->height == 1 && average[0] == 12 &&
+				   average[1] == 22 && average[2] == 255);
+		delete half;
+		delete image;
+		
+		SimRandom random(28);
+		const int checkSizes[][2] = {{1023, 777}, {1, 300}, {300, 1}, {1, 1},
+									 {64, 64}, {3, 5}};
+		for(int i = 0; i < 6; i++) {
+			image = randomImage(checkSizes[i][0], checkSizes[i][1], random);
+			char label[64];
+			sprintf(label, "chain of %dx%d", checkSizes[i][0], checkSizes[i][1]);
+			printCheck(label, checkMipmaps(image));
+			delete image;
+		}
+		
+		image = loadBMP("blockybalboa.bmp");
+		if (image != NULL) {
+			runMipmaps("blockybalboa.bmp", image);
+			delete image;
+		}
+		else {
+			printf("  could not load blockybalboa.bmp\n");
+		}
+		
+		const int sizes[][2] = {{1024, 1024}, {4096, 4096}, {1023, 777}};
+		for(int i = 0; i < 3; i++) {
+			vector<char> bytes = syntheticBMP(sizes[i][0], sizes[i][1], 24);
+			image = loadBMPFromMemory(&bytes[0], (int)bytes.size());
+			char label[64];
+			sprintf(label, "synthetic %dx%d", sizes[i][0], sizes[i][1]);
+			runMipmaps(label, image);
+			delete image;
+		}
+	}
+	
+	//Times converting HUD-style strings into text meshes
+	void benchText() {
+		t3dInit();
+		const int ITERATIONS = 100000;
+		double start = now();
+		size_t numVerts = 0;
+		for(int i = 0; i < ITERATIONS; i++) {
+			char str[64];
+			sprintf(str, "Score: %d\nTime: %d", i % 1000, i % 60);
+			T3DMesh* mesh = t3dMake2D(str, -1, -1);
+			numVerts += mesh->vertices.size() / 6;
+			delete mesh;
+		}
+		double elapsed = now() - start;
+		printf("  %-28s %9.3f us/string (%d triangles)\n",
+			   "2D HUD string",
+			   elapsed * 1e6 / ITERATIONS,
+			   (int)(numVerts / 3 / ITERATIONS));
+		
+		//A HUD whose values change now and then measures the same strings
+		//over and over, which the layout cache should absorb
+		start = now();
+		volatile float total = 0; //Keeps the calls from being optimized out
+		for(int i = 0; i < ITERATIONS; i++) {
+			char str[64];
+			sprintf(str, "Score: %d\nTime: %d", (i / 1000) * 10, i / 2000);
+			total = total + t3dDrawWidth(str) + t3dDrawHeight(str);
+		}
+		elapsed = now() - start;
+		printf("  %-28s %9.3f us/string\n",
+			   "cached measure",
+			   elapsed * 1e6 / ITERATIONS);
+		
+		start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			char str[64];
+			sprintf(str, "Score: %d\nTime: %d", i, i);
+			total = total + t3dDrawWidth(str) + t3dDrawHeight(str);
+		}
+		elapsed = now() - start;
+		printf("  %-28s %9.3f us/string\n",
+			   "uncached measure",
+			   elapsed * 1e6 / ITERATIONS);
+		t3dCleanup();
+	}
+	
+	Terrain* benchTerrain;
+	MD2Model* benchModel;
+	
+	void loadBenchTerrain() {
+		benchTerrain = loadTerrain("heightmap.bmp", 30.0f);
+	}
+	
+	void loadBenchModel() {
+		benchModel = MD2Model::loadData("blockybalboa.md2");
+	}
+	
+	//Compares loading the game's assets one after another with loading them
+	//through an AssetLoader
+	void benchLoad() {
+		double start = now();
+		loadBenchTerrain();
+		loadBenchModel();
+		printf("  %-28s %9.2f ms\n", "sequential", (now() - start) * 1000);
+		delete benchTerrain;
+		delete benchModel;
+		
+		start = now();
+		AssetLoader loader;
+		double poolStarted = now();
+		loader.add("heightmap.bmp", loadBenchTerrain);
+		loader.add("blockybalboa.md2", loadBenchModel);
+		while (!loader.done()) {
+			loader.poll();
+			this_thread::yield();
+		}
+		printf("  %-28s %9.2f ms (%.2f ms starting threads)\n",
+			   "asset loader",
+			   (now() - start) * 1000,
+			   (poolStarted - start) * 1000);
+		delete benchTerrain;
+		delete benchModel;
+	}
+	
+	//Steps many bikes over the game's terrain and prints how many bike steps
+	//one core manages per second
+	void benchPhysics() {
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		
+		const int NUM_BIKES = 1000;
+		const int NUM_STEPS = 120;
+		BikeParams params = defaultBikeParams();
+		vector<BikeState> bikes(NUM_BIKES);
+		vector<BikeInput> inputs(NUM_BIKES);
+		for(int i = 0; i < NUM_BIKES; i++) {
+			placeBike(terrain,
+					  params,
+					  (float)(i * 37 % (terrain->width() - 1)),
+					  (float)(i * 53 % (terrain->length() - 1)),
+					  i * 0.1f,
+					  bikes[i]);
+			inputs[i].throttle = 1.0f - (i % 3) * 0.5f;
+			inputs[i].steer = (i % 5 - 2) * 0.5f;
+			inputs[i].lean = 0;
+		}
+		
+		double start = now();
+		for(int step = 0; step < NUM_STEPS; step++) {
+			for(int i = 0; i < NUM_BIKES; i++) {
+				stepBike(terrain, params, inputs[i], bikes[i], PHYSICS_STEP);
+			}
+		}
+		double elapsed = now() - start;
+		
+		int numAirborne = 0;
+		for(int i = 0; i < NUM_BIKES; i++) {
+			if (bikes[i].airTime > 0) {
+				numAirborne++;
+			}
+		}
+		printf("  %-28s %9.2f M steps/s (%d bikes, %d airborne at the end)\n",
+			   "bikes",
+			   NUM_BIKES * (double)NUM_STEPS / elapsed / 1e6,
+			   NUM_BIKES,
+			   numAirborne);
+		delete terrain;
+	}
+	
+	//Steps a large RiderSystem with pools of increasing size and prints the
+	//speedup over stepping it on the calling thread alone
+	void benchRiders() {
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		
+		const int NUM_RIDERS = 16384;
+		const int NUM_STEPS = 60;
+		int maxThreads = (int)thread::hardware_concurrency();
+		if (maxThreads < 1) {
+			maxThreads = 1;
+		}
+		
+		double serialRate = 0;
+		for(int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+			RiderSystem riders(terrain, defaultBikeParams());
+			for(int i = 0; i < NUM_RIDERS; i++) {
+				riders.add((float)(i * 37 % (terrain->width() - 1)),
+						   (float)(i * 53 % (terrain->length() - 1)),
+						   i * 0.1f);
+				BikeInput input = {1.0f - (i % 3) * 0.5f, (i % 5 - 2) * 0.5f, 0};
+				riders.setInput(i, input);
+			}
+			
+			//The calling thread takes part in the loop, so a pool of
+			//numThreads - 1 workers uses numThreads threads
+			ThreadPool* pool = numThreads > 1 ? new ThreadPool(numThreads - 1) : NULL;
+			double start = now();
+			for(int step = 0; step < NUM_STEPS; step++) {
+				riders.step(PHYSICS_STEP, pool);
+			}
+			double rate = NUM_RIDERS * (double)NUM_STEPS / (now() - start);
+			delete pool;
+			
+			if (numThreads == 1) {
+				serialRate = rate;
+			}
+			char label[64];
+			sprintf(label, "%d riders, %d thread%s",
+					NUM_RIDERS, numThreads, numThreads == 1 ? "" : "s");
+			printf("  %-28s %9.2f M steps/s %6.2fx\n",
+				   label,
+				   rate / 1e6,
+				   rate / serialRate);
+			
+			if (numThreads < maxThreads && numThreads * 2 > maxThreads) {
+				numThreads = maxThreads / 2; //Finish on every thread
+			}
+		}
+		delete terrain;
+	}
+	
+	//Fills in rays from above the terrain looking out across it, as a
+	//camera might
+	void makeRays(Terrain* terrain, vector<TerrainRay> &rays) {
+		unsigned int seed = 12345;
+		auto random = [&seed]() {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			return (seed & 0xFFFFFF) / (float)0x1000000;
+		};
+		
+		float w = (float)(terrain->width() - 1);
+		float l = (float)(terrain->length() - 1);
+		for(size_t i = 0; i < rays.size(); i++) {
+			TerrainRay &ray = rays[i];
+			ray.origin[0] = random() * w;
+			ray.origin[2] = random() * l;
+			ray.origin[1] = heightAt(terrain, ray.origin[0], ray.origin[2]) +
+				2 + random() * 30;
+			float angle = random() * 6.2831853f;
+			ray.dir[0] = cosf(angle);
+			ray.dir[1] = -0.3f + random() * 0.35f;
+			ray.dir[2] = sinf(angle);
+			ray.maxDist = 0.5f * (w < l ? w : l);
+		}
+	}
+	
+	//Returns a bound on how steep the terrain gets anywhere: the length of
+	//the steepest height change across a square in x, and in z, together
+	float maxSlope(Terrain* terrain) {
+		float maxX = 0;
+		float maxZ = 0;
+		for(int z = 0; z < terrain->length(); z++) {
+			for(int x = 0; x < terrain->width(); x++) {
+				float h = terrain->getHeight(x, z);
+				if (x + 1 < terrain->width()) {
+					maxX = max(maxX, fabsf(terrain->getHeight(x + 1, z) - h));
+				}
+				if (z + 1 < terrain->length()) {
+					maxZ = max(maxZ, fabsf(terrain->getHeight(x, z + 1) - h));
+				}
+			}
+		}
+		return sqrtf(maxX * maxX + maxZ * maxZ);
+	}
+	
+	/* Finds where a ray hits the terrain by marching along it, without
+	 * solving for the hit the way the raycaster does.  The ground can't rise
+	 * faster than slope per unit across, so each step is as long as the ray
+	 * can go without reaching the ground, but never shorter than
+	 * MIN_STEP.  Only a hit that dips in and out of the ground within
+	 * MIN_STEP can be missed, and a hit is found at most MIN_STEP late.
+	 */
+	bool marchRay(Terrain* terrain, const TerrainRay &ray, float slope,
+				  float &dist) {
+		const float MIN_STEP = 0.001f;
+		float w = (float)(terrain->width() - 1);
+		float l = (float)(terrain->length() - 1);
+		float across = sqrtf(ray.dir[0] * ray.dir[0] + ray.dir[2] * ray.dir[2]);
+		float closing = slope * across - ray.dir[1]; //The fastest the gap shrinks
+		for(float t = 0; t <= ray.maxDist; ) {
+			float x = ray.origin[0] + ray.dir[0] * t;
+			float z = ray.origin[2] + ray.dir[2] * t;
+			if (x < 0 || z < 0 || x > w || z > l) {
+				return false;
+			}
+			float gap = ray.origin[1] + ray.dir[1] * t - heightAt(terrain, x, z);
+			if (gap <= 0) {
+				dist = t;
+				return true;
+			}
+			if (closing <= 0) {
+				return false; //The ray pulls away from the ground everywhere
+			}
+			t += max(gap / closing, MIN_STEP);
+		}
+		return false;
+	}
+	
+	//Times casting rays at a terrain, with and without threads, and checks
+	//the hits against marching along each ray
+	void benchRaycastTerrain(Terrain* terrain, const char* name) {
+		double start = now();
+		TerrainRaycaster raycaster(terrain);
+		char label[64];
+		sprintf(label, "%s build", name);
+		printf("  %-28s %9.3f ms\n", label, (now() - start) * 1000);
+		
+		vector<TerrainRay> rays(65536);
+		makeRays(terrain, rays);
+		vector<TerrainHit> hits(rays.size());
+		
+		const int NUM_MARCHED = 4096;
+		int numHits = 0;
+		int numAgreed = 0;
+		float slope = maxSlope(terrain);
+		start = now();
+		for(int i = 0; i < NUM_MARCHED; i++) {
+			float dist;
+			bool hit = marchRay(terrain, rays[i], slope, dist);
+			TerrainHit exact;
+			raycaster.cast(rays[i], exact);
+			if (hit == exact.hit && (!hit || fabsf(dist - exact.dist) <= 0.01f)) {
+				numAgreed++;
+			}
+		}
+		double marchRate = NUM_MARCHED / (now() - start);
+		sprintf(label, "%s march", name);
+		printf("  %-28s %9.3f M rays/s\n", label, marchRate / 1e6);
+		
+		int maxThreads = (int)thread::hardware_concurrency();
+		if (maxThreads < 1) {
+			maxThreads = 1;
+		}
+		double serialRate = 0;
+		for(int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+			ThreadPool* pool = numThreads > 1 ? new ThreadPool(numThreads - 1) : NULL;
+			start = now();
+			raycaster.castMany(&rays[0], &hits[0], (int)rays.size(), pool);
+			double rate = rays.size() / (now() - start);
+			delete pool;
+			
+			if (numThreads == 1) {
+				serialRate = rate;
+			}
+			sprintf(label, "%s %d thread%s",
+					name, numThreads, numThreads == 1 ? "" : "s");
+			printf("  %-28s %9.3f M rays/s %6.2fx\n",
+				   label,
+				   rate / 1e6,
+				   rate / serialRate);
+			
+			if (numThreads < maxThreads && numThreads * 2 > maxThreads) {
+				numThreads = maxThreads / 2; //Finish on every thread
+			}
+		}
+		
+		for(size_t i = 0; i < hits.size(); i++) {
+			numHits += hits[i].hit ? 1 : 0;
+		}
+		numFailed += numAgreed == NUM_MARCHED ? 0 : 1;
+		printf("  %-28s %8.1f%% hit, %d/%d agree\n",
+			   "", 100.0f * numHits / hits.size(), numAgreed, NUM_MARCHED);
+	}
+	
+	//Times casting rays at the game's terrain and at a big rolling one
+	void benchRaycast() {
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		char name[32];
+		sprintf(name, "%dx%d", terrain->width(), terrain->length());
+		benchRaycastTerrain(terrain, name);
+		delete terrain;
+		
+		const int SIZE = 4096;
+		terrain = new Terrain(SIZE, SIZE);
+		for(int z = 0; z < SIZE; z++) {
+			for(int x = 0; x < SIZE; x++) {
+				terrain->setHeight(x, z,
+								   20 * sinf(x * 0.01f) * cosf(z * 0.013f) +
+								   5 * sinf(x * 0.07f + z * 0.05f));
+			}
+		}
+		sprintf(name, "%dx%d", SIZE, SIZE);
+		benchRaycastTerrain(terrain, name);
+		delete terrain;
+	}
+	
+	//Times updating the camera as a bike drives in circles over the terrain
+	void benchCamera() {
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		
+		const CameraMode modes[] = {CAMERA_CHASE, CAMERA_SIDE, CAMERA_OVERHEAD};
+		const char* names[] = {"chase", "side", "overhead"};
+		const int ITERATIONS = 200000;
+		volatile float sink = 0;
+		TerrainRaycaster raycaster(terrain);
+		for(int m = 0; m < 6; m++) {
+			Camera camera;
+			camera.setMode(modes[m % 3]);
+			if (m >= 3) {
+				camera.setRaycaster(&raycaster);
+			}
+			BikeState bike;
+			placeBike(terrain, defaultBikeParams(), 100, 100, 0, bike);
+			double start = now();
+			for(int i = 0; i < ITERATIONS; i++) {
+				float angle = i * 0.001f;
+				bike.x = 100 + 60 * cosf(angle);
+				bike.z = 100 + 60 * sinf(angle);
+				bike.y = heightAt(terrain, bike.x, bike.z) + 0.5f;
+				bike.yaw = -angle - 1.5707963f;
+				camera.update(terrain, bike, 1 / 60.0f);
+				sink = sink + camera.viewMatrix()[12];
+			}
+			char label[64];
+			sprintf(label, "update (%s%s)", names[m % 3], m >= 3 ? ", raycast" : "");
+			printf("  %-28s %9.1f ns\n",
+				   label,
+				   (now() - start) * 1e9 / ITERATIONS);
+		}
+		delete terrain;
+	}
+	
+	//Compares updating a flow field as goals come and go with rebuilding it,
+	//and times steering riders with it
+	void benchFlow() {
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		
+		const int NUM_GOALS = 10;
+		float goals[NUM_GOALS][2];
+		for(int i = 0; i < NUM_GOALS; i++) {
+			goals[i][0] = (float)(10 + i * 97 % 180);
+			goals[i][1] = (float)(10 + i * 61 % 180);
+		}
+		
+		FlowField field(terrain);
+		const int ITERATIONS = 20;
+		double start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			field.clearGoals();
+			for(int j = 0; j < NUM_GOALS; j++) {
+				field.addGoal(goals[j][0], goals[j][1]);
+			}
+		}
+		printf("  %-28s %9.3f ms\n",
+			   "add 10 goals one at a time",
+			   (now() - start) * 1000 / ITERATIONS);
+		
+		start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			field.clearGoals();
+			field.addGoals(goals, NUM_GOALS);
+		}
+		printf("  %-28s %9.3f ms\n",
+			   "add 10 goals at once",
+			   (now() - start) * 1000 / ITERATIONS);
+		
+		start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			int j = i % NUM_GOALS;
+			field.removeGoal(goals[j][0], goals[j][1]);
+			field.addGoal(goals[j][0], goals[j][1]);
+		}
+		printf("  %-28s %9.3f ms\n",
+			   "remove and re-add a goal",
+			   (now() - start) * 1000 / ITERATIONS);
+		
+		const int NUM_RIDERS = 16384;
+		RiderSystem riders(terrain, defaultBikeParams());
+		for(int i = 0; i < NUM_RIDERS; i++) {
+			riders.add((float)(i * 37 % (terrain->width() - 1)),
+					   (float)(i * 53 % (terrain->length() - 1)),
+					   i * 0.1f);
+		}
+		start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			riders.followField(field, 0, NUM_RIDERS);
+		}
+		printf("  %-28s %9.3f ns/rider\n",
+			   "steer riders",
+			   (now() - start) * 1e9 / ITERATIONS / NUM_RIDERS);
+		delete terrain;
+	}
+	
+	//Returns the input a scripted player gives on the given tick
+	BikeInput scriptedInput(int player, int tick) {
+		SimRandom random((unsigned int)(player * 7919 + tick / 60 + 1));
+		random.next();
+		BikeInput input;
+		input.throttle = random.nextFloat() * 1.5f - 0.5f;
+		input.steer = random.nextFloat() * 2 - 1;
+		input.lean = random.nextFloat() * 2 - 1;
+		return input;
+	}
+	
+	/* Runs several lockstep players in one process, talking over UDP on the
+	 * loopback interface with scripted inputs, and checks that their Sims
+	 * are identical at the end
+	 */
+	void benchLockstep() {
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		
+		const int NUM_PLAYERS = 3;
+		const int NUM_TICKS = 100000;
+		Sim* sims[NUM_PLAYERS];
+		Lockstep* nets[NUM_PLAYERS];
+		for(int i = 0; i < NUM_PLAYERS; i++) {
+			sims[i] = new Sim(terrain, NUM_PLAYERS, 2, 12345);
+			nets[i] = new Lockstep(NUM_PLAYERS, i, 6);
+			if (!nets[i]->listen(0)) {
+				printf("  could not open a UDP socket\n");
+				return;
+			}
+		}
+		for(int i = 0; i < NUM_PLAYERS; i++) {
+			for(int j = 0; j < NUM_PLAYERS; j++) {
+				if (i != j) {
+					nets[i]->setPeer(j, "127.0.0.1", nets[j]->port());
+				}
+			}
+		}
+		
+		double start = now();
+		int numInputs[NUM_PLAYERS] = {0};
+		bool done = false;
+		while (!done) {
+			done = true;
+			for(int i = 0; i < NUM_PLAYERS; i++) {
+				Lockstep* net = nets[i];
+				while (net->needsInput()) {
+					net->addLocalInput(scriptedInput(i, numInputs[i]++));
+				}
+				net->poll();
+				while (net->ready() && net->tick() < NUM_TICKS) {
+					BikeInput inputs[NUM_PLAYERS];
+					net->getInputs(inputs);
+					sims[i]->step(inputs);
+					net->advance(sims[i]->checksum());
+				}
+				net->poll();
+				if (net->tick() < NUM_TICKS) {
+					done = false;
+				}
+			}
+		}
+		double elapsed = now() - start;
+		
+		bool identical = true;
+		for(int i = 1; i < NUM_PLAYERS; i++) {
+			const RiderSystem &a = sims[0]->getRiders();
+			const RiderSystem &b = sims[i]->getRiders();
+			for(int j = 0; j < a.size(); j++) {
+				BikeState bikeA = a.state(j);
+				BikeState bikeB = b.state(j);
+				if (memcmp(&bikeA, &bikeB, sizeof(BikeState)) != 0) {
+					identical = false;
+				}
+			}
+			if (sims[i]->checksum() != sims[0]->checksum() ||
+				nets[i]->desynced()) {
+				identical = false;
+			}
+		}
+		
+		printf("  %-28s %9.0f ticks/s per player\n",
+			   "3 players, 100000 ticks",
+			   NUM_TICKS / elapsed);
+		numFailed += identical ? 0 : 1;
+		printf("  %-28s %9s (checksum %08x, score %d/%d/%d)\n",
+			   "final states",
+			   identical ? "identical" : "DIFFER",
+			   sims[0]->checksum(),
+			   sims[0]->score(0),
+			   sims[0]->score(1),
+			   sims[0]->score(2));
+		for(int i = 0; i < NUM_PLAYERS; i++) {
+			delete sims[i];
+			delete nets[i];
+		}
+		delete terrain;
+	}
+	
+	/* Runs a 64-rider Sim that rolls back 8 ticks and simulates them again
+	 * on every tick, as a rollback client would when a late input arrives,
+	 * and checks that it ends up the same as a Sim that never rolled back
+	 */
+	void benchRollback() {
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		
+		const int NUM_PLAYERS = 4;
+		const int NUM_TICKS = 3000;
+		const int ROLLBACK = 8;
+		Sim sim(terrain, NUM_PLAYERS, 60, 777);
+		Sim reference(terrain, NUM_PLAYERS, 60, 777);
+		SimHistory history(sim, ROLLBACK + 1);
+		sim.setHistory(&history);
+		BikeInput inputs[NUM_PLAYERS];
+		
+		double saveTime = 0;
+		double restoreTime = 0;
+		vector<double> rollbackTimes;
+		//The rollbacks that simulate a spawn or pickup again, which would
+		//recompute the flow field if it weren't taken from the history
+		vector<double> changeTimes;
+		int lastChange = -ROLLBACK;
+		for(int tick = 0; tick < NUM_TICKS; tick++) {
+			for(int i = 0; i < NUM_PLAYERS; i++) {
+				inputs[i] = scriptedInput(i, tick);
+			}
+			Collectible before[NUM_COLLECTIBLES];
+			memcpy(before, reference.getCollectibles(), sizeof(before));
+			reference.step(inputs);
+			if (memcmp(before, reference.getCollectibles(), sizeof(before)) != 0) {
+				lastChange = tick;
+			}
+			
+			double start = now();
+			history.save(sim);
+			saveTime += now() - start;
+			sim.step(inputs);
+			
+			if (sim.tick() < ROLLBACK) {
+				continue;
+			}
+			start = now();
+			history.restore(sim, sim.tick() - ROLLBACK);
+			restoreTime += now() - start;
+			while (sim.tick() < tick + 1) {
+				for(int i = 0; i < NUM_PLAYERS; i++) {
+					inputs[i] = scriptedInput(i, sim.tick());
+				}
+				history.save(sim);
+				sim.step(inputs);
+			}
+			rollbackTimes.push_back(now() - start);
+			if (tick - lastChange < ROLLBACK) {
+				changeTimes.push_back(rollbackTimes.back());
+			}
+		}
+		
+		sort(rollbackTimes.begin(), rollbackTimes.end());
+		sort(changeTimes.begin(), changeTimes.end());
+		printf("  %-28s %9d bytes (+%d when the flow field changed)\n",
+			   "snapshot size",
+			   history.snapshotSize(),
+			   history.flowSnapshotSize());
+		printf("  %-28s %9.3f us\n", "save", saveTime * 1e6 / NUM_TICKS);
+		printf("  %-28s %9.3f us\n",
+			   "restore",
+			   restoreTime * 1e6 / rollbackTimes.size());
+		printf("  %-28s %9.3f ms median, %.3f ms p99, %.3f ms max\n",
+			   "restore + resimulate 8",
+			   rollbackTimes[rollbackTimes.size() / 2] * 1000,
+			   rollbackTimes[rollbackTimes.size() * 99 / 100] * 1000,
+			   rollbackTimes.back() * 1000);
+		if (!changeTimes.empty()) {
+			printf("  %-28s %9.3f ms median, %.3f ms max (%d rollbacks)\n",
+				   "  over a spawn or pickup",
+				   changeTimes[changeTimes.size() / 2] * 1000,
+				   changeTimes.back() * 1000,
+				   (int)changeTimes.size());
+		}
+		printCheck("matches a plain run",
+				   sim.checksum() == reference.checksum());
+		delete terrain;
+	}
+	
+	//Multiplies m on the right by r, the way the fixed-function pipeline
+	//multiplies the current matrix
+	void glMultiply(float* m, const float* r) {
+		float result[16];
+		for(int col = 0; col < 4; col++) {
+			for(int row = 0; row < 4; row++) {
+				float sum = 0;
+				for(int k = 0; k < 4; k++) {
+					sum += m[k * 4 + row] * r[col * 4 + k];
+				}
+				result[col * 4 + row] = sum;
+			}
+		}
+		memcpy(m, result, sizeof(result));
+	}
+	
+	//Does what glTranslatef does to m
+	void glTranslate(float* m, float x, float y, float z) {
+		const float t[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, x, y, z, 1};
+		glMultiply(m, t);
+	}
+	
+	//Does what glRotatef does to m, following the formula in the GL spec
+	void glRotate(float* m, float degrees, float x, float y, float z) {
+		float length = sqrtf(x * x + y * y + z * z);
+		x /= length;
+		y /= length;
+		z /= length;
+		float c = cosf(degrees * 3.1415926535f / 180);
+		float s = sinf(degrees * 3.1415926535f / 180);
+		const float r[16] = {
+			x * x * (1 - c) + c, y * x * (1 - c) + z * s, x * z * (1 - c) - y * s, 0,
+			x * y * (1 - c) - z * s, y * y * (1 - c) + c, y * z * (1 - c) + x * s, 0,
+			x * z * (1 - c) + y * s, y * z * (1 - c) - x * s, z * z * (1 - c) + c, 0,
+			0, 0, 0, 1
+		};
+		glMultiply(m, r);
+	}
+	
+	//Times updating a scene of bikes with five parts each, and checks the
+	//world matrices against the glTranslatef and glRotatef calls that used
+	//to place them
+	void benchScene() {
+		const int NUM_BIKES = 4096;
+		const int NUM_PARTS = 5;
+		const float offsets[NUM_PARTS] = {1.0f, -1.0f, 0.0f, 0.4f, -0.5f};
+		SceneGraph scene;
+		vector<BikeState> bikes(NUM_BIKES);
+		vector<int> bikeNodes(NUM_BIKES);
+		for(int i = 0; i < NUM_BIKES; i++) {
+			bikeNodes[i] = scene.add();
+			for(int j = 0; j < NUM_PARTS; j++) {
+				scene.add(bikeNodes[i], Mat4f::translation(Vec3f(offsets[j], 0, 0)));
+			}
+			BikeState &bike = bikes[i];
+			bike.x = i % 64 * 3.0f;
+			bike.y = i % 7 * 0.5f;
+			bike.z = i / 64 * 3.0f;
+			bike.yaw = i * 0.37f;
+			bike.pitch = sinf((float)i) * 0.8f;
+			bike.roll = cosf(i * 1.7f) * 0.5f;
+		}
+		scene.update();
+		
+		const int ITERATIONS = 200;
+		double start = now();
+		int numUpdated = 0;
+		for(int k = 0; k < ITERATIONS; k++) {
+			for(int i = 0; i < NUM_BIKES; i++) {
+				scene.setLocal(bikeNodes[i], bikeTransform(bikes[i]));
+			}
+			numUpdated = scene.update();
+		}
+		printf("  %-28s %9.3f us (%d nodes)\n",
+			   "move every bike",
+			   (now() - start) * 1e6 / ITERATIONS,
+			   numUpdated);
+		
+		start = now();
+		for(int k = 0; k < ITERATIONS; k++) {
+			for(int i = 0; i < NUM_BIKES; i += 64) {
+				scene.setLocal(bikeNodes[i], bikeTransform(bikes[i]));
+			}
+			numUpdated = scene.update();
+		}
+		printf("  %-28s %9.3f us (%d nodes)\n",
+			   "move 1 bike in 64",
+			   (now() - start) * 1e6 / ITERATIONS,
+			   numUpdated);
+		
+		const float PI = 3.1415926535f;
+		float worst = 0;
+		for(int i = 0; i < NUM_BIKES; i++) {
+			const BikeState &bike = bikes[i];
+			for(int j = 0; j < NUM_PARTS; j++) {
+				float m[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+				glTranslate(m, bike.x, bike.y, bike.z);
+				glRotate(m, bike.yaw * 180 / PI, 0, 1000, 0);
+				glRotate(m, bike.pitch * 180 / PI, 0, 0, 10);
+				glRotate(m, bike.roll * 180 / PI, 10, 0, 0);
+				glTranslate(m, offsets[j], 0, 0);
+				const Mat4f &world = scene.world(bikeNodes[i] + 1 + j);
+				for(int k = 0; k < 16; k++) {
+					worst = max(worst, fabsf(world[k] - m[k]));
+				}
+			}
+		}
+		//The GL calls build the same matrices in another order, so they only
+		//agree to float rounding
+		numFailed += worst <= 1e-3f ? 0 : 1;
+		printf("  %-28s %9.2g\n", "max diff from GL calls", worst);
+	}
+	
+	//A GL backend that only counts the calls that reach it
+	int mockCalls = 0;
+	
+	void mockEnable(GLenum) {
+		mockCalls++;
+	}
+	
+	void mockSetMode(GLenum) {
+		mockCalls++;
+	}
+	
+	void mockBindTexture(GLenum, GLuint) {
+		mockCalls++;
+	}
+	
+	void mockDeleteTextures(GLsizei, const GLuint*) {
+		mockCalls++;
+	}
+	
+	void mockLightfv(GLenum, GLenum, const GLfloat*) {
+		mockCalls++;
+	}
+	
+	void mockLightModelfv(GLenum, const GLfloat*) {
+		mockCalls++;
+	}
+	
+	const GLBackend MOCK_BACKEND = {
+		mockEnable,
+		mockEnable,
+		mockSetMode,
+		mockSetMode,
+		mockBindTexture,
+		mockDeleteTextures,
+		mockLightfv,
+		mockLightModelfv
+	};
+	
+	//Prints whether a check of the GL state cache passed
+	void checkGLState(const char* name, int expectedCalls, bool ok = true) {
+		ok = ok && mockCalls == expectedCalls;
+		printf("  %-28s %9s\n", name, ok ? "ok" : "FAILED");
+		numFailed += ok ? 0 : 1;
+		mockCalls = 0;
+	}
+	
+	//Checks the GL state cache against a mock backend, then counts what it
+	//saves over the state changes of a frame of the game
+	void benchGLState() {
+		glsSetBackend(&MOCK_BACKEND);
+		mockCalls = 0;
+		
+		glsEnable(GL_LIGHTING);
+		glsEnable(GL_LIGHTING);
+		glsDisable(GL_FOG); //Already disabled
+		checkGLState("repeated enable", 1, glsIsEnabled(GL_LIGHTING));
+		
+		glsShadeModel(GL_SMOOTH);
+		glsFrontFace(GL_CW);
+		glsFrontFace(GL_CW);
+		checkGLState("modes", 1, glsGetFrontFace() == GL_CW);
+		
+		GLuint texture = 5;
+		glsBindTexture(texture);
+		glsBindTexture(texture);
+		glsDeleteTextures(1, &texture);
+		glsBindTexture(0); //Deleting the texture unbound it
+		checkGLState("bind and delete", 2, glsGetBoundTexture() == 0);
+		
+		const GLfloat color[] = {0.5f, 0.5f, 0.5f, 1.0f};
+		const GLfloat position[] = {0.0f, 1.0f, 0.0f, 0.0f};
+		glsLightfv(GL_LIGHT0, GL_DIFFUSE, color);
+		glsLightfv(GL_LIGHT0, GL_DIFFUSE, color);
+		glsLightfv(GL_LIGHT1, GL_DIFFUSE, color);
+		glsLightfv(GL_LIGHT0, GL_POSITION, position);
+		glsLightfv(GL_LIGHT0, GL_POSITION, position);
+		glsLightModelfv(GL_LIGHT_MODEL_AMBIENT, color);
+		glsLightModelfv(GL_LIGHT_MODEL_AMBIENT, color);
+		GLfloat read[4];
+		bool readOk = glsGetLightfv(GL_LIGHT0, GL_DIFFUSE, read) &&
+			read[0] == color[0] && read[3] == color[3] &&
+			glsGetLightfv(GL_LIGHT0, GL_POSITION, read) &&
+			read[1] == position[1] && read[3] == position[3];
+		checkGLState("lights", 5, readOk);
+		
+		glsReset();
+		glsEnable(GL_LIGHTING);
+		checkGLState("reset", 1);
+		
+		//The state changes that drawScene, drawTerrain and the HUD make in a
+		//frame
+		glsReset();
+		glsResetStats();
+		const int NUM_FRAMES = 100000;
+		double start = now();
+		for(int i = 0; i < NUM_FRAMES; i++) {
+			glsLightModelfv(GL_LIGHT_MODEL_AMBIENT, color);
+			glsLightfv(GL_LIGHT0, GL_DIFFUSE, color);
+			glsLightfv(GL_LIGHT0, GL_POSITION, position);
+			glsLightfv(GL_LIGHT1, GL_POSITION, position);
+			glsDisable(GL_TEXTURE_2D);
+			for(int j = 0; j < 4; j++) {
+				glsDisable(GL_TEXTURE_2D);
+				glsEnable(GL_TEXTURE_2D);
+				glsBindTexture(1);
+			}
+			glsDisable(GL_LIGHTING);
+			glsDisable(GL_DEPTH_TEST);
+			glsShadeModel(GL_SMOOTH);
+			glsSetEnabled(GL_NORMALIZE, false);
+			glsSetEnabled(GL_CULL_FACE, false);
+			glsFrontFace(GL_CCW);
+			glsEnable(GL_LIGHTING);
+			glsEnable(GL_DEPTH_TEST);
+		}
+		double elapsed = now() - start;
+		GLStateStats stats = glsGetStats();
+		printf("  %-28s %9.1f passed, %.1f skipped\n",
+			   "changes per frame",
+			   (float)stats.calls / NUM_FRAMES,
+			   (float)stats.skipped / NUM_FRAMES);
+		printf("  %-28s %9.1f ns\n",
+			   "per change",
+			   elapsed * 1e9 / (stats.calls + stats.skipped));
+		glsSetBackend(NULL);
+	}
+	
+	//Mock render backend calls.  Materials still go through the GL state
+	//cache, onto the mock GL backend, to count the state changes it saves.
+	void mockLoadMatrix(const GLfloat*) {
+		
+	}
+	
+	void mockMaterial(const Material &material) {
+		glsSetEnabled(GL_LIGHTING, material.lighting);
+		glsSetEnabled(GL_TEXTURE_2D, material.texture != 0);
+		if (material.texture != 0) {
+			glsBindTexture(material.texture);
+		}
+	}
+	
+	void mockDrawTriangles(const TriangleBatch &) {
+		
+	}
+	
+	const RenderBackend MOCK_RENDER_BACKEND = {
+		mockLoadMatrix,
+		mockMaterial,
+		mockDrawTriangles
+	};
+	
+	int numMockDraws = 0;
+	
+	void mockDraw(void*, const RenderBackend*) {
+		numMockDraws++;
+	}
+	
+	//Adds the commands for one subsystem's share of the draws to list, with
+	//materials and meshes in an order that would switch state often if they
+	//were drawn as they came
+	void addMockCommands(CommandList* list, int first, int count,
+						 int numMaterials, int numMeshes) {
+		for(int i = first; i < first + count; i++) {
+			int material = i * 7 % numMaterials;
+			int mesh = i * 13 % numMeshes;
+			float depth = (i * 7919 % 1000) / 1000.0f;
+			Mat4f world = Mat4f::translation(Vec3f((float)i, 0, depth * 100));
+			list->add(RenderQueue::makeKey(0, material, mesh, depth),
+					  mesh, material, list->addTransform(world));
+		}
+	}
+	
+	//Times making, sorting and submitting a frame's draws, against a mock
+	//backend, and counts the state changes the sort saves
+	void benchQueue() {
+		const int NUM_LISTS = 4;
+		const int NUM_COMMANDS = 16384;
+		const int NUM_MATERIALS = 16;
+		const int NUM_MESHES = 32;
+		const int PER_LIST = NUM_COMMANDS / NUM_LISTS;
+		RenderQueue queue;
+		CommandList* lists[NUM_LISTS];
+		for(int i = 0; i < NUM_LISTS; i++) {
+			lists[i] = queue.addList();
+		}
+		for(int i = 0; i < NUM_MATERIALS; i++) {
+			Material material = {(GLuint)(i % 4), i % 2 == 0, {1, 1, 1}};
+			queue.addMaterial(material);
+		}
+		for(int i = 0; i < NUM_MESHES; i++) {
+			queue.addMesh(mockDraw);
+		}
+		glsSetBackend(&MOCK_BACKEND);
+		
+		int maxThreads = (int)thread::hardware_concurrency();
+		ThreadPool* pool = maxThreads > 1 ? new ThreadPool(maxThreads - 1) : NULL;
+		const int ITERATIONS = 50;
+		double generateTime = 0;
+		double submitTime = 0;
+		for(int k = 0; k < ITERATIONS; k++) {
+			double start = now();
+			auto generate = [&](int i) {
+				addMockCommands(lists[i], i * PER_LIST, PER_LIST,
+								NUM_MATERIALS, NUM_MESHES);
+			};
+			if (pool != NULL) {
+				pool->parallelFor(NUM_LISTS, generate);
+			}
+			else {
+				for(int i = 0; i < NUM_LISTS; i++) {
+					generate(i);
+				}
+			}
+			generateTime += now() - start;
+			
+			start = now();
+			glsResetStats();
+			queue.submit(Mat4f::identity(), &MOCK_RENDER_BACKEND);
+			submitTime += now() - start;
+		}
+		delete pool;
+		GLStateStats stats = glsGetStats();
+		
+		printf("  %-28s %9.3f ms (%d threads)\n",
+			   "make 16384 commands",
+			   generateTime * 1000 / ITERATIONS,
+			   maxThreads > 1 ? maxThreads : 1);
+		printf("  %-28s %9.3f ms\n",
+			   "sort and submit",
+			   submitTime * 1000 / ITERATIONS);
+		
+		const vector<DrawCommand> &sorted = queue.lastCommands();
+		bool inOrder = numMockDraws == NUM_COMMANDS * ITERATIONS;
+		for(size_t i = 1; i < sorted.size(); i++) {
+			inOrder = inOrder && sorted[i - 1].key <= sorted[i].key;
+		}
+		printCheck("sorted by key", inOrder);
+		
+		int unsortedChanges = 0;
+		for(int i = 1; i < NUM_COMMANDS; i++) {
+			if (i * 7 % NUM_MATERIALS != (i - 1) * 7 % NUM_MATERIALS) {
+				unsortedChanges++;
+			}
+		}
+		printf("  %-28s %9d (vs %d unsorted)\n",
+			   "material changes",
+			   queue.lastStateChanges(),
+			   unsortedChanges + 1);
+		printf("  %-28s %9d passed, %d skipped\n",
+			   "GL state changes",
+			   stats.calls,
+			   stats.skipped);
+		
+		vector<DrawCommand> copy(sorted.size());
+		for(size_t i = 0; i < sorted.size(); i++) {
+			copy[i] = sorted[i * 7919 % sorted.size()];
+		}
+		double start = now();
+		std::sort(copy.begin(), copy.end(),
+				  [](const DrawCommand &a, const DrawCommand &b) {
+					  return a.key < b.key;
+				  });
+		printf("  %-28s %9.3f ms\n",
+			   "std::sort, for comparison",
+			   (now() - start) * 1000);
+		glsSetBackend(NULL);
+	}
+	
+	//A value that shows whether it was torn: every part holds the same number
+	struct StressValue {
+		int seq;
+		int values[64];
+		vector<int> more;
+	};
+	
+	//Hands values through a triple buffer from one thread to another as fast
+	//as they can go, checking that the reader never sees a torn or old
+	//value, then runs a Sim on a SimThread and reads it like the GL thread
+	void benchPipeline() {
+		const int NUM_VALUES = 1000000;
+		TripleBuffer<StressValue> buffer;
+		buffer.writeSlot().seq = 0;
+		buffer.writeSlot().more.assign(1, 0);
+		for(int i = 0; i < 64; i++) {
+			buffer.writeSlot().values[i] = 0;
+		}
+		buffer.publish();
+		
+		double start = now();
+		std::thread writer([&buffer]() {
+			for(int seq = 1; seq <= NUM_VALUES; seq++) {
+				StressValue &value = buffer.writeSlot();
+				value.seq = seq;
+				for(int i = 0; i < 64; i++) {
+					value.values[i] = seq;
+				}
+				value.more.assign(seq % 100 + 1, seq);
+				buffer.publish();
+			}
+		});
+		int numTaken = 0;
+		int numBad = 0;
+		int lastSeq = -1;
+		while (lastSeq < NUM_VALUES) {
+			if (!buffer.update()) {
+				continue;
+			}
+			const StressValue &value = buffer.readSlot();
+			bool ok = value.seq > lastSeq &&
+				(int)value.more.size() == value.seq % 100 + 1;
+			for(int i = 0; i < 64; i++) {
+				ok = ok && value.values[i] == value.seq;
+			}
+			for(size_t i = 0; i < value.more.size(); i++) {
+				ok = ok && value.more[i] == value.seq;
+			}
+			numBad += ok ? 0 : 1;
+			lastSeq = value.seq;
+			numTaken++;
+		}
+		writer.join();
+		double elapsed = now() - start;
+		printf("  %-28s %9.2f M/s published, %d taken\n",
+			   "triple buffer",
+			   NUM_VALUES / elapsed / 1e6,
+			   numTaken);
+		printCheck("no torn or stale values", numBad == 0);
+		
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		Sim sim(terrain, 1, 3, 1);
+		SimThread simThread(&sim, NULL, 0);
+		simThread.start();
+		int firstTick = simThread.snapshot().tick;
+		int shownSeq = 0;
+		vector<double> latencies;
+		start = now();
+		for(int frame = 0; now() - start < 1.0; frame++) {
+			//Change the input every few frames, like a player would
+			if (frame % 4 == 0) {
+				BikeInput input = {1, (frame / 4 % 3 - 1) * 0.5f, 0};
+				simThread.setInput(input);
+			}
+			std::this_thread::sleep_for(chrono::milliseconds(16));
+			simThread.update();
+			const FrameSnapshot &snapshot = simThread.snapshot();
+			if (snapshot.inputSeq != shownSeq) {
+				shownSeq = snapshot.inputSeq;
+				latencies.push_back(SimThread::now() - snapshot.inputTime);
+			}
+		}
+		int numTicks = simThread.snapshot().tick - firstTick;
+		elapsed = now() - start;
+		simThread.stop();
+		sort(latencies.begin(), latencies.end());
+		printf("  %-28s %9.1f ticks/s\n", "sim thread", numTicks / elapsed);
+		if (!latencies.empty()) {
+			printf("  %-28s %9.2f ms median, %.2f ms max\n",
+				   "input to frame",
+				   latencies[latencies.size() / 2] * 1000,
+				   latencies.back() * 1000);
+		}
+		
+		//Once the game is over, the sim thread has nothing to do and should
+		//sleep rather than spin
+		while (!sim.over()) {
+			BikeInput none = {0, 0, 0};
+			sim.step(&none);
+		}
+		simThread.start();
+		clock_t cpuStart = clock();
+		start = now();
+		std::this_thread::sleep_for(chrono::milliseconds(500));
+		double cpuTime = (double)(clock() - cpuStart) / CLOCKS_PER_SEC;
+		elapsed = now() - start;
+		simThread.stop();
+		printf("  %-28s %9.1f %% of a core\n",
+			   "sim thread after game over",
+			   cpuTime * 100 / elapsed);
+		delete terrain;
+	}
+	
+	void drawSoftTerrain(void* mesh, const RenderBackend* backend) {
+		((TerrainMesh*)mesh)->draw(backend);
+	}
+	
+	void drawSoftBike(void* mesh, const RenderBackend* backend) {
+		((BikeMesh*)mesh)->draw(backend);
+	}
+	
+	void drawSoftRider(void* model, const RenderBackend* backend) {
+		((MD2Model*)model)->draw(0.25f, backend);
+	}
+	
+	//Returns how many pixels differ between two images of the same size
+	int countDifferentPixels(const Image* a, const Image* b) {
+		int count = 0;
+		for(int i = 0; i < a->width * a->height; i++) {
+			if (memcmp(a->pixels + 3 * i, b->pixels + 3 * i, 3) != 0) {
+				count++;
+			}
+		}
+		return count;
+	}
+	
+	//Returns how many pixels differ between two images of the same size by
+	//more than tolerance in some channel
+	int countPixelsOver(const Image* a, const Image* b, int tolerance) {
+		int count = 0;
+		for(int i = 0; i < a->width * a->height; i++) {
+			for(int j = 3 * i; j < 3 * i + 3; j++) {
+				if (abs((unsigned char)a->pixels[j] -
+						(unsigned char)b->pixels[j]) > tolerance) {
+					count++;
+					break;
+				}
+			}
+		}
+		return count;
+	}
+	
+	/* The frames benchSoftRaster draws are compared with reference frames at
+	 * half size, so that a triangle edge that moves by a pixel, e.g. with
+	 * another compiler's rounding, only changes a few pixels a little.  Each
+	 * channel may be off by REFERENCE_TOLERANCE, and up to REFERENCE_OUTLIERS
+	 * pixels may be off by more.
+	 */
+	const int REFERENCE_TOLERANCE = 8;
+	const int REFERENCE_OUTLIERS = 40;
+	
+	//Returns whether the half-size image matches the reference image
+	bool matchesReference(const Image* half, const Image* reference) {
+		return reference->width == half->width &&
+			reference->height == half->height &&
+			countPixelsOver(half, reference, REFERENCE_TOLERANCE) <=
+			REFERENCE_OUTLIERS;
+	}
+	
+	/* Prints whether the image matches the reference frame in the given file,
+	 * and returns whether it does.  If there is no reference frame, the image
+	 * is saved as one, but the check still fails, so that a missing reference
+	 * isn't mistaken for a match.
+	 */
+	bool checkReference(const char* label, const Image* image,
+						const char* filename) {
+		Image* half = halveImage(image);
+		Image* reference = loadBMP(filename);
+		bool ok = false;
+		if (reference == NULL) {
+			printf("  %-28s %9s (no %s; saved this frame as it)\n",
+				   label, "FAILED", filename);
+			saveBMP(filename, half);
+		}
+		else if (reference->width != half->width ||
+				 reference->height != half->height) {
+			printf("  %-28s %9s (%s is %dx%d, not %dx%d)\n",
+				   label, "FAILED", filename, reference->width,
+				   reference->height, half->width, half->height);
+		}
+		else {
+			int numOver = countPixelsOver(half, reference, REFERENCE_TOLERANCE);
+			ok = numOver <= REFERENCE_OUTLIERS;
+			printf("  %-28s %9s (%d pixels off by more than %d)\n",
+				   label,
+				   ok ? "matches" : "FAILED",
+				   numOver,
+				   REFERENCE_TOLERANCE);
+		}
+		numFailed += ok ? 0 : 1;
+		delete reference;
+		delete half;
+		return ok;
+	}
+	
+	/* Draws the game's scene, as the race starts, with the software
+	 * rasterizer through the render queue, and times it with different
+	 * numbers of threads.  The frames drawn with bilinear and nearest filtering
+	 * are checked against reference frames, so that a change to how the scene
+	 * is drawn shows up without a GPU.  The bilinear frame is saved to
+	 * softraster.bmp for looking at.
+	 */
+	void benchSoftRaster() {
+		const int WIDTH = 800;
+		const int HEIGHT = 600;
+		const float VIEW_DISTANCE = 200.0f;
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		MD2Model* model = MD2Model::loadData("blockybalboa.md2");
+		if (terrain == NULL || model == NULL) {
+			printf("  could not load heightmap.bmp or blockybalboa.md2\n");
+			delete terrain;
+			delete model;
+			return;
+		}
+		model->setAnimation("run");
+		Image* splatMap = loadBMP("splatmap.bmp");
+		TerrainMesh terrainMesh(terrain, splatMap);
+		delete splatMap;
+		BikeMesh bikeMesh;
+		Sim sim(terrain, 1, 3, 1);
+		
+		//Place the riders as main does
+		const RiderSystem &riders = sim.getRiders();
+		SceneGraph scene;
+		vector<int> bikeNodes;
+		for(int i = 0; i < riders.size(); i++) {
+			int bikeNode = scene.add();
+			scene.add(bikeNode,
+					  Mat4f::translation(Vec3f(0.0f, 0.75f, 0.0f)) *
+					  Mat4f::rotation(-90.0f, Vec3f(0.0f, 0.0f, 1.0f)) *
+					  Mat4f::scaling(Vec3f(0.1f, 0.1f, 0.1f)));
+			scene.setLocal(bikeNode, bikeTransform(riders.state(i)));
+			bikeNodes.push_back(bikeNode);
+		}
+		scene.update();
+		
+		//The rider sits sideways on the bike, so look at the first one's face
+		//from beside its bike, close enough that the rider's texture is
+		//magnified and the two ways of filtering it differ
+		BikeState bike = riders.state(0);
+		Vec3f side(sinf(bike.yaw), 0.0f, cosf(bike.yaw));
+		Vec3f bikePos(bike.x, bike.y, bike.z);
+		Mat4f view = Mat4f::lookAt(bikePos - side * 2.0f + Vec3f(0, 1.6f, 0),
+								   bikePos + Vec3f(0, 1.2f, 0),
+								   Vec3f(0, 1, 0));
+		Mat4f projection = Mat4f::perspective(45.0f, (float)WIDTH / HEIGHT,
+											  0.1f, VIEW_DISTANCE);
+		
+		const GLuint RIDER_TEXTURE = 1;
+		SoftRasterizer raster(WIDTH, HEIGHT);
+		raster.setProjection(projection);
+		raster.setLight(view.transformDirection(Vec3f(-0.2f, 0.3f, -1.0f)),
+						Vec3f(0.5f, 0.5f, 0.5f),
+						Vec3f(0.5f, 0.5f, 0.5f));
+		raster.addTexture(RIDER_TEXTURE, model->getTextureImage());
+		
+		RenderQueue queue;
+		CommandList* commands = queue.addList();
+		int terrainId = queue.addMesh(drawSoftTerrain, &terrainMesh);
+		int bikeId = queue.addMesh(drawSoftBike, &bikeMesh);
+		int riderId = queue.addMesh(drawSoftRider, model);
+		Material lit = {0, true, {1.0f, 1.0f, 1.0f}};
+		Material textured = {RIDER_TEXTURE, true, {1.0f, 1.0f, 1.0f}};
+		int litMaterial = queue.addMaterial(lit);
+		int riderMaterial = queue.addMaterial(textured);
+		
+		auto drawFrame = [&]() {
+			raster.clear();
+			commands->add(RenderQueue::makeKey(0, litMaterial, terrainId, 0),
+						  terrainId, litMaterial,
+						  commands->addTransform(Mat4f::identity()));
+			for(size_t i = 0; i < bikeNodes.size(); i++) {
+				const Mat4f &bikeWorld = scene.world(bikeNodes[i]);
+				Vec3f origin = view.transformPoint(Vec3f(bikeWorld[12],
+														 bikeWorld[13],
+														 bikeWorld[14]));
+				float depth = -origin[2] / VIEW_DISTANCE;
+				commands->add(RenderQueue::makeKey(0, litMaterial, bikeId, depth),
+							  bikeId, litMaterial,
+							  commands->addTransform(bikeWorld));
+				commands->add(RenderQueue::makeKey(0, riderMaterial, riderId,
+												   depth),
+							  riderId, riderMaterial,
+							  commands->addTransform(scene.world(bikeNodes[i] + 1)));
+			}
+			queue.submit(view, raster.backend());
+			raster.finish();
+		};
+		
+		drawFrame();
+		printf("  %-28s %9d\n", "triangles", raster.numTriangles());
+		Image* first = raster.toImage();
+		int maxThreads = max(4, (int)thread::hardware_concurrency());
+		for(int threads = 1; threads <= maxThreads; threads *= 2) {
+			ThreadPool* pool = threads > 1 ? new ThreadPool(threads - 1) : NULL;
+			raster.setThreadPool(pool);
+			int frames = 0;
+			double start = now();
+			double elapsed;
+			do {
+				drawFrame();
+				frames++;
+				elapsed = now() - start;
+			} while (elapsed < 0.5);
+			Image* image = raster.toImage();
+			char label[32];
+			snprintf(label, sizeof(label), "%d thread%s", threads,
+					 threads > 1 ? "s" : "");
+			bool same = countDifferentPixels(image, first) == 0;
+			numFailed += same ? 0 : 1;
+			printf("  %-28s %9.1f fps %9.2f ms%s\n",
+				   label,
+				   frames / elapsed,
+				   elapsed * 1000 / frames,
+				   same ? "" : " (image differs)");
+			delete image;
+			raster.setThreadPool(NULL);
+			delete pool;
+		}
+		
+		raster.setBilinear(false);
+		drawFrame();
+		Image* nearest = raster.toImage();
+		printf("  %-28s %9d pixels\n",
+			   "nearest differs by",
+			   countDifferentPixels(nearest, first));
+		bool matches = checkReference("bilinear frame", first,
+									  "softraster_reference.bmp");
+		matches = checkReference("nearest frame", nearest,
+								 "softraster_nearest_reference.bmp") && matches;
+		
+		//The tolerance mustn't be so loose that the filtering could change
+		//unnoticed
+		Image* reference = loadBMP("softraster_reference.bmp");
+		if (reference != NULL) {
+			Image* half = halveImage(nearest);
+			printCheck("nearest fails bilinear ref",
+					   !matchesReference(half, reference));
+			delete half;
+			delete reference;
+		}
+		delete nearest;
+		
+		bool saved = saveBMP("softraster.bmp", first);
+		Image* reloaded = saved ? loadBMP("softraster.bmp") : NULL;
+		printCheck("saved softraster.bmp",
+				   reloaded != NULL && countDifferentPixels(reloaded, first) == 0);
+		delete reloaded;
+		if (!matches) {
+			printf("  the frame has changed; if that was meant, check "
+				   "softraster.bmp, then delete the references and run this "
+				   "again to save new ones\n");
+		}
+		delete first;
+		delete model;
+		delete terrain;
+	}
+	
+	//Times building and painting the terrain's mesh on one thread and on a
+	//pool, and checks that both paint it the same
+	void benchSplat() {
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		Image* splatMap = loadBMP("splatmap.bmp");
+		if (terrain == NULL || splatMap == NULL) {
+			printf("  could not load heightmap.bmp or splatmap.bmp\n");
+			delete terrain;
+			delete splatMap;
+			return;
+		}
+		
+		int maxThreads = (int)thread::hardware_concurrency();
+		ThreadPool* pool = maxThreads > 1 ? new ThreadPool(maxThreads - 1) : NULL;
+		const TerrainPalette &palette = defaultTerrainPalette();
+		const int ITERATIONS = 20;
+		double start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			TerrainMesh mesh(terrain, splatMap, palette);
+		}
+		double serialTime = (now() - start) / ITERATIONS;
+		start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			TerrainMesh mesh(terrain, splatMap, palette, NULL, pool);
+		}
+		double poolTime = (now() - start) / ITERATIONS;
+		
+		TerrainMesh serial(terrain, splatMap, palette);
+		TerrainMesh parallel(terrain, splatMap, palette, NULL, pool);
+		TerrainMesh unsplatted(terrain, NULL, palette);
+		bool same = memcmp(serial.vertices(), parallel.vertices(),
+						   serial.numVertices() * 9 * sizeof(float)) == 0;
+		
+		//Count the vertices the rules painted, as those whose colour isn't
+		//one of the layers'
+		int numRuled = 0;
+		for(int i = 0; i < unsplatted.numVertices(); i++) {
+			const float* color = unsplatted.vertices() + 9 * i + 6;
+			if (memcmp(color, palette.layers[0], 3 * sizeof(float)) != 0) {
+				numRuled++;
+			}
+		}
+		
+		printf("  %-28s %9.3f ms\n", "paint 200x200, 1 thread",
+			   serialTime * 1000);
+		printf("  %-28s %9.3f ms (%d threads)\n",
+			   "paint 200x200, pool",
+			   poolTime * 1000,
+			   maxThreads > 1 ? maxThreads : 1);
+		printCheck("same paint on the pool", same);
+		printf("  %-28s %8.1f%%\n",
+			   "painted by slope or height",
+			   100.0 * numRuled / unsplatted.numVertices());
+		delete pool;
+		delete splatMap;
+		delete terrain;
+	}
+	
+	//Returns whether two lightmaps hold exactly the same light
+	bool sameLight(const TerrainLightmap &a, const TerrainLightmap &b) {
+		if (a.width() != b.width() || a.length() != b.length()) {
+			return false;
+		}
+		for(int z = 0; z < a.length(); z++) {
+			for(int x = 0; x < a.width(); x++) {
+				if (a.skyLight(x, z) != b.skyLight(x, z) ||
+					a.sunLight(x, z) != b.sunLight(x, z)) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+	
+	//Times baking the terrain's light on one thread and on a pool, and
+	//against reading the bake back from its cache
+	void benchBake() {
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		
+		int maxThreads = (int)thread::hardware_concurrency();
+		ThreadPool* pool = maxThreads > 1 ? new ThreadPool(maxThreads - 1) : NULL;
+		Vec3f sunDir(-0.2f, 0.3f, -1.0f);
+		const int ITERATIONS = 3;
+		double start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			TerrainLightmap lightmap(terrain, sunDir);
+		}
+		double serialTime = (now() - start) / ITERATIONS;
+		start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			TerrainLightmap lightmap(terrain, sunDir, pool);
+		}
+		double poolTime = (now() - start) / ITERATIONS;
+		
+		TerrainLightmap serial(terrain, sunDir);
+		TerrainLightmap parallel(terrain, sunDir, pool);
+		bool same = sameLight(serial, parallel);
+		
+		const char* CACHE_FILE = "bench.light";
+		unsigned long long key =
+			TerrainLightmap::cacheKey("heightmap.bmp", 30.0f, sunDir);
+		serial.save(CACHE_FILE, key);
+		start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			delete TerrainLightmap::load(CACHE_FILE, key);
+		}
+		double loadTime = (now() - start) / ITERATIONS;
+		TerrainLightmap* loaded = TerrainLightmap::load(CACHE_FILE, key);
+		bool roundTrip = loaded != NULL && sameLight(serial, *loaded);
+		TerrainLightmap* stale = TerrainLightmap::load(
+			CACHE_FILE,
+			TerrainLightmap::cacheKey("heightmap.bmp", 30.0f,
+									  Vec3f(0.2f, 0.3f, -1.0f)));
+		remove(CACHE_FILE);
+		
+		//Count the vertices facing the sun that the horizon hides it from
+		double skySum = 0;
+		int numFacing = 0;
+		int numShadowed = 0;
+		Vec3f toSun = sunDir.normalize();
+		for(int z = 0; z < terrain->length(); z++) {
+			for(int x = 0; x < terrain->width(); x++) {
+				skySum += serial.skyLight(x, z);
+				float lambert =
+					terrain->getNormal(x, z).normalize().dot(toSun);
+				if (lambert > 0) {
+					numFacing++;
+					if (serial.sunLight(x, z) < lambert / 2) {
+						numShadowed++;
+					}
+				}
+			}
+		}
+		int numVertices = terrain->width() * terrain->length();
+		
+		printf("  %-28s %9.3f ms\n", "bake 200x200, 1 thread",
+			   serialTime * 1000);
+		printf("  %-28s %9.3f ms (%d threads)\n",
+			   "bake 200x200, pool",
+			   poolTime * 1000,
+			   maxThreads > 1 ? maxThreads : 1);
+		printf("  %-28s %9.3f ms\n", "load from cache", loadTime * 1000);
+		printCheck("same bake on the pool", same);
+		printCheck("same bake from cache", roundTrip);
+		printCheck("cache ignored for new sun", stale == NULL);
+		printf("  %-28s %9.3f\n", "average sky seen",
+			   skySum / numVertices);
+		printf("  %-28s %8.1f%%\n", "sunward vertices shadowed",
+			   100.0 * numShadowed / max(numFacing, 1));
+		delete stale;
+		delete loaded;
+		delete pool;
+		delete terrain;
+	}
+	
+	//Finds the water on the game's terrain, checks the regions against the
+	//heights, and drives a bike into the largest one with and without it
+	void benchWater() {
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		
+		const float LEVEL = -14.0f;
+		const int MIN_VERTICES = 50;
+		const int ITERATIONS = 20;
+		double start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			WaterMap water(terrain, LEVEL, MIN_VERTICES);
+		}
+		double extractTime = (now() - start) / ITERATIONS;
+		WaterMap water(terrain, LEVEL, MIN_VERTICES);
+		
+		/* Flood fill the vertices under the water again, simply, and check
+		 * that the large sets match the regions.  A square takes the region
+		 * of its first corner under the water, so each vertex's region is
+		 * that of the square it's the first corner of.
+		 */
+		int w = terrain->width();
+		int l = terrain->length();
+		bool valid = true;
+		vector<int> component(w * l, -1);
+		vector<bool> regionFound(water.numRegions(), false);
+		int numComponents = 0;
+		int numLarge = 0;
+		for(int start = 0; start < w * l; start++) {
+			if (component[start] >= 0 ||
+				terrain->getHeight(start % w, start / w) >= LEVEL) {
+				continue;
+			}
+			int index = numComponents;
+			vector<int> filled(1, start);
+			component[start] = index;
+			for(int i = 0; i < (int)filled.size(); i++) {
+				int x = filled[i] % w;
+				int z = filled[i] / w;
+				const int next[4][2] = {{x + 1, z}, {x - 1, z}, {x, z + 1},
+										{x, z - 1}};
+				for(int j = 0; j < 4; j++) {
+					int nx = next[j][0];
+					int nz = next[j][1];
+					if (nx >= 0 && nx < w && nz >= 0 && nz < l &&
+						component[nz * w + nx] < 0 &&
+						terrain->getHeight(nx, nz) < LEVEL) {
+						component[nz * w + nx] = index;
+						filled.push_back(nz * w + nx);
+					}
+				}
+			}
+			
+			numComponents++;
+			if ((int)filled.size() < MIN_VERTICES) {
+				continue;
+			}
+			int region = -1;
+			for(int i = 0; i < (int)filled.size(); i++) {
+				int x = filled[i] % w;
+				int z = filled[i] / w;
+				if (x < w - 1 && z < l - 1) {
+					int cellRegion = water.regionAt(x + 0.5f, z + 0.5f);
+					valid = valid && cellRegion >= 0 &&
+						(region < 0 || cellRegion == region);
+					region = cellRegion;
+				}
+			}
+			if (region < 0 || regionFound[region]) {
+				valid = false;
+				continue;
+			}
+			valid = valid &&
+				water.region(region).numVertices == (int)filled.size();
+			regionFound[region] = true;
+			numLarge++;
+		}
+		valid = valid && numLarge == water.numRegions();
+		
+		int numTriangles = 0;
+		int numWet = 0;
+		float deepest = 0;
+		for(int i = 0; i < water.numRegions(); i++) {
+			const WaterRegion &region = water.region(i);
+			numTriangles += region.numTriangles();
+			numWet += region.numVertices;
+			deepest = max(deepest, region.maxDepth);
+		}
+		
+		//What a frame costs: colouring every region for where it's seen from
+		const float eye[3] = {100.0f, 5.0f, 100.0f};
+		float color[3];
+		start = now();
+		for(int i = 0; i < 1000; i++) {
+			for(int j = 0; j < water.numRegions(); j++) {
+				waterColor(water.region(j), eye, color);
+			}
+		}
+		double colorTime = (now() - start) / 1000;
+		
+		//Drive into the largest region from its middle, with and without it
+		int largest = 0;
+		for(int i = 1; i < water.numRegions(); i++) {
+			if (water.region(i).numVertices >
+				water.region(largest).numVertices) {
+				largest = i;
+			}
+		}
+		float speeds[2];
+		for(int pass = 0; pass < 2; pass++) {
+			BikeParams params = defaultBikeParams();
+			BikeState bike;
+			const WaterRegion &region = water.region(largest);
+			placeBike(terrain, params, region.center[0], region.center[2], 0,
+					  bike);
+			BikeInput input = {1, 0, 0};
+			for(int i = 0; i < 120; i++) {
+				stepBike(terrain, params, input, bike, PHYSICS_STEP,
+						 pass == 0 ? NULL : &water);
+			}
+			speeds[pass] = sqrtf(bike.vx * bike.vx + bike.vz * bike.vz);
+		}
+		
+		printf("  %-28s %9.3f ms\n", "find water on 200x200",
+			   extractTime * 1000);
+		printf("  %-28s %9d (%d vertices, %d triangles)\n", "regions",
+			   water.numRegions(), numWet, numTriangles);
+		printf("  %-28s %9.2f\n", "deepest water", deepest);
+		printCheck("regions match the heights", valid);
+		printf("  %-28s %9.3f us\n", "colour every region",
+			   colorTime * 1e6);
+		printf("  %-28s %9.2f -> %.2f\n", "speed after 1 s, dry -> wet",
+			   speeds[0], speeds[1]);
+		delete terrain;
+	}
+	
+	//Keeps a pool of particles full over the game's terrain, frame after
+	//frame, and times moving them and making their quads
+	void benchParticles() {
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		
+		int maxThreads = (int)thread::hardware_concurrency();
+		ThreadPool* pool = maxThreads > 1 ? new ThreadPool(maxThreads - 1) : NULL;
+		const int NUM_FRAMES = 20;
+		const float FRAME_TIME = 1.0f / 60;
+		const int SIZES[] = {100000, 250000, 1000000};
+		float maxX = (float)(terrain->width() - 1);
+		float maxZ = (float)(terrain->length() - 1);
+		for(int s = 0; s < 3; s++) {
+			for(int threaded = 0; threaded < 2; threaded++) {
+				ParticleSystem particles(SIZES[s]);
+				SimRandom random(12345);
+				ThreadPool* framePool = threaded ? pool : NULL;
+				double emitTime = 0;
+				double updateTime = 0;
+				double buildTime = 0;
+				int numEmitted = 0;
+				for(int frame = 0; frame < NUM_FRAMES; frame++) {
+					double start = now();
+					while (particles.size() < particles.getCapacity()) {
+						float x = random.nextFloat() * maxX;
+						float z = random.nextFloat() * maxZ;
+						particles.emit(Vec3f(x, heightAt(terrain, x, z) +
+											 random.nextFloat() * 5, z),
+									   Vec3f(random.nextFloat() * 4 - 2,
+											 random.nextFloat() * 4,
+											 random.nextFloat() * 4 - 2),
+									   0.1f + random.nextFloat(),
+									   Vec3f(0.5f, 0.4f, 0.3f));
+						numEmitted++;
+					}
+					double emitted = now();
+					particles.update(FRAME_TIME, terrain, framePool);
+					double updated = now();
+					particles.buildQuads(Vec3f(1, 0, 0), Vec3f(0, 1, 0), 0.25f,
+										 framePool);
+					emitTime += emitted - start;
+					updateTime += updated - emitted;
+					buildTime += now() - updated;
+				}
+				
+				//Nothing may end up under the ground
+				int numUnder = 0;
+				for(int i = 0; i < particles.size(); i++) {
+					Vec3f pos = particles.position(i);
+					if (pos[1] < heightAt(terrain, pos[0], pos[2]) - 1e-4f) {
+						numUnder++;
+					}
+				}
+				
+				numFailed += numUnder == 0 ? 0 : 1;
+				char name[64];
+				snprintf(name, sizeof(name), "%dk, %s", SIZES[s] / 1000,
+						 threaded ? "pool" : "1 thread");
+				printf("  %-28s %9.3f ms update %8.3f ms quads %8.3f ms "
+					   "emit (%d died, %d under ground)\n",
+					   name,
+					   updateTime * 1000 / NUM_FRAMES,
+					   buildTime * 1000 / NUM_FRAMES,
+					   emitTime * 1000 / NUM_FRAMES,
+					   numEmitted - particles.size(),
+					   numUnder);
+			}
+		}
+		printf("  %-28s %9d\n", "threads in the pool",
+			   maxThreads > 1 ? maxThreads : 1);
+		delete pool;
+		delete terrain;
+	}
+	
+	//Times op(i) for i over [0, count), many times over, and prints the
+	//average time per call
+	template<class Op>
+	void timeOp(const char* name, int count, Op op) {
+		const int REPEATS = 2000;
+		double start = now();
+		for(int r = 0; r < REPEATS; r++) {
+			for(int i = 0; i < count; i++) {
+				op(i);
+			}
+		}
+		printf("  %-28s %9.2f ns\n",
+			   name,
+			   (now() - start) * 1e9 / ((double)REPEATS * count));
+	}
+	
+	//Times each of the vector and matrix operations, over arrays so that the
+	//compiler can't fold them away
+	void benchVec() {
+		const int N = 1024;
+		vector<Vec3f> a(N);
+		vector<Vec3f> b(N);
+		vector<Vec3f> out(N);
+		vector<Vec4f> a4(N);
+		vector<Vec4f> out4(N);
+		vector<Mat4f> mats(N);
+		vector<float> scalars(N);
+		for(int i = 0; i < N; i++) {
+			a[i] = Vec3f(i * 0.5f + 1, i % 7 - 3.0f, 2 - i * 0.25f);
+			b[i] = Vec3f(i % 5 + 0.5f, i * 0.125f, i % 3 - 1.0f);
+			a4[i] = Vec4f(a[i], 1);
+			mats[i] = Mat4f::rotation((float)i, b[i]) * Mat4f::translation(a[i]);
+		}
+		Mat4f m = Mat4f::lookAt(Vec3f(1, 2, 3), Vec3f(0, 0, 0), Vec3f(0, 1, 0));
+		
+		timeOp("Vec3f +", N, [&](int i) { out[i] = a[i] + b[i]; });
+		timeOp("Vec3f * float", N, [&](int i) { out[i] = a[i] * 1.5f; });
+		timeOp("Vec3f scaleAdd", N, [&](int i) {
+			out[i] = scaleAdd(a[i], 1.5f, b[i]);
+		});
+		timeOp("Vec3f lerp", N, [&](int i) { out[i] = lerp(a[i], b[i], 0.25f); });
+		timeOp("Vec3f dot", N, [&](int i) { scalars[i] = a[i].dot(b[i]); });
+		timeOp("Vec3f cross", N, [&](int i) { out[i] = a[i].cross(b[i]); });
+		timeOp("Vec3f magnitude", N, [&](int i) { scalars[i] = a[i].magnitude(); });
+		timeOp("Vec3f normalize", N, [&](int i) { out[i] = a[i].normalize(); });
+		vector<float> xs(N), ys(N), zs(N);
+		auto fillSoA = [&]() {
+			for(int i = 0; i < N; i++) {
+				xs[i] = a[i][0];
+				ys[i] = a[i][1];
+				zs[i] = a[i][2];
+			}
+		};
+		//Over whole arrays, the way normalizeFast is meant to be used.  Going
+		//over the same arrays again leaves them unit length.
+		const int REPEATS = 2000;
+		fillSoA();
+		double start = now();
+		for(int r = 0; r < REPEATS; r++) {
+			for(int i = 0; i < N; i++) {
+				Vec3f n = Vec3f(xs[i], ys[i], zs[i]).normalize();
+				xs[i] = n[0];
+				ys[i] = n[1];
+				zs[i] = n[2];
+			}
+		}
+		printf("  %-28s %9.2f ns\n",
+			   "normalize over arrays",
+			   (now() - start) * 1e9 / ((double)REPEATS * N));
+		fillSoA();
+		start = now();
+		for(int r = 0; r < REPEATS; r++) {
+			normalizeFast(&xs[0], &ys[0], &zs[0], N);
+		}
+		printf("  %-28s %9.2f ns\n",
+			   "normalizeFast over arrays",
+			   (now() - start) * 1e9 / ((double)REPEATS * N));
+		timeOp("Vec4f +", N, [&](int i) { out4[i] = a4[i] + a4[(i + 1) % N]; });
+		timeOp("Vec4f scaleAdd", N, [&](int i) {
+			out4[i] = scaleAdd(a4[i], 1.5f, a4[(i + 1) % N]);
+		});
+		timeOp("Vec4f dot", N, [&](int i) {
+			scalars[i] = a4[i].dot(a4[(i + 1) % N]);
+		});
+		timeOp("Mat4f * Vec4f", N, [&](int i) { out4[i] = m * a4[i]; });
+		timeOp("Mat4f transformPoint", N, [&](int i) {
+			out[i] = mats[i].transformPoint(a[i]);
+		});
+		timeOp("Mat4f * Mat4f", N, [&](int i) {
+			mats[i] = mats[i] * mats[(i + 1) % N];
+		});
+		
+		//The last few go through the scalar tail
+		fillSoA();
+		normalizeFast(&xs[0], &ys[0], &zs[0], N - 3);
+		float worst = 0;
+		for(int i = 0; i < N - 3; i++) {
+			Vec3f exact = a[i].normalize();
+			worst = max(worst, (exact - Vec3f(xs[i], ys[i], zs[i])).magnitude());
+		}
+		printf("  %-28s %9.2g\n", "normalizeFast max error", worst);
+		float zero[3] = {0, 0, 0};
+		normalizeFast(zero, zero + 1, zero + 2, 1);
+		printCheck("zero stays zero",
+				   zero[0] == 0 && zero[1] == 0 && zero[2] == 0);
+		
+		Terrain* terrain = loadTerrain("heightmap.bmp", 30.0f);
+		if (terrain == NULL) {
+			printf("  could not load heightmap.bmp\n");
+			return;
+		}
+		const int ITERATIONS = 50;
+		start = now();
+		for(int i = 0; i < ITERATIONS; i++) {
+			terrain->setHeight(0, 0, terrain->getHeight(0, 0)); //Marks normals stale
+			terrain->computeNormals();
+		}
+		printf("  %-28s %9.3f ms\n",
+			   "Terrain::computeNormals",
+			   (now() - start) * 1000 / ITERATIONS);
+		delete terrain;
+	}
+	
+	struct Benchmark {
+		const char* name;
+		void (*run)();
+	};
+	
+	const Benchmark BENCHMARKS[] = {
+		{"bake", benchBake},
+		{"bmp", benchBMP},
+		{"camera", benchCamera},
+		{"flow", benchFlow},
+		{"glstate", benchGLState},
+		{"load", benchLoad},
+		{"lockstep", benchLockstep},
+		{"mip", benchMipmaps},
+		{"particles", benchParticles},
+		{"physics", benchPhysics},
+		{"pipeline", benchPipeline},
+		{"queue", benchQueue},
+		{"raycast", benchRaycast},
+		{"riders", benchRiders},
+		{"rollback", benchRollback},
+		{"scene", benchScene},
+		{"softraster", benchSoftRaster},
+		{"splat", benchSplat},
+		{"text", benchText},
+		{"vec", benchVec},
+		{"water", benchWater}
+	};
+	const int NUM_BENCHMARKS = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+}
+
+int main(int argc, char** argv) {
+	for(int i = 0; i < NUM_BENCHMARKS; i++) {
+		bool selected = argc <= 1;
+		for(int j = 1; j < argc; j++) {
+			if (strcmp(argv[j], BENCHMARKS[i].name) == 0) {
+				selected = true;
+			}
+		}
+		if (selected) {
+			printf("%s:\n", BENCHMARKS[i].name);
+			BENCHMARKS[i].run();
+		}
+	}
+	if (numFailed > 0) {
+		printf("%d check%s failed\n", numFailed, numFailed == 1 ? "" : "s");
+		return 1;
+	}
+	return 0;
+}
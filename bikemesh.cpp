@@ -0,0 +1,134 @@
+#include <math.h>
+
+#include "bikemesh.h"
+#include "vec3f.h"
+
+using namespace std;
+
+namespace {
+	//The parts of a bike, each placed relative to the bike
+	struct BikePart {
+		float offset[3];
+		float color[3];
+		bool wheel; //A sphere of the given radius, rather than a cube
+		float size;
+	};
+	
+	const BikePart BIKE_PARTS[] = {
+		{{1.0f, 0.0f, 0.0f}, {0.1f, 0.1f, 0.1f}, true, 0.25f},  //Front wheel
+		{{-1.0f, 0.0f, 0.0f}, {0.1f, 0.1f, 0.1f}, true, 0.25f}, //Back wheel
+		{{0.0f, 0.0f, 0.0f}, {0.8f, 0.0f, 0.0f}, false, 0.4f},  //Frame
+		{{0.4f, 0.0f, 0.0f}, {0.2f, 0.2f, 0.2f}, false, 0.5f},  //Engine
+		{{-0.5f, 0.0f, 0.0f}, {0.8f, 0.0f, 0.0f}, false, 0.5f}  //Seat
+	};
+	const int NUM_BIKE_PARTS = sizeof(BIKE_PARTS) / sizeof(BIKE_PARTS[0]);
+	
+	//As many as glutSolidSphere(0.25, 5, 5) used
+	const int WHEEL_SLICES = 5;
+	const int WHEEL_STACKS = 5;
+	
+	void addVertex(vector<float> &verts, const BikePart &part,
+				   const Vec3f &pos, const Vec3f &normal) {
+		for(int i = 0; i < 3; i++) {
+			verts.push_back(part.offset[i] + pos[i]);
+		}
+		for(int i = 0; i < 3; i++) {
+			verts.push_back(normal[i]);
+		}
+		for(int i = 0; i < 3; i++) {
+			verts.push_back(part.color[i]);
+		}
+	}
+	
+	//Returns the point on the unit sphere at the given angle from +y and
+	//angle around the y axis
+	Vec3f spherePoint(float down, float around) {
+		return Vec3f(sinf(down) * cosf(around), cosf(down),
+					 sinf(down) * sinf(around));
+	}
+	
+	//Calls corner(n) with the normal at each corner of the sphere's
+	//triangles, three at a time
+	template<class CornerFunc>
+	void forSphereCorners(int slices, int stacks, CornerFunc corner) {
+		const float PI = 3.1415926535f;
+		for(int i = 0; i < stacks; i++) {
+			float down0 = PI * i / stacks;
+			float down1 = PI * (i + 1) / stacks;
+			for(int j = 0; j < slices; j++) {
+				float around0 = 2 * PI * j / slices;
+				float around1 = 2 * PI * (j + 1) / slices;
+				Vec3f corners[4] = {spherePoint(down0, around0),
+									spherePoint(down1, around0),
+									spherePoint(down1, around1),
+									spherePoint(down0, around1)};
+				const int order[6] = {0, 3, 2, 0, 2, 1};
+				for(int k = 0; k < 6; k++) {
+					corner(corners[order[k]]);
+				}
+			}
+		}
+	}
+	
+	void addSphere(vector<float> &verts, const BikePart &part) {
+		forSphereCorners(WHEEL_SLICES, WHEEL_STACKS, [&](const Vec3f &n) {
+			addVertex(verts, part, n * part.size, n);
+		});
+	}
+	
+	void addCube(vector<float> &verts, const BikePart &part) {
+		float h = part.size / 2;
+		for(int axis = 0; axis < 3; axis++) {
+			for(int sign = -1; sign <= 1; sign += 2) {
+				//u cross v is the face's normal, so the corners go
+				//counterclockwise seen from outside
+				Vec3f n(0, 0, 0);
+				Vec3f u(0, 0, 0);
+				Vec3f v(0, 0, 0);
+				n[axis] = (float)sign;
+				u[(axis + 1) % 3] = 1;
+				v[(axis + 2) % 3] = (float)sign;
+				Vec3f corners[4] = {(n - u - v) * h,
+									(n + u - v) * h,
+									(n + u + v) * h,
+									(n - u + v) * h};
+				const int order[6] = {0, 1, 2, 0, 2, 3};
+				for(int k = 0; k < 6; k++) {
+					addVertex(verts, part, corners[order[k]], n);
+				}
+			}
+		}
+	}
+}
+
+BikeMesh::BikeMesh() {
+	for(int i = 0; i < NUM_BIKE_PARTS; i++) {
+		if (BIKE_PARTS[i].wheel) {
+			addSphere(verts, BIKE_PARTS[i]);
+		}
+		else {
+			addCube(verts, BIKE_PARTS[i]);
+		}
+	}
+}
+
+void BikeMesh::draw(const RenderBackend* backend) const {
+	if (backend == NULL) {
+		backend = openGLBackend();
+	}
+	TriangleBatch batch = {&verts[0], numVertices(), 9, 3, 6, -1, NULL, 0};
+	backend->drawTriangles(batch);
+}
+
+vector<float> sphereVertices(float radius, int slices, int stacks) {
+	vector<float> verts;
+	forSphereCorners(slices, stacks, [&](const Vec3f &n) {
+		for(int i = 0; i < 3; i++) {
+			verts.push_back(n[i] * radius);
+		}
+		for(int i = 0; i < 3; i++) {
+			verts.push_back(n[i]);
+		}
+	});
+	return verts;
+}
@@ -0,0 +1,38 @@
+#ifndef BIKE_MESH_H_INCLUDED
+#define BIKE_MESH_H_INCLUDED
+
+#include <vector>
+
+#include "renderqueue.h"
+
+/* The bike's wheels and body, built once into a single mesh in the bike's
+ * space, where +x points forward and +y up.  Each vertex carries its part's
+ * colour, so the whole bike is drawn with one batch of triangles, which
+ * relies on GL_COLOR_MATERIAL being enabled for the colours to be lit.
+ */
+class BikeMesh {
+	private:
+		std::vector<float> verts; //x, y, z, nx, ny, nz, r, g, b for each vertex
+	public:
+		BikeMesh();
+		
+		int numVertices() const {
+			return (int)verts.size() / 9;
+		}
+		
+		//Returns the interleaved vertex data, nine floats per vertex
+		const float* vertices() const {
+			return &verts[0];
+		}
+		
+		//Draws the mesh through backend, or through OpenGL if it's NULL
+		void draw(const RenderBackend* backend = NULL) const;
+};
+
+/* Returns a sphere of the given radius, like glutSolidSphere draws, as
+ * triangles whose vertices are each a position then a normal, ready to be
+ * drawn in a TriangleBatch.
+ */
+std::vector<float> sphereVertices(float radius, int slices, int stacks);
+
+#endif
@@ -0,0 +1,161 @@
+#include <math.h>
+
+#ifdef __APPLE__
+#include <OpenGL/OpenGL.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/glut.h>
+#endif
+
+#include "camera.h"
+
+namespace {
+	/* Moves value toward goal with a critically damped spring, where
+	 * velocity is the spring's velocity, and returns the new value.  This is
+	 * the usual polynomial approximation of the exact solution, which is
+	 * accurate for any dt and doesn't need exp().
+	 */
+	float smoothDamp(float value, float goal, float &velocity,
+					 float smoothTime, float dt) {
+		float omega = 2 / smoothTime;
+		float x = omega * dt;
+		float decay = 1 / (1 + x + 0.48f * x * x + 0.235f * x * x * x);
+		float change = value - goal;
+		float temp = (velocity + omega * change) * dt;
+		velocity = (velocity - omega * temp) * decay;
+		return goal + (change + temp) * decay;
+	}
+	
+	/* Returns the fraction of the way from a to b at which the segment first
+	 * goes under the terrain, plus the given clearance, or 1 if it doesn't.
+	 * The first half unit of the segment is not checked.  Without a
+	 * raycaster, the segment is sampled every half unit.
+	 */
+	float clearFraction(Terrain* terrain, const TerrainRaycaster* raycaster,
+						const float* a, const float* b, float clearance) {
+		float dx = b[0] - a[0];
+		float dy = b[1] - a[1];
+		float dz = b[2] - a[2];
+		int numSteps = (int)(sqrtf(dx * dx + dy * dy + dz * dz) * 2) + 1;
+		if (raycaster != NULL) {
+			//Lowering the segment by the clearance makes it a plain raycast
+			float start = 1.0f / numSteps;
+			const float origin[3] = {a[0] + dx * start,
+									 a[1] + dy * start - clearance,
+									 a[2] + dz * start};
+			const float dir[3] = {dx, dy, dz};
+			float dist;
+			if (raycaster->cast(origin, dir, 1 - start, dist)) {
+				return dist > 0 ? start + dist : 0;
+			}
+			return 1;
+		}
+		
+		for(int i = 1; i <= numSteps; i++) {
+			float t = (float)i / numSteps;
+			float y = a[1] + dy * t;
+			if (y < heightAt(terrain, a[0] + dx * t, a[2] + dz * t) + clearance) {
+				return (float)(i - 1) / numSteps;
+			}
+		}
+		return 1;
+	}
+}
+
+Camera::Camera() :
+	mode(CAMERA_CHASE), smoothTime(0.15f), clearance(1.0f), placed(false),
+	raycaster(NULL) {
+	for(int i = 0; i < 3; i++) {
+		eye[i] = 0;
+		eyeVel[i] = 0;
+		target[i] = 0;
+		targetVel[i] = 0;
+	}
+	view = Mat4f::identity(); //Looking down -z from the origin
+	setPerspective(45, 1, 1, 200);
+}
+
+void Camera::update(Terrain* terrain, const BikeState &bike, float dt) {
+	float lx = cosf(bike.yaw); //The direction the bike faces
+	float lz = -sinf(bike.yaw);
+	float wantEye[3];
+	float wantTarget[3];
+	switch (mode) {
+		case CAMERA_CHASE: {
+			//Tilt with the bike, so that it looks up the hills it climbs
+			float cosPitch = cosf(bike.pitch);
+			float sinPitch = sinf(bike.pitch);
+			wantEye[0] = bike.x - 3 * lx * cosPitch;
+			wantEye[1] = bike.y + 2 - 3 * sinPitch;
+			wantEye[2] = bike.z - 3 * lz * cosPitch;
+			wantTarget[0] = bike.x + 3 * lx * cosPitch;
+			wantTarget[1] = bike.y + 2 + 3 * sinPitch;
+			wantTarget[2] = bike.z + 3 * lz * cosPitch;
+			break;
+		}
+		case CAMERA_SIDE:
+			wantEye[0] = bike.x - 5;
+			wantEye[1] = bike.y + 5;
+			wantEye[2] = bike.z;
+			wantTarget[0] = wantEye[0] + lx;
+			wantTarget[1] = wantEye[1];
+			wantTarget[2] = wantEye[2] + lz;
+			break;
+		default:
+			wantEye[0] = bike.x - 10 * lx;
+			wantEye[1] = bike.y + 50;
+			wantEye[2] = bike.z - 10 * lz;
+			wantTarget[0] = bike.x + 10 * lx;
+			wantTarget[1] = bike.y;
+			wantTarget[2] = bike.z + 10 * lz;
+			break;
+	}
+	
+	//Pull the eye in toward the bike if a hill is in the way
+	const float bikeTop[3] = {bike.x, bike.y + 1, bike.z};
+	float t = clearFraction(terrain, raycaster, bikeTop, wantEye, clearance);
+	for(int i = 0; i < 3; i++) {
+		wantEye[i] = bikeTop[i] + (wantEye[i] - bikeTop[i]) * t;
+	}
+	
+	if (!placed || smoothTime <= 0) {
+		for(int i = 0; i < 3; i++) {
+			eye[i] = wantEye[i];
+			target[i] = wantTarget[i];
+			eyeVel[i] = 0;
+			targetVel[i] = 0;
+		}
+		placed = true;
+	}
+	else {
+		for(int i = 0; i < 3; i++) {
+			eye[i] = smoothDamp(eye[i], wantEye[i], eyeVel[i], smoothTime, dt);
+			target[i] = smoothDamp(target[i], wantTarget[i], targetVel[i],
+								   smoothTime, dt);
+		}
+	}
+	
+	//Whatever the spring did, never go into the ground
+	float ground = heightAt(terrain, eye[0], eye[2]) + clearance;
+	if (eye[1] < ground) {
+		eye[1] = ground;
+		if (eyeVel[1] < 0) {
+			eyeVel[1] = 0;
+		}
+	}
+	
+	view = Mat4f::lookAt(Vec3f(eye[0], eye[1], eye[2]),
+						 Vec3f(target[0], target[1], target[2]),
+						 Vec3f(0, 1, 0));
+}
+
+void Camera::setPerspective(float fovy, float aspect, float zNear, float zFar) {
+	projection = Mat4f::perspective(fovy, aspect, zNear, zFar);
+}
+
+void Camera::load() const {
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(projection.data());
+	glMatrixMode(GL_MODELVIEW);
+	glLoadMatrixf(view.data());
+}
@@ -0,0 +1,90 @@
+#ifndef CAMERA_H_INCLUDED
+#define CAMERA_H_INCLUDED
+
+#include "mat4f.h"
+#include "physics.h"
+#include "raycast.h"
+#include "terrain.h"
+
+//The ways the camera can follow the bike
+enum CameraMode {
+	CAMERA_CHASE = 1,   //Behind the bike, looking where it's going
+	CAMERA_SIDE = 2,    //Off to the side, above the bike
+	CAMERA_OVERHEAD = 3 //High above and behind the bike
+};
+
+/* A camera that follows a bike.  The eye and the point looked at each chase
+ * where the mode wants them with a critically damped spring, so the camera
+ * eases into place without overshooting, at the same speed at any frame
+ * rate.  The eye is kept from going into the terrain or behind a hill.
+ * Given a TerrainRaycaster, hills are found by casting a ray at them, which
+ * is much cheaper than sampling the terrain for the high cameras.
+ *
+ * The matrices are computed here as Mat4fs and given to OpenGL whole with
+ * glLoadMatrixf.
+ */
+class Camera {
+	private:
+		CameraMode mode;
+		float smoothTime; //Roughly how long the camera takes to catch up
+		float clearance;  //How far the eye stays above the terrain
+		bool placed;      //Whether the eye has been placed yet
+		const TerrainRaycaster* raycaster;
+		float eye[3];
+		float eyeVel[3];
+		float target[3];
+		float targetVel[3];
+		Mat4f view;
+		Mat4f projection;
+	public:
+		Camera();
+		
+		CameraMode getMode() const {
+			return mode;
+		}
+		
+		void setMode(CameraMode mode2) {
+			mode = mode2;
+		}
+		
+		//Sets roughly how long the camera takes to catch up with the bike, in
+		//seconds.  0 makes it follow the bike exactly.
+		void setSmoothTime(float seconds) {
+			smoothTime = seconds;
+		}
+		
+		//Sets the raycaster for the terrain passed to update, or NULL to
+		//sample the terrain instead
+		void setRaycaster(const TerrainRaycaster* raycaster2) {
+			raycaster = raycaster2;
+		}
+		
+		//Makes the next update jump straight to where the camera should be
+		void snap() {
+			placed = false;
+		}
+		
+		//Moves the camera dt seconds closer to where the mode wants it for
+		//the given bike
+		void update(Terrain* terrain, const BikeState &bike, float dt);
+		//Sets up a perspective projection, like gluPerspective
+		void setPerspective(float fovy, float aspect, float zNear, float zFar);
+		
+		const Mat4f &viewMatrix() const {
+			return view;
+		}
+		
+		const Mat4f &projectionMatrix() const {
+			return projection;
+		}
+		
+		const float* eyePosition() const {
+			return eye;
+		}
+		
+		//Loads the projection and view matrices into OpenGL, leaving the
+		//modelview matrix current
+		void load() const;
+};
+
+#endif
@@ -0,0 +1,236 @@
+#include <atomic>
+#include <functional>
+#include <math.h>
+#include <queue>
+#include <string.h>
+
+#include "flowfield.h"
+
+using namespace std;
+
+namespace {
+	//The eight neighbours of a grid point
+	const int DIRECTIONS[8][2] = {
+		{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}
+	};
+	const float LENGTHS[8] = {
+		1, 1.41421356f, 1, 1.41421356f, 1, 1.41421356f, 1, 1.41421356f
+	};
+	
+	//How much more a step across a vertical cliff costs than one across flat
+	//ground, minus one
+	const float SLOPE_COST = 10.0f;
+	
+	const float FAR = 1e30f; //The distance of a cell with no goal
+	
+	typedef pair<float, int> QueueItem; //A distance and a cell
+	typedef priority_queue<QueueItem, vector<QueueItem>, greater<QueueItem> >
+		Queue;
+	
+	//The last version given to any flow field
+	atomic<unsigned int> lastVersion(0);
+	
+	//Returns the grid point of a w x l grid nearest (x, z)
+	int nearestCell(float x, float z, int w, int l) {
+		int ix = (int)(x + 0.5f);
+		int iz = (int)(z + 0.5f);
+		ix = ix < 0 ? 0 : (ix > w - 1 ? w - 1 : ix);
+		iz = iz < 0 ? 0 : (iz > l - 1 ? l - 1 : iz);
+		return iz * w + ix;
+	}
+}
+
+FlowField::FlowField(Terrain* terrain2) : terrain(terrain2) {
+	w = terrain->width();
+	l = terrain->length();
+	steepness.resize(w * l);
+	for(int z = 0; z < l; z++) {
+		for(int x = 0; x < w; x++) {
+			Vec3f normal = terrain->getNormal(x, z);
+			steepness[z * w + x] = 1 - normal[1] / normal.magnitude();
+		}
+	}
+	dists.assign(w * l, FAR);
+	goalOf.assign(w * l, -1);
+	next.assign(w * l, -1);
+	changed();
+}
+
+void FlowField::changed() {
+	version = ++lastVersion;
+}
+
+float FlowField::stepCost(int from, int to, int direction) const {
+	return LENGTHS[direction] *
+		(1 + SLOPE_COST * (steepness[from] + steepness[to]) / 2);
+}
+
+void FlowField::relax(const vector<int> &seeds) {
+	Queue queue;
+	for(size_t i = 0; i < seeds.size(); i++) {
+		queue.push(QueueItem(dists[seeds[i]], seeds[i]));
+	}
+	
+	while (!queue.empty()) {
+		QueueItem item = queue.top();
+		queue.pop();
+		int cell = item.second;
+		if (item.first > dists[cell]) {
+			continue; //This cell was reached more cheaply since it was queued
+		}
+		
+		int x = cell % w;
+		int z = cell / w;
+		for(int d = 0; d < 8; d++) {
+			int nx = x + DIRECTIONS[d][0];
+			int nz = z + DIRECTIONS[d][1];
+			if (nx < 0 || nx >= w || nz < 0 || nz >= l) {
+				continue;
+			}
+			
+			int neighbour = nz * w + nx;
+			float dist = item.first + stepCost(neighbour, cell, d);
+			if (dist < dists[neighbour]) {
+				dists[neighbour] = dist;
+				goalOf[neighbour] = goalOf[cell];
+				next[neighbour] = (signed char)((d + 4) % 8);
+				queue.push(QueueItem(dist, neighbour));
+			}
+		}
+	}
+}
+
+void FlowField::addGoal(float x, float z) {
+	int cell = nearestCell(x, z, w, l);
+	if (goalOf[cell] == cell) {
+		return;
+	}
+	
+	goals.push_back(cell);
+	dists[cell] = 0;
+	goalOf[cell] = cell;
+	next[cell] = -1;
+	relax(vector<int>(1, cell));
+	changed();
+}
+
+void FlowField::addGoals(const float (*points)[2], int count) {
+	vector<int> seeds;
+	for(int i = 0; i < count; i++) {
+		int cell = nearestCell(points[i][0], points[i][1], w, l);
+		if (goalOf[cell] == cell) {
+			continue;
+		}
+		goals.push_back(cell);
+		dists[cell] = 0;
+		goalOf[cell] = cell;
+		next[cell] = -1;
+		seeds.push_back(cell);
+	}
+	relax(seeds);
+	changed();
+}
+
+void FlowField::removeGoal(float x, float z) {
+	int cell = nearestCell(x, z, w, l);
+	if (goalOf[cell] != cell) {
+		return;
+	}
+	for(size_t i = 0; i < goals.size(); i++) {
+		if (goals[i] == cell) {
+			goals.erase(goals.begin() + i);
+			break;
+		}
+	}
+	
+	//Every cell that was headed for the goal has to find another one.  The
+	//rest are still headed for their nearest goal, so the new distances can
+	//be found by working inward from the edge of the cells that lost theirs.
+	vector<int> lost;
+	for(int i = 0; i < w * l; i++) {
+		if (goalOf[i] == cell) {
+			dists[i] = FAR;
+			goalOf[i] = -1;
+			next[i] = -1;
+			lost.push_back(i);
+		}
+	}
+	
+	vector<int> edge;
+	for(size_t i = 0; i < lost.size(); i++) {
+		int x2 = lost[i] % w;
+		int z2 = lost[i] / w;
+		for(int d = 0; d < 8; d++) {
+			int nx = x2 + DIRECTIONS[d][0];
+			int nz = z2 + DIRECTIONS[d][1];
+			if (nx >= 0 && nx < w && nz >= 0 && nz < l &&
+				goalOf[nz * w + nx] >= 0) {
+				edge.push_back(nz * w + nx);
+			}
+		}
+	}
+	relax(edge);
+	changed();
+}
+
+void FlowField::clearGoals() {
+	goals.clear();
+	dists.assign(w * l, FAR);
+	goalOf.assign(w * l, -1);
+	next.assign(w * l, -1);
+	changed();
+}
+
+int FlowField::stateSize() const {
+	return (int)sizeof(version) + w * l * (int)(sizeof(float) + sizeof(int) + 1);
+}
+
+void FlowField::saveState(unsigned char* dest) const {
+	int n = w * l;
+	memcpy(dest, &version, sizeof(version));
+	dest += sizeof(version);
+	memcpy(dest, &dists[0], n * sizeof(float));
+	dest += n * sizeof(float);
+	memcpy(dest, &goalOf[0], n * sizeof(int));
+	dest += n * sizeof(int);
+	memcpy(dest, &next[0], n);
+}
+
+void FlowField::restoreState(const unsigned char* src) {
+	int n = w * l;
+	memcpy(&version, src, sizeof(version));
+	src += sizeof(version);
+	memcpy(&dists[0], src, n * sizeof(float));
+	src += n * sizeof(float);
+	memcpy(&goalOf[0], src, n * sizeof(int));
+	src += n * sizeof(int);
+	memcpy(&next[0], src, n);
+	
+	//The goals are the cells that are their own nearest goal
+	goals.clear();
+	for(int i = 0; i < n; i++) {
+		if (goalOf[i] == i) {
+			goals.push_back(i);
+		}
+	}
+}
+
+bool FlowField::isGoal(float x, float z) const {
+	int cell = nearestCell(x, z, w, l);
+	return goalOf[cell] == cell;
+}
+
+float FlowField::distance(float x, float z) const {
+	int cell = nearestCell(x, z, w, l);
+	return goalOf[cell] >= 0 ? dists[cell] : -1;
+}
+
+bool FlowField::direction(float x, float z, float &dx, float &dz) const {
+	int d = next[nearestCell(x, z, w, l)];
+	if (d < 0) {
+		return false;
+	}
+	dx = DIRECTIONS[d][0] / LENGTHS[d];
+	dz = DIRECTIONS[d][1] / LENGTHS[d];
+	return true;
+}
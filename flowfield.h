@@ -0,0 +1,77 @@
+#ifndef FLOW_FIELD_H_INCLUDED
+#define FLOW_FIELD_H_INCLUDED
+
+#include <vector>
+
+#include "terrain.h"
+
+/* For every point of the terrain grid, the cheapest way to the nearest goal,
+ * where moving across steep ground costs more than moving across flat ground.
+ * A rider only has to look up the cell it's in to know which way to go.
+ *
+ * Adding or removing a goal only recomputes the cells whose nearest goal
+ * changes, rather than the whole grid.
+ */
+class FlowField {
+	private:
+		Terrain* terrain;
+		int w; //Width
+		int l; //Length
+		std::vector<float> steepness; //How steep the ground is at each cell
+		std::vector<float> dists;     //The cost to reach the nearest goal
+		std::vector<int> goalOf;      //The cell of the nearest goal, or -1
+		std::vector<signed char> next; //The neighbour to head for, or -1
+		std::vector<int> goals;       //The cells that are goals
+		unsigned int version;         //Changes whenever the field does
+		
+		void changed();
+		
+		float stepCost(int from, int to, int direction) const;
+		//Lowers the distances around the given cells, which must already
+		//have their final distances, until nothing more changes
+		void relax(const std::vector<int> &seeds);
+	public:
+		//Builds a field with no goals.  The terrain must outlive the field.
+		explicit FlowField(Terrain* terrain);
+		
+		//Makes the grid point nearest (x, z) a goal
+		void addGoal(float x, float z);
+		//Makes the grid points nearest each of the given (x, z) points goals.
+		//This is quicker than adding them one at a time.
+		void addGoals(const float (*points)[2], int count);
+		//Stops the grid point nearest (x, z) being a goal
+		void removeGoal(float x, float z);
+		//Removes every goal
+		void clearGoals();
+		//Returns whether the grid point nearest (x, z) is a goal
+		bool isGoal(float x, float z) const;
+		int numGoals() const {
+			return (int)goals.size();
+		}
+		
+		/* Returns a number that identifies the field's current contents.  It
+		 * changes whenever a goal is added or removed, and is never reused
+		 * by any field, so a saved field with the same version is the same.
+		 */
+		unsigned int getVersion() const {
+			return version;
+		}
+		//Returns the size in bytes of the field, as saved by saveState
+		int stateSize() const;
+		//Copies the field to dest, which must have room for stateSize() bytes
+		void saveState(unsigned char* dest) const;
+		//Sets the field back to one saved by saveState from a field on the
+		//same terrain
+		void restoreState(const unsigned char* src);
+		
+		//Returns the cost to reach the nearest goal from (x, z), or a negative
+		//number if there are no goals
+		float distance(float x, float z) const;
+		/* Sets (dx, dz) to the unit direction to head in from (x, z) to reach
+		 * the nearest goal.  Returns false, leaving them as they were, if
+		 * there are no goals or (x, z) is at a goal.
+		 */
+		bool direction(float x, float z, float &dx, float &dz) const;
+};
+
+#endif
@@ -0,0 +1,217 @@
+#include <map>
+#include <string.h>
+#include <utility>
+
+#include "glstate.h"
+
+using namespace std;
+
+namespace {
+	const GLBackend OPENGL_BACKEND = {
+		glEnable,
+		glDisable,
+		glShadeModel,
+		glFrontFace,
+		glBindTexture,
+		glDeleteTextures,
+		glLightfv,
+		glLightModelfv
+	};
+	
+	//A parameter of up to four floats
+	struct Param {
+		GLfloat values[4];
+	};
+	
+	const GLBackend* backend = &OPENGL_BACKEND;
+	GLStateStats stats = {0, 0};
+	
+	//The capabilities that have been changed, and whether they're enabled.
+	//Capabilities that aren't in the map have their initial value, which is
+	//disabled for everything the game uses.
+	map<GLenum, bool> caps;
+	GLenum shadeModel = GL_SMOOTH;
+	GLenum frontFace = GL_CCW;
+	GLuint boundTexture = 0;
+	//The light parameters that have been set, by light and parameter name
+	map<pair<GLenum, GLenum>, Param> lightParams;
+	map<GLenum, Param> lightModelParams;
+	
+	//Returns how many floats a light or light model parameter has
+	int paramSize(GLenum pname) {
+		switch (pname) {
+			case GL_AMBIENT:
+			case GL_DIFFUSE:
+			case GL_SPECULAR:
+			case GL_POSITION:
+			case GL_LIGHT_MODEL_AMBIENT:
+				return 4;
+			case GL_SPOT_DIRECTION:
+				return 3;
+			default:
+				return 1;
+		}
+	}
+	
+	//Stores params in cache under key and returns true, or returns false if
+	//they're already there
+	template<class Key>
+	bool storeParam(map<Key, Param> &cache, const Key &key, GLenum pname,
+					const GLfloat* params) {
+		int size = paramSize(pname);
+		typename map<Key, Param>::iterator it = cache.find(key);
+		if (it != cache.end() &&
+			memcmp(it->second.values, params, size * sizeof(GLfloat)) == 0) {
+			return false;
+		}
+		memcpy(cache[key].values, params, size * sizeof(GLfloat));
+		return true;
+	}
+}
+
+void glsEnable(GLenum cap) {
+	glsSetEnabled(cap, true);
+}
+
+void glsDisable(GLenum cap) {
+	glsSetEnabled(cap, false);
+}
+
+void glsSetEnabled(GLenum cap, bool enabled) {
+	map<GLenum, bool>::iterator it = caps.find(cap);
+	if (it != caps.end() && it->second == enabled) {
+		stats.skipped++;
+		return;
+	}
+	if (it == caps.end() && !enabled) {
+		caps[cap] = false;
+		stats.skipped++;
+		return;
+	}
+	
+	if (enabled) {
+		backend->enable(cap);
+	}
+	else {
+		backend->disable(cap);
+	}
+	caps[cap] = enabled;
+	stats.calls++;
+}
+
+bool glsIsEnabled(GLenum cap) {
+	map<GLenum, bool>::iterator it = caps.find(cap);
+	return it != caps.end() && it->second;
+}
+
+void glsShadeModel(GLenum mode) {
+	if (mode != shadeModel) {
+		backend->shadeModel(mode);
+		shadeModel = mode;
+		stats.calls++;
+	}
+	else {
+		stats.skipped++;
+	}
+}
+
+GLenum glsGetShadeModel() {
+	return shadeModel;
+}
+
+void glsFrontFace(GLenum mode) {
+	if (mode != frontFace) {
+		backend->frontFace(mode);
+		frontFace = mode;
+		stats.calls++;
+	}
+	else {
+		stats.skipped++;
+	}
+}
+
+GLenum glsGetFrontFace() {
+	return frontFace;
+}
+
+void glsBindTexture(GLuint texture) {
+	if (texture != boundTexture) {
+		backend->bindTexture(GL_TEXTURE_2D, texture);
+		boundTexture = texture;
+		stats.calls++;
+	}
+	else {
+		stats.skipped++;
+	}
+}
+
+GLuint glsGetBoundTexture() {
+	return boundTexture;
+}
+
+void glsDeleteTextures(GLsizei n, const GLuint* textures) {
+	backend->deleteTextures(n, textures);
+	for(GLsizei i = 0; i < n; i++) {
+		if (textures[i] == boundTexture) {
+			boundTexture = 0;
+		}
+	}
+	stats.calls++;
+}
+
+void glsLightfv(GLenum light, GLenum pname, const GLfloat* params) {
+	//Store the value first, so a position or direction that is passed on
+	//anyway can still be read back
+	bool changed = storeParam(lightParams, make_pair(light, pname), pname,
+							  params);
+	if (changed || pname == GL_POSITION || pname == GL_SPOT_DIRECTION) {
+		backend->lightfv(light, pname, params);
+		stats.calls++;
+	}
+	else {
+		stats.skipped++;
+	}
+}
+
+bool glsGetLightfv(GLenum light, GLenum pname, GLfloat* params) {
+	map<pair<GLenum, GLenum>, Param>::iterator it =
+		lightParams.find(make_pair(light, pname));
+	if (it == lightParams.end()) {
+		return false;
+	}
+	memcpy(params, it->second.values, paramSize(pname) * sizeof(GLfloat));
+	return true;
+}
+
+void glsLightModelfv(GLenum pname, const GLfloat* params) {
+	if (storeParam(lightModelParams, pname, pname, params)) {
+		backend->lightModelfv(pname, params);
+		stats.calls++;
+	}
+	else {
+		stats.skipped++;
+	}
+}
+
+void glsSetBackend(const GLBackend* backend2) {
+	backend = backend2 != NULL ? backend2 : &OPENGL_BACKEND;
+	glsReset();
+}
+
+void glsReset() {
+	caps.clear();
+	shadeModel = GL_SMOOTH;
+	frontFace = GL_CCW;
+	boundTexture = 0;
+	lightParams.clear();
+	lightModelParams.clear();
+}
+
+GLStateStats glsGetStats() {
+	return stats;
+}
+
+void glsResetStats() {
+	stats.calls = 0;
+	stats.skipped = 0;
+}
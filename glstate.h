@@ -0,0 +1,77 @@
+#ifndef GL_STATE_H_INCLUDED
+#define GL_STATE_H_INCLUDED
+
+#ifdef __APPLE__
+#include <OpenGL/OpenGL.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/glut.h>
+#endif
+
+/* A client-side copy of the OpenGL state that the game changes.  Changing
+ * state through these functions skips calls that wouldn't change anything,
+ * and reading it back doesn't need a glGet, which can stall the pipeline.
+ * This only works if the state is never changed by calling OpenGL directly.
+ */
+
+//Enables or disables a capability, such as GL_LIGHTING
+void glsEnable(GLenum cap);
+void glsDisable(GLenum cap);
+void glsSetEnabled(GLenum cap, bool enabled);
+//Returns whether a capability is enabled
+bool glsIsEnabled(GLenum cap);
+
+void glsShadeModel(GLenum mode);
+GLenum glsGetShadeModel();
+void glsFrontFace(GLenum mode);
+GLenum glsGetFrontFace();
+
+//Binds a texture to GL_TEXTURE_2D
+void glsBindTexture(GLuint texture);
+//Returns the texture bound to GL_TEXTURE_2D
+GLuint glsGetBoundTexture();
+//Deletes textures, unbinding any of them that is bound, like glDeleteTextures
+void glsDeleteTextures(GLsizei n, const GLuint* textures);
+
+/* Sets a light parameter, like glLightfv.  GL_POSITION and
+ * GL_SPOT_DIRECTION are always passed on, since OpenGL transforms them by
+ * the modelview matrix, so the same values can mean something different.
+ */
+void glsLightfv(GLenum light, GLenum pname, const GLfloat* params);
+/* Copies a light parameter that was set through glsLightfv into params and
+ * returns true, or returns false if it hasn't been set that way.  A
+ * GL_POSITION or GL_SPOT_DIRECTION comes back as it was passed, not
+ * transformed into eye coordinates the way glGetLightfv returns it.
+ */
+bool glsGetLightfv(GLenum light, GLenum pname, GLfloat* params);
+void glsLightModelfv(GLenum pname, const GLfloat* params);
+
+//The OpenGL calls that the state changes are passed on to.  Tests can use a
+//mock backend to check what gets through without a GL context.
+struct GLBackend {
+	void (*enable)(GLenum cap);
+	void (*disable)(GLenum cap);
+	void (*shadeModel)(GLenum mode);
+	void (*frontFace)(GLenum mode);
+	void (*bindTexture)(GLenum target, GLuint texture);
+	void (*deleteTextures)(GLsizei n, const GLuint* textures);
+	void (*lightfv)(GLenum light, GLenum pname, const GLfloat* params);
+	void (*lightModelfv)(GLenum pname, const GLfloat* params);
+};
+
+//Counts of the state changes made through these functions
+struct GLStateStats {
+	int calls;   //Changes passed on to the backend
+	int skipped; //Changes skipped because they wouldn't have done anything
+};
+
+//Passes state changes to backend, or to OpenGL if it's NULL, and forgets
+//the state, as glsReset does
+void glsSetBackend(const GLBackend* backend);
+//Forgets the state, so that it's taken to be OpenGL's initial state, e.g.
+//for a new context
+void glsReset();
+GLStateStats glsGetStats();
+void glsResetStats();
+
+#endif
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include <OpenGL/OpenGL.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/glut.h>
+#endif
+
+#include "glstate.h"
+#include "hud.h"
+
+using namespace std;
+
+namespace {
+	//The height of the text, in pixels
+	const float TEXT_SIZE = 18.0f;
+	//How often the frame rate and frame times are updated, in seconds
+	const double STATS_INTERVAL = 0.5;
+	
+	//Returns the time in seconds since an arbitrary point
+	double now() {
+		return chrono::duration<double>(
+			chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+Hud::Hud() : score(0), timeLeft(0), windowWidth(1), windowHeight(1),
+	numFrameTimes(0), nextFrameTime(0), lastFrame(-1), lastStats(-1),
+	framesSinceStats(0) {
+	gameLine.mesh = NULL;
+	gameLine.dirty = true;
+	statsLine.mesh = NULL;
+	statsLine.dirty = true;
+	setText(gameLine, "Score: 0   Time: 0");
+}
+
+Hud::~Hud() {
+	delete gameLine.mesh;
+	delete statsLine.mesh;
+}
+
+void Hud::setText(Line &line, const char* text) {
+	if (line.text != text) {
+		line.text = text;
+		line.dirty = true;
+	}
+}
+
+void Hud::setScore(int score1) {
+	if (score1 != score) {
+		score = score1;
+		char text[64];
+		sprintf(text, "Score: %d   Time: %d", score, timeLeft);
+		setText(gameLine, text);
+	}
+}
+
+void Hud::setTimeLeft(int timeLeft1) {
+	if (timeLeft1 != timeLeft) {
+		timeLeft = timeLeft1;
+		char text[64];
+		sprintf(text, "Score: %d   Time: %d", score, timeLeft);
+		setText(gameLine, text);
+	}
+}
+
+void Hud::resize(int width, int height) {
+	windowWidth = width > 0 ? width : 1;
+	windowHeight = height > 0 ? height : 1;
+}
+
+void Hud::frameDone() {
+	double time = now();
+	if (lastFrame >= 0) {
+		frameTimes[nextFrameTime] = (float)((time - lastFrame) * 1000);
+		nextFrameTime = (nextFrameTime + 1) % NUM_FRAME_TIMES;
+		if (numFrameTimes < NUM_FRAME_TIMES) {
+			numFrameTimes++;
+		}
+	}
+	lastFrame = time;
+	framesSinceStats++;
+	
+	if (lastStats < 0) {
+		lastStats = time;
+	}
+	else if (time - lastStats >= STATS_INTERVAL) {
+		updateStats(time);
+	}
+}
+
+void Hud::updateStats(double time) {
+	float fps = (float)(framesSinceStats / (time - lastStats));
+	lastStats = time;
+	framesSinceStats = 0;
+	if (numFrameTimes == 0) {
+		return;
+	}
+	
+	float sorted[NUM_FRAME_TIMES];
+	memcpy(sorted, frameTimes, numFrameTimes * sizeof(float));
+	sort(sorted, sorted + numFrameTimes);
+	float p50 = sorted[numFrameTimes * 50 / 100];
+	float p95 = sorted[numFrameTimes * 95 / 100];
+	float p99 = sorted[numFrameTimes * 99 / 100];
+	
+	char text[128];
+	sprintf(text, "%.0f FPS   %.1f / %.1f / %.1f ms (50/95/99%%)",
+			fps, p50, p95, p99);
+	setText(statsLine, text);
+}
+
+void Hud::drawLine(Line &line, float x, float y) {
+	if (line.dirty) {
+		delete line.mesh;
+		line.mesh = t3dMake2D(line.text, -1, -1);
+		line.dirty = false;
+	}
+	
+	glPushMatrix();
+	glTranslatef(x, y, 0);
+	glScalef(TEXT_SIZE, TEXT_SIZE, TEXT_SIZE);
+	t3dDrawMesh(line.mesh);
+	glPopMatrix();
+}
+
+void Hud::draw() {
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0, windowWidth, 0, windowHeight, -TEXT_SIZE, TEXT_SIZE);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	
+	bool lighting = glsIsEnabled(GL_LIGHTING);
+	bool depthTest = glsIsEnabled(GL_DEPTH_TEST);
+	glsDisable(GL_LIGHTING);
+	glsDisable(GL_DEPTH_TEST);
+	
+	glColor3f(1.0f, 1.0f, 1.0f);
+	float margin = TEXT_SIZE;
+	drawLine(gameLine, margin, windowHeight - margin);
+	if (!statsLine.text.empty()) {
+		drawLine(statsLine, margin, windowHeight - margin - 2 * TEXT_SIZE);
+	}
+	
+	glsSetEnabled(GL_LIGHTING, lighting);
+	glsSetEnabled(GL_DEPTH_TEST, depthTest);
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+}
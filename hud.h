@@ -0,0 +1,54 @@
+#ifndef HUD_H_INCLUDED
+#define HUD_H_INCLUDED
+
+#include <string>
+
+#include "text3d.h"
+
+/* The heads-up display: the score and time left, plus the frame rate and frame
+ * time percentiles.  Each line of text is only laid out again when one of its
+ * values changes, so drawing an unchanged HUD is just a couple of draw calls.
+ */
+class Hud {
+	private:
+		//A line of text, and the mesh for it if it's up to date
+		struct Line {
+			std::string text;
+			T3DMesh* mesh;
+			bool dirty;
+		};
+		
+		static const int NUM_FRAME_TIMES = 256;
+		
+		Line gameLine; //Score and time
+		Line statsLine; //Frame rate and frame times
+		int score;
+		int timeLeft;
+		int windowWidth;
+		int windowHeight;
+		
+		//The lengths of the most recent frames, in milliseconds
+		float frameTimes[NUM_FRAME_TIMES];
+		int numFrameTimes;
+		int nextFrameTime;
+		double lastFrame; //When the last frame was drawn, in seconds
+		double lastStats; //When the stats line was last updated
+		int framesSinceStats;
+		
+		static void setText(Line &line, const char* text);
+		void updateStats(double time);
+		void drawLine(Line &line, float x, float y);
+	public:
+		Hud();
+		~Hud();
+		
+		void setScore(int score1);
+		void setTimeLeft(int timeLeft1);
+		void resize(int width, int height);
+		//Records that a frame has been drawn.  Call once per frame.
+		void frameDone();
+		//Draws the HUD over whatever has been drawn
+		void draw();
+};
+
+#endif
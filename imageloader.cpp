@@ -22,8 +22,14 @@
 
 
 
-#include <assert.h>
 #include <fstream>
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+	(defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define IMAGE_LOADER_SSSE3
+#endif
 
 #include "imageloader.h"
 
@@ -52,20 +58,6 @@ namespace {
 					   (unsigned char)bytes[0]);
 	}
 	
-	//Reads the next four bytes as an integer, using little-endian form
-	int readInt(ifstream &input) {
-		char buffer[4];
-		input.read(buffer, 4);
-		return toInt(buffer);
-	}
-	
-	//Reads the next two bytes as a short, using little-endian form
-	short readShort(ifstream &input) {
-		char buffer[2];
-		input.read(buffer, 2);
-		return toShort(buffer);
-	}
-	
 	//Just like auto_ptr, but for arrays
 	template<class T>
 	class auto_array {
@@ -130,81 +122,386 @@ namespace {
 				return array[i];
 			}
 	};
+	
+	//Values of the compression field of the header
+	enum Compression {BI_RGB = 0,
+					  BI_BITFIELDS = 3,
+					  BI_ALPHABITFIELDS = 6};
+	
+	//Converts count pixels in (B, G, R) order to (R, G, B) order
+	void swizzleBGR(const unsigned char* src, unsigned char* dest, int count) {
+		for(int i = 0; i < count; i++) {
+			dest[0] = src[2];
+			dest[1] = src[1];
+			dest[2] = src[0];
+			src += 3;
+			dest += 3;
+		}
+	}
+	
+	//Converts count pixels in (B, G, R, X) order to (R, G, B) order
+	void swizzleBGRX(const unsigned char* src, unsigned char* dest, int count) {
+		for(int i = 0; i < count; i++) {
+			dest[0] = src[2];
+			dest[1] = src[1];
+			dest[2] = src[0];
+			src += 4;
+			dest += 3;
+		}
+	}
+	
+#ifdef IMAGE_LOADER_SSSE3
+	/* SSSE3 versions of the above.  Each step loads and stores 16 bytes but
+	 * only converts five (or four) pixels; the bytes written past them are
+	 * overwritten by the next step, so we stop while a sixth pixel remains and
+	 * let the scalar loop finish the row.
+	 */
+	__attribute__((target("ssse3")))
+	void swizzleBGRSSSE3(const unsigned char* src,
+						 unsigned char* dest,
+						 int count) {
+		const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7,
+											  6, 11, 10, 9, 14, 13, 12, 15);
+		int i = 0;
+		for(; i + 6 <= count; i += 5) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+			_mm_storeu_si128((__m128i*)(dest + 3 * i),
+							 _mm_shuffle_epi8(v, shuffle));
+		}
+		swizzleBGR(src + 3 * i, dest + 3 * i, count - i);
+	}
+	
+	__attribute__((target("ssse3")))
+	void swizzleBGRXSSSE3(const unsigned char* src,
+						  unsigned char* dest,
+						  int count) {
+		const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9,
+											  8, 14, 13, 12, -1, -1, -1, -1);
+		int i = 0;
+		for(; i + 6 <= count; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+			_mm_storeu_si128((__m128i*)(dest + 3 * i),
+							 _mm_shuffle_epi8(v, shuffle));
+		}
+		swizzleBGRX(src + 4 * i, dest + 3 * i, count - i);
+	}
+#endif
+	
+	typedef void (*SwizzleFunc)(const unsigned char*, unsigned char*, int);
+	
+	//Returns the fastest available conversion for 3- or 4-byte pixels
+	SwizzleFunc swizzleFunc(int bytesPerPixel) {
+#ifdef IMAGE_LOADER_SSSE3
+		if (__builtin_cpu_supports("ssse3")) {
+			return bytesPerPixel == 3 ? swizzleBGRSSSE3 : swizzleBGRXSSSE3;
+		}
+#endif
+		return bytesPerPixel == 3 ? swizzleBGR : swizzleBGRX;
+	}
+	
+	//Describes how to pull one 8-bit channel out of a masked pixel value
+	struct Channel {
+		unsigned int mask;
+		int shift;
+		int bits;
+	};
+	
+	Channel toChannel(unsigned int mask) {
+		Channel channel;
+		channel.mask = mask;
+		channel.shift = 0;
+		channel.bits = 0;
+		if (mask != 0) {
+			while (((mask >> channel.shift) & 1) == 0) {
+				channel.shift++;
+			}
+			while (channel.shift + channel.bits < 32 &&
+				   ((mask >> (channel.shift + channel.bits)) & 1) != 0) {
+				channel.bits++;
+			}
+		}
+		return channel;
+	}
+	
+	unsigned char extract(unsigned int pixel, const Channel &channel) {
+		if (channel.bits == 0) {
+			return 0;
+		}
+		unsigned int value = (pixel & channel.mask) >> channel.shift;
+		if (channel.bits >= 8) {
+			return (unsigned char)(value >> (channel.bits - 8));
+		}
+		return (unsigned char)(value * 255 / ((1u << channel.bits) - 1));
+	}
+	
+	//Converts a row of 16- or 32-bit pixels with arbitrary channel masks
+	void convertMasked(const unsigned char* src,
+					   unsigned char* dest,
+					   int count,
+					   int bytesPerPixel,
+					   const Channel* channels) {
+		for(int i = 0; i < count; i++) {
+			unsigned int pixel = src[0] | (src[1] << 8);
+			if (bytesPerPixel == 4) {
+				pixel |= (src[2] << 16) | ((unsigned int)src[3] << 24);
+			}
+			dest[0] = extract(pixel, channels[0]);
+			dest[1] = extract(pixel, channels[1]);
+			dest[2] = extract(pixel, channels[2]);
+			src += bytesPerPixel;
+			dest += 3;
+		}
+	}
+	
+	//Converts a row of 8-bit palette indices
+	void convertPaletted(const unsigned char* src,
+						 unsigned char* dest,
+						 int count,
+						 const unsigned char* palette) {
+		for(int i = 0; i < count; i++) {
+			const unsigned char* color = palette + 3 * src[i];
+			dest[0] = color[0];
+			dest[1] = color[1];
+			dest[2] = color[2];
+			dest += 3;
+		}
+	}
 }
 
-Image* loadBMP(const char* filename) {
-	ifstream input;
-	input.open(filename, ifstream::binary);
-	assert(!input.fail() || !"Could not find file");
-	char buffer[2];
-	input.read(buffer, 2);
-	assert((buffer[0] == 'B' && buffer[1] == 'M') || !"Not a bitmap file");
-	input.ignore(8);
-	int dataOffset = readInt(input);
+Image* loadBMPFromMemory(const char* bytes, int size) {
+	if (bytes == NULL || size < 18 || bytes[0] != 'B' || bytes[1] != 'M') {
+		return NULL; //Not a bitmap file
+	}
+	int dataOffset = toInt(bytes + 10);
 	
 	//Read the header
-	int headerSize = readInt(input);
+	int headerSize = toInt(bytes + 14);
+	if (headerSize < 12 || headerSize > size - 14) {
+		return NULL;
+	}
 	int width;
 	int height;
+	int bitsPerPixel;
+	int compression = BI_RGB;
+	int paletteOffset = 14 + headerSize;
+	int paletteEntrySize = 4;
+	int numColors = 0;
+	unsigned int masks[3] = {0, 0, 0};
 	switch(headerSize) {
-		case 40:
-			//V3
-			width = readInt(input);
-			height = readInt(input);
-			input.ignore(2);
-			assert(readShort(input) == 24 || !"Image is not 24 bits per pixel");
-			assert(readShort(input) == 0 || !"Image is compressed");
-			break;
 		case 12:
 			//OS/2 V1
-			width = readShort(input);
-			height = readShort(input);
-			input.ignore(2);
-			assert(readShort(input) == 24 || !"Image is not 24 bits per pixel");
+			width = (unsigned short)toShort(bytes + 18);
+			height = (unsigned short)toShort(bytes + 20);
+			bitsPerPixel = toShort(bytes + 24);
+			paletteEntrySize = 3;
 			break;
+		case 40:
+		case 52:
+		case 56:
 		case 64:
-			//OS/2 V2
-			assert(!"Can't load OS/2 V2 bitmaps");
-			break;
 		case 108:
-			//Windows V4
-			assert(!"Can't load Windows V4 bitmaps");
-			break;
 		case 124:
-			//Windows V5
-			assert(!"Can't load Windows V5 bitmaps");
+			//Windows V3 (with the optional mask extensions), OS/2 V2, Windows
+			//V4 and Windows V5 all share the first 40 bytes
+			width = toInt(bytes + 18);
+			height = toInt(bytes + 22);
+			bitsPerPixel = toShort(bytes + 28);
+			compression = toInt(bytes + 30);
+			numColors = toInt(bytes + 46);
+			if (headerSize == 64 && compression != BI_RGB) {
+				return NULL; //OS/2 compression schemes
+			}
+			if (compression == BI_BITFIELDS ||
+				compression == BI_ALPHABITFIELDS) {
+				//A bare V3 header is followed by the masks; the larger
+				//headers hold them in place
+				int maskOffset = 54;
+				if (headerSize == 40) {
+					paletteOffset += compression == BI_BITFIELDS ? 12 : 16;
+					if (paletteOffset > size) {
+						return NULL;
+					}
+				}
+				for(int i = 0; i < 3; i++) {
+					masks[i] = (unsigned int)toInt(bytes + maskOffset + 4 * i);
+				}
+			}
+			else if (compression != BI_RGB) {
+				return NULL; //Image is compressed
+			}
 			break;
 		default:
-			assert(!"Unknown bitmap format");
+			return NULL; //Unknown bitmap format
+	}
+	
+	bool topDown = height < 0;
+	if (topDown) {
+		height = -height;
+	}
+	if (width <= 0 || height <= 0 ||
+		(long long)width * height * 3 > 0x7FFFFFFF) {
+		return NULL;
+	}
+	
+	int bytesPerPixel = bitsPerPixel / 8;
+	if (bitsPerPixel != 8 && bitsPerPixel != 16 &&
+		bitsPerPixel != 24 && bitsPerPixel != 32) {
+		return NULL;
+	}
+	if (compression != BI_RGB && bitsPerPixel != 16 && bitsPerPixel != 32) {
+		return NULL;
+	}
+	
+	//Rows are padded to a multiple of four bytes.  Some writers leave the
+	//padding off the last row, so we only require the pixels themselves.
+	long long bytesPerRow = (((long long)width * bitsPerPixel + 31) / 32) * 4;
+	long long dataSize = bytesPerRow * (height - 1) +
+		(long long)width * bytesPerPixel;
+	if (dataOffset < 14 + headerSize || dataOffset + dataSize > size) {
+		return NULL;
+	}
+	
+	unsigned char palette[256 * 3];
+	if (bitsPerPixel == 8) {
+		if (numColors <= 0 || numColors > 256) {
+			numColors = 256;
+		}
+		memset(palette, 0, sizeof(palette));
+		for(int i = 0; i < numColors; i++) {
+			int offset = paletteOffset + paletteEntrySize * i;
+			if (offset + 3 > dataOffset) {
+				break;
+			}
+			palette[3 * i] = (unsigned char)bytes[offset + 2];
+			palette[3 * i + 1] = (unsigned char)bytes[offset + 1];
+			palette[3 * i + 2] = (unsigned char)bytes[offset];
+		}
 	}
 	
-	//Read the data
-	int bytesPerRow = ((width * 3 + 3) / 4) * 4 - (width * 3 % 4);
-	int size = bytesPerRow * height;
-	auto_array<char> pixels(new char[size]);
-	input.seekg(dataOffset, ios_base::beg);
-	input.read(pixels.get(), size);
+	//Standard masks are just BGR(X) in memory, which takes the fast path
+	bool masked = false;
+	Channel channels[3];
+	if (bitsPerPixel == 16 || bitsPerPixel == 32) {
+		if (compression == BI_RGB) {
+			if (bitsPerPixel == 16) {
+				masks[0] = 0x7C00;
+				masks[1] = 0x03E0;
+				masks[2] = 0x001F;
+			}
+			else {
+				masks[0] = 0xFF0000;
+				masks[1] = 0x00FF00;
+				masks[2] = 0x0000FF;
+			}
+		}
+		masked = bitsPerPixel == 16 || masks[0] != 0xFF0000 ||
+			masks[1] != 0x00FF00 || masks[2] != 0x0000FF;
+		for(int i = 0; i < 3; i++) {
+			channels[i] = toChannel(masks[i]);
+		}
+	}
 	
 	//Get the data into the right format
-	auto_array<char> pixels2(new char[width * height * 3]);
+	auto_array<char> pixels(new char[width * height * 3]);
+	const unsigned char* data = (const unsigned char*)bytes + dataOffset;
+	unsigned char* dest = (unsigned char*)pixels.get();
+	SwizzleFunc swizzle =
+		bitsPerPixel >= 24 ? swizzleFunc(bytesPerPixel) : NULL;
 	for(int y = 0; y < height; y++) {
-		for(int x = 0; x < width; x++) {
-			for(int c = 0; c < 3; c++) {
-				pixels2[3 * (width * y + x) + c] =
-					pixels[bytesPerRow * y + 3 * x + (2 - c)];
-			}
+		const unsigned char* src =
+			data + bytesPerRow * (topDown ? height - 1 - y : y);
+		unsigned char* destRow = dest + 3 * width * y;
+		if (bitsPerPixel == 8) {
+			convertPaletted(src, destRow, width, palette);
+		}
+		else if (masked) {
+			convertMasked(src, destRow, width, bytesPerPixel, channels);
+		}
+		else {
+			swizzle(src, destRow, width);
 		}
 	}
 	
-	input.close();
-	return new Image(pixels2.release(), width, height);
+	return new Image(pixels.release(), width, height);
 }
 
+Image* loadBMP(const char* filename) {
+	ifstream input;
+	input.open(filename, ifstream::binary);
+	if (input.fail()) {
+		return NULL; //Could not find file
+	}
+	
+	//Read the whole file in one go and decode it from memory
+	input.seekg(0, ios_base::end);
+	long long size = (long long)input.tellg();
+	if (size <= 0 || size > 0x7FFFFFFF) {
+		return NULL;
+	}
+	auto_array<char> bytes(new char[size]);
+	input.seekg(0, ios_base::beg);
+	input.read(bytes.get(), size);
+	if (input.fail()) {
+		return NULL;
+	}
+	input.close();
+	
+	return loadBMPFromMemory(bytes.get(), (int)size);
+}
 
+namespace {
+	//Writes the low four bytes of value in little-endian form
+	void writeInt(ostream &output, int value) {
+		char bytes[4] = {(char)value, (char)(value >> 8), (char)(value >> 16),
+						 (char)(value >> 24)};
+		output.write(bytes, 4);
+	}
+	
+	//Writes the low two bytes of value in little-endian form
+	void writeShort(ostream &output, int value) {
+		char bytes[2] = {(char)value, (char)(value >> 8)};
+		output.write(bytes, 2);
+	}
+}
 
-
-
-
-
-
-
+bool saveBMP(const char* filename, const Image* image) {
+	ofstream output;
+	output.open(filename, ofstream::binary);
+	if (output.fail()) {
+		return false;
+	}
+	
+	//Rows are padded to a multiple of four bytes
+	int rowSize = (image->width * 3 + 3) / 4 * 4;
+	int dataOffset = 14 + 40;
+	writeShort(output, 'B' | ('M' << 8));
+	writeInt(output, dataOffset + rowSize * image->height); //File size
+	writeInt(output, 0);                                    //Reserved
+	writeInt(output, dataOffset);
+	writeInt(output, 40);            //Windows V3 header size
+	writeInt(output, image->width);
+	writeInt(output, image->height); //Positive, so rows go bottom-up
+	writeShort(output, 1);           //Planes
+	writeShort(output, 24);          //Bits per pixel
+	writeInt(output, 0);             //No compression
+	writeInt(output, rowSize * image->height);
+	writeInt(output, 2835);          //72 DPI
+	writeInt(output, 2835);
+	writeInt(output, 0);             //Colours in the palette
+	writeInt(output, 0);             //Important colours
+	
+	//Both Image and the bitmap start at the bottom row, but a bitmap stores
+	//each pixel as BGR
+	auto_array<char> row(new char[rowSize]);
+	memset(row.get(), 0, rowSize);
+	for(int y = 0; y < image->height; y++) {
+		const char* src = image->pixels + 3 * image->width * y;
+		for(int x = 0; x < image->width; x++) {
+			row.get()[3 * x] = src[3 * x + 2];
+			row.get()[3 * x + 1] = src[3 * x + 1];
+			row.get()[3 * x + 2] = src[3 * x];
+		}
+		output.write(row.get(), rowSize);
+	}
+	return !output.fail();
+}
@@ -42,8 +42,19 @@ class Image {
 		int height;
 };
 
-//Reads a bitmap image from file.
+/* Reads a bitmap image from file.  Uncompressed 8-bit (paletted), 16-, 24- and
+ * 32-bit images are supported, as are bit field masks, top-down images and the
+ * OS/2 V1, Windows V3, V4 and V5 headers.  The result is always converted to
+ * the RGB form described above.  Returns NULL if there was an error loading
+ * it.
+ */
 Image* loadBMP(const char* filename);
+//Decodes a bitmap image that has already been read into memory.  Returns NULL
+//if the data is not a bitmap that loadBMP supports.
+Image* loadBMPFromMemory(const char* bytes, int size);
+//Writes the image to a file as an uncompressed 24-bit bitmap, which loadBMP
+//reads back exactly.  Returns false if the file couldn't be written.
+bool saveBMP(const char* filename, const Image* image);
 
 
 
@@ -0,0 +1,293 @@
+#include <arpa/inet.h>
+#include <chrono>
+#include <math.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "lockstep.h"
+
+using namespace std;
+
+namespace {
+	const int MAX_BATCH = 64; //The most inputs sent in one packet
+	const int HEADER_SIZE = 22;
+	const int MAX_PACKET = HEADER_SIZE + 3 * MAX_BATCH;
+	//How long to wait before sending inputs again, if nothing new has been
+	//sent, but the others may be missing something
+	const double RESEND_INTERVAL = 0.02;
+	
+	double now() {
+		return chrono::duration<double>(
+			chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	
+	void putInt(unsigned char* bytes, int value) {
+		for(int i = 0; i < 4; i++) {
+			bytes[i] = (unsigned char)(((unsigned int)value >> (8 * i)) & 0xFF);
+		}
+	}
+	
+	int getInt(const unsigned char* bytes) {
+		unsigned int value = 0;
+		for(int i = 0; i < 4; i++) {
+			value |= (unsigned int)bytes[i] << (8 * i);
+		}
+		return (int)value;
+	}
+	
+	signed char toNet(float value) {
+		value = value < -1 ? -1 : (value > 1 ? 1 : value);
+		return (signed char)lrintf(value * 127);
+	}
+	
+	float fromNet(signed char value) {
+		return value / 127.0f;
+	}
+}
+
+Lockstep::Lockstep(int numPlayers2, int localPlayer2, int inputDelay2) :
+	sock(-1),
+	numPlayers(numPlayers2),
+	localPlayer(localPlayer2),
+	inputDelay(inputDelay2),
+	currentTick(0),
+	unsent(false),
+	lastSend(0),
+	firstDesync(-1) {
+	if (inputDelay < 0) {
+		inputDelay = 0;
+	}
+	else if (inputDelay > WINDOW / 4) {
+		inputDelay = WINDOW / 4;
+	}
+	
+	sockaddr_in nowhere;
+	memset(&nowhere, 0, sizeof(nowhere));
+	addresses.assign(numPlayers, nowhere);
+	NetInput none = {0, 0, 0};
+	inputs.assign(WINDOW * numPlayers, none);
+	
+	//Every player starts with inputDelay ticks of doing nothing, which no one
+	//has to send
+	numReceived.assign(numPlayers, inputDelay);
+	numAcked.assign(numPlayers, inputDelay);
+	checksums.assign(WINDOW, 0);
+	checksumTicks.assign(WINDOW, -1);
+	remoteChecksums.assign(WINDOW * numPlayers, 0);
+	remoteChecksumTicks.assign(WINDOW * numPlayers, -1);
+}
+
+Lockstep::~Lockstep() {
+	if (sock >= 0) {
+		close(sock);
+	}
+}
+
+bool Lockstep::listen(unsigned short port2) {
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		return false;
+	}
+	
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port2);
+	if (bind(sock, (sockaddr*)&address, sizeof(address)) != 0) {
+		close(sock);
+		sock = -1;
+		return false;
+	}
+	return true;
+}
+
+unsigned short Lockstep::port() const {
+	sockaddr_in address;
+	socklen_t size = sizeof(address);
+	if (sock < 0 || getsockname(sock, (sockaddr*)&address, &size) != 0) {
+		return 0;
+	}
+	return ntohs(address.sin_port);
+}
+
+bool Lockstep::setPeer(int player, const char* host, unsigned short port2) {
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* result;
+	if (getaddrinfo(host, NULL, &hints, &result) != 0) {
+		return false;
+	}
+	
+	addresses[player] = *(sockaddr_in*)result->ai_addr;
+	addresses[player].sin_port = htons(port2);
+	freeaddrinfo(result);
+	return true;
+}
+
+bool Lockstep::needsInput() const {
+	return numReceived[localPlayer] <= currentTick + inputDelay;
+}
+
+void Lockstep::addLocalInput(const BikeInput &input) {
+	int tick2 = numReceived[localPlayer];
+	NetInput &slot = inputs[(tick2 % WINDOW) * numPlayers + localPlayer];
+	slot.throttle = toNet(input.throttle);
+	slot.steer = toNet(input.steer);
+	slot.lean = toNet(input.lean);
+	numReceived[localPlayer]++;
+	unsent = true;
+}
+
+bool Lockstep::ready() const {
+	for(int i = 0; i < numPlayers; i++) {
+		if (numReceived[i] <= currentTick) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void Lockstep::getInputs(BikeInput* out) const {
+	for(int i = 0; i < numPlayers; i++) {
+		const NetInput &input = inputs[(currentTick % WINDOW) * numPlayers + i];
+		out[i].throttle = fromNet(input.throttle);
+		out[i].steer = fromNet(input.steer);
+		out[i].lean = fromNet(input.lean);
+	}
+}
+
+void Lockstep::advance(unsigned int checksum) {
+	int slot = currentTick % WINDOW;
+	checksums[slot] = checksum;
+	checksumTicks[slot] = currentTick;
+	for(int i = 0; i < numPlayers; i++) {
+		if (remoteChecksumTicks[slot * numPlayers + i] == currentTick) {
+			compareChecksum(i, currentTick, remoteChecksums[slot * numPlayers + i]);
+		}
+	}
+	currentTick++;
+}
+
+void Lockstep::compareChecksum(int player, int tick2, unsigned int checksum) {
+	if (tick2 < 0 || tick2 <= currentTick - WINDOW) {
+		return;
+	}
+	
+	int slot = tick2 % WINDOW;
+	if (checksumTicks[slot] == tick2) {
+		if (checksums[slot] != checksum && firstDesync < 0) {
+			firstDesync = tick2;
+		}
+	}
+	else if (tick2 >= currentTick) {
+		//We haven't got there yet; compare once we have
+		remoteChecksums[slot * numPlayers + player] = checksum;
+		remoteChecksumTicks[slot * numPlayers + player] = tick2;
+	}
+}
+
+void Lockstep::receive(const unsigned char* packet, int size) {
+	if (size < HEADER_SIZE || memcmp(packet, "MXLS", 4) != 0) {
+		return;
+	}
+	int player = packet[4];
+	int count = packet[5];
+	if (player >= numPlayers || player == localPlayer ||
+		count > MAX_BATCH || size < HEADER_SIZE + 3 * count) {
+		return;
+	}
+	
+	int firstTick = getInt(packet + 6);
+	int ack = getInt(packet + 10);
+	if (ack > numAcked[player] && ack <= numReceived[localPlayer]) {
+		numAcked[player] = ack;
+	}
+	
+	//Take the inputs that follow on from the ones we have, leaving room in
+	//the window for the ticks still to be simulated
+	for(int i = 0; i < count; i++) {
+		int tick2 = firstTick + i;
+		if (tick2 != numReceived[player] || tick2 >= currentTick + WINDOW / 2) {
+			continue;
+		}
+		NetInput &slot = inputs[(tick2 % WINDOW) * numPlayers + player];
+		slot.throttle = (signed char)packet[HEADER_SIZE + 3 * i];
+		slot.steer = (signed char)packet[HEADER_SIZE + 3 * i + 1];
+		slot.lean = (signed char)packet[HEADER_SIZE + 3 * i + 2];
+		numReceived[player]++;
+	}
+	
+	compareChecksum(player,
+					getInt(packet + 14),
+					(unsigned int)getInt(packet + 18));
+}
+
+void Lockstep::send() {
+	unsigned char packet[MAX_PACKET];
+	memcpy(packet, "MXLS", 4);
+	packet[4] = (unsigned char)localPlayer;
+	int lastChecksum = currentTick - 1;
+	putInt(packet + 14, lastChecksum);
+	putInt(packet + 18,
+		   lastChecksum >= 0 ? (int)checksums[lastChecksum % WINDOW] : 0);
+	
+	for(int i = 0; i < numPlayers; i++) {
+		if (i == localPlayer) {
+			continue;
+		}
+		
+		int first = numAcked[i];
+		int count = numReceived[localPlayer] - first;
+		if (count > MAX_BATCH) {
+			count = MAX_BATCH;
+		}
+		packet[5] = (unsigned char)count;
+		putInt(packet + 6, first);
+		putInt(packet + 10, numReceived[i]);
+		for(int j = 0; j < count; j++) {
+			const NetInput &input =
+				inputs[((first + j) % WINDOW) * numPlayers + localPlayer];
+			packet[HEADER_SIZE + 3 * j] = (unsigned char)input.throttle;
+			packet[HEADER_SIZE + 3 * j + 1] = (unsigned char)input.steer;
+			packet[HEADER_SIZE + 3 * j + 2] = (unsigned char)input.lean;
+		}
+		sendto(sock,
+			   packet,
+			   HEADER_SIZE + 3 * count,
+			   0,
+			   (sockaddr*)&addresses[i],
+			   sizeof(addresses[i]));
+	}
+	unsent = false;
+	lastSend = now();
+}
+
+void Lockstep::poll() {
+	if (sock < 0) {
+		return;
+	}
+	
+	unsigned char packet[MAX_PACKET];
+	while (true) {
+		ssize_t size = recv(sock, packet, sizeof(packet), MSG_DONTWAIT);
+		if (size < 0) {
+			break;
+		}
+		receive(packet, (int)size);
+	}
+	
+	bool waiting = !ready();
+	for(int i = 0; i < numPlayers; i++) {
+		if (numAcked[i] < numReceived[localPlayer]) {
+			waiting = true; //Someone may have missed our inputs
+		}
+	}
+	if (unsent || (waiting && now() - lastSend > RESEND_INTERVAL)) {
+		send();
+	}
+}
@@ -0,0 +1,104 @@
+#ifndef LOCKSTEP_H_INCLUDED
+#define LOCKSTEP_H_INCLUDED
+
+#include <netinet/in.h>
+#include <vector>
+
+#include "physics.h"
+
+/* Keeps the Sims of several players in step by exchanging their inputs over
+ * UDP.  Every player runs the same Sim, and a tick is only simulated once the
+ * inputs of every player for that tick have arrived.
+ *
+ * Local input is scheduled inputDelay ticks ahead, which gives it that long
+ * to reach the other players before they need it.  Each packet carries every
+ * input the receiver hasn't acknowledged yet, so inputs from several ticks
+ * travel together and a lost packet is covered by the next one.  Packets also
+ * carry a checksum of the sender's latest tick, so that a desync is noticed
+ * within a few ticks of happening.
+ *
+ * Inputs are rounded to 8 bits per control, and the rounded values are what
+ * every player simulates, including the one who made them.
+ */
+class Lockstep {
+	private:
+		//How many ticks of inputs and checksums are remembered
+		static const int WINDOW = 256;
+		
+		//An input as sent over the network
+		struct NetInput {
+			signed char throttle;
+			signed char steer;
+			signed char lean;
+		};
+		
+		int sock;
+		int numPlayers;
+		int localPlayer;
+		int inputDelay;
+		std::vector<sockaddr_in> addresses; //Where each player is
+		std::vector<NetInput> inputs;       //[tick % WINDOW][player]
+		std::vector<int> numReceived;       //Consecutive ticks of input
+		                                    //we have from each player
+		std::vector<int> numAcked;          //Consecutive ticks of our input
+		                                    //each player has
+		std::vector<unsigned int> checksums; //[tick % WINDOW], ours
+		std::vector<int> checksumTicks;
+		std::vector<unsigned int> remoteChecksums; //[tick % WINDOW][player]
+		std::vector<int> remoteChecksumTicks;
+		int currentTick;
+		bool unsent;       //Whether there's local input not sent yet
+		double lastSend;   //When we last sent, in seconds
+		int firstDesync;  //The first tick found to differ, or -1
+		
+		void receive(const unsigned char* packet, int size);
+		void compareChecksum(int player, int tick, unsigned int checksum);
+		void send();
+	public:
+		Lockstep(int numPlayers, int localPlayer, int inputDelay);
+		~Lockstep();
+		Lockstep(const Lockstep &other) = delete;
+		Lockstep &operator=(const Lockstep &other) = delete;
+		
+		//Opens a UDP socket on the given port, or any free port if it's 0.
+		//Returns false if the socket can't be opened.
+		bool listen(unsigned short port);
+		//Returns the port the socket is bound to
+		unsigned short port() const;
+		//Sets the address of another player.  Returns false if the host
+		//can't be resolved.
+		bool setPeer(int player, const char* host, unsigned short port);
+		
+		int tick() const {
+			return currentTick;
+		}
+		
+		//Returns whether it's time to give the next local input
+		bool needsInput() const;
+		//Gives the local input for the next tick that needs one
+		void addLocalInput(const BikeInput &input);
+		//Receives whatever packets have arrived, and sends our inputs if
+		//there are new ones or the others seem to be waiting on us
+		void poll();
+		
+		//Returns whether the inputs of every player for the current tick have
+		//arrived
+		bool ready() const;
+		//Sets out[i] to player i's input for the current tick
+		void getInputs(BikeInput* out) const;
+		//Moves on to the next tick, after the current one has been simulated
+		//and left the Sim with the given checksum
+		void advance(unsigned int checksum);
+		
+		//Returns whether another player's Sim has been found to differ from
+		//ours
+		bool desynced() const {
+			return firstDesync >= 0;
+		}
+		
+		int desyncTick() const {
+			return firstDesync;
+		}
+};
+
+#endif
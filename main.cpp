@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <stdio.h>
 #include <cstdlib>
 #include <ctime>
@@ -6,6 +7,7 @@
 #include <set>
 #include <sstream>
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 #include <cmath>
 
@@ -16,36 +18,60 @@
 #include <GL/glut.h>
 #endif
 
+#include "assetloader.h"
+#include "bikemesh.h"
+#include "camera.h"
+#include "glstate.h"
+#include "hud.h"
 #include "imageloader.h"
+#include "lockstep.h"
 #include "md2model.h"
+#include "offscreen.h"
+#include "particles.h"
+#include "physics.h"
+#include "raycast.h"
+#include "renderqueue.h"
+#include "riders.h"
+#include "scenegraph.h"
+#include "sim.h"
+#include "simthread.h"
+#include "terrain.h"
+#include "terrainlight.h"
+#include "terrainmesh.h"
 #include "text3d.h"
+#include "texture.h"
+#include "threadpool.h"
+#include "water.h"
 
 using namespace std;
 
 //Global Variables.
 
 //Bike.
-float bike_x = 50.0f, bike_y, bike_z = 50.0f;
-float bike_deltaAngle = 0.0f;
-float bike_deltaMove = 0.0f;
-float bike_angle = 0.0;
-float bike_rot = 0.0;
-float bike_lx = 0.0, bike_lz = 0.0;
-float bike_pitch = 0.0;
-float bike_roll_fl = 0.0;
-float bike_roll = 0.0;
-
-int game_score = 0;
-int game_time = 20;
-char str[100];
-int light = 0;
-//Camera.
-float cam_fl = 1.0;
-float cam_pitch =0.0;
+BikeState bike;             //The player's bike in the snapshot being drawn
+float bike_deltaMove = 0.0f; //Throttle from the keyboard
+float bike_rot = 0.0;        //Steering from the keyboard
+float bike_roll_fl = 0.0;    //Lean from the keyboard
 
+int light = 1; //Whether the headlight is on
 const float PI = 3.1415926535f;
 //The width of the terrain in units, after scaling
 const float TERRAIN_WIDTH = 100.0f;
+//Towards the sun, which doesn't move, so the terrain's shadows are baked
+const Vec3f SUN_DIRECTION(-0.2f, 0.3f, -1.0f);
+//The height of the water's surface, and the fewest vertices under it that
+//make a pond rather than a puddle
+const float WATER_LEVEL = -14.0f;
+const int MIN_WATER_VERTICES = 50;
+//How many particles there can be at once, and how big they're drawn
+const int MAX_PARTICLES = 8192;
+const float PARTICLE_SIZE = 0.25f;
+//The particles a back wheel throws up for each unit the bike moves, on dry
+//ground and in water
+const float DUST_PER_UNIT = 6.0f;
+const float SPRAY_PER_UNIT = 12.0f;
+//The particles thrown out when a collectible is picked up
+const int PICKUP_PARTICLES = 48;
 
 //Returns a random float from 0 to < 1
 float randomFloat() {
@@ -53,309 +79,96 @@ float randomFloat() {
 }
 
 //Collectible objects
-typedef struct c {
-	float pos[3];
-	int state;
-}collect;
-
-collect col_obj[100];
 float col_obj_size = 0.5f;
 
-//Represents a terrain, by storing a set of heights and normals at 2D locations
-class Terrain {
-	private:
-		int w; //Width
-		int l; //Length
-		float** hs; //Heights
-		Vec3f** normals;
-		bool computedNormals; //Whether normals is up-to-date
-	public:
-		Terrain(int w2, int l2) {
-			w = w2;
-			l = l2;
-			
-			hs = new float*[l];
-			for(int i = 0; i < l; i++) {
-				hs[i] = new float[w];
-			}
-			
-			normals = new Vec3f*[l];
-			for(int i = 0; i < l; i++) {
-				normals[i] = new Vec3f[w];
-			}
-			
-			computedNormals = false;
-		}
-		
-		~Terrain() {
-			for(int i = 0; i < l; i++) {
-				delete[] hs[i];
-			}
-			delete[] hs;
-			
-			for(int i = 0; i < l; i++) {
-				delete[] normals[i];
-			}
-			delete[] normals;
-		}
-		
-		int width() {
-			return w;
-		}
-		
-		int length() {
-			return l;
-		}
-		
-		//Sets the height at (x, z) to y
-		void setHeight(int x, int z, float y) {
-			hs[z][x] = y;
-			computedNormals = false;
-		}
-		
-		//Returns the height at (x, z)
-		float getHeight(int x, int z) {
-			return hs[z][x];
-		}
-		
-		//Computes the normals, if they haven't been computed yet
-		void computeNormals() {
-			if (computedNormals) {
-				return;
-			}
-			
-			//Compute the rough version of the normals
-			Vec3f** normals2 = new Vec3f*[l];
-			for(int i = 0; i < l; i++) {
-				normals2[i] = new Vec3f[w];
-			}
-			
-			for(int z = 0; z < l; z++) {
-				for(int x = 0; x < w; x++) {
-					Vec3f sum(0.0f, 0.0f, 0.0f);
-					
-					Vec3f out;
-					if (z > 0) {
-						out = Vec3f(0.0f, hs[z - 1][x] - hs[z][x], -1.0f);
-					}
-					Vec3f in;
-					if (z < l - 1) {
-						in = Vec3f(0.0f, hs[z + 1][x] - hs[z][x], 1.0f);
-					}
-					Vec3f left;
-					if (x > 0) {
-						left = Vec3f(-1.0f, hs[z][x - 1] - hs[z][x], 0.0f);
-					}
-					Vec3f right;
-					if (x < w - 1) {
-						right = Vec3f(1.0f, hs[z][x + 1] - hs[z][x], 0.0f);
-					}
-					
-					if (x > 0 && z > 0) {
-						sum += out.cross(left).normalize();
-					}
-					if (x > 0 && z < l - 1) {
-						sum += left.cross(in).normalize();
-					}
-					if (x < w - 1 && z < l - 1) {
-						sum += in.cross(right).normalize();
-					}
-					if (x < w - 1 && z > 0) {
-						sum += right.cross(out).normalize();
-					}
-					
-					normals2[z][x] = sum;
-				}
-			}
-			
-			//Smooth out the normals
-			const float FALLOUT_RATIO = 0.5f;
-			for(int z = 0; z < l; z++) {
-				for(int x = 0; x < w; x++) {
-					Vec3f sum = normals2[z][x];
-					
-					if (x > 0) {
-						sum += normals2[z][x - 1] * FALLOUT_RATIO;
-					}
-					if (x < w - 1) {
-						sum += normals2[z][x + 1] * FALLOUT_RATIO;
-					}
-					if (z > 0) {
-						sum += normals2[z - 1][x] * FALLOUT_RATIO;
-					}
-					if (z < l - 1) {
-						sum += normals2[z + 1][x] * FALLOUT_RATIO;
-					}
-					
-					if (sum.magnitude() == 0) {
-						sum = Vec3f(0.0f, 1.0f, 0.0f);
-					}
-					normals[z][x] = sum;
-				}
-			}
-			
-			for(int i = 0; i < l; i++) {
-				delete[] normals2[i];
-			}
-			delete[] normals2;
-			
-			computedNormals = true;
-		}
-		
-		//Returns the normal at (x, z)
-		Vec3f getNormal(int x, int z) {
-			if (!computedNormals) {
-				computeNormals();
-			}
-			return normals[z][x];
-		}
-};
-
-//Loads a terrain from a heightmap.  The heights of the terrain range from
-//-height / 2 to height / 2.
-Terrain* loadTerrain(const char* filename, float height) {
-	Image* image = loadBMP(filename);
-	Terrain* t = new Terrain(image->width, image->height);
-	for(int y = 0; y < image->height; y++) {
-		for(int x = 0; x < image->width; x++) {
-			unsigned char color =
-				(unsigned char)image->pixels[3 * (y * image->width + x)];
-			float h = height * ((color / 255.0f) - 0.5f);
-			t->setHeight(x, y, h);
-		}
-	}
-	
-	delete image;
-	t->computeNormals();
-	return t;
-}
-
-//Returns the approximate height of the terrain at the specified (x, z) position
-float heightAt(Terrain* terrain, float x, float z) {
-	//Make (x, z) lie within the bounds of the terrain
-	if (x < 0) {
-		x = 0;
-	}
-	else if (x > terrain->width() - 1) {
-		x = terrain->width() - 1;
-	}
-	if (z < 0) {
-		z = 0;
-	}
-	else if (z > terrain->length() - 1) {
-		z = terrain->length() - 1;
-	}
-	
-	//Compute the grid cell in which (x, z) lies and how close we are to the
-	//left and outward edges
-	int leftX = (int)x;
-	if (leftX == terrain->width() - 1) {
-		leftX--;
-	}
-	float fracX = x - leftX;
-	
-	int outZ = (int)z;
-	if (outZ == terrain->width() - 1) {
-		outZ--;
-	}
-	float fracZ = z - outZ;
-	
-	//Compute the four heights for the grid cell
-	float h11 = terrain->getHeight(leftX, outZ);
-	float h12 = terrain->getHeight(leftX, outZ + 1);
-	float h21 = terrain->getHeight(leftX + 1, outZ);
-	float h22 = terrain->getHeight(leftX + 1, outZ + 1);
-	
-	//Take a weighted average of the four heights
-	return (1 - fracX) * ((1 - fracZ) * h11 + fracZ * h12) +
-		fracX * ((1 - fracZ) * h21 + fracZ * h22);
-}
-
-
-//Draws the terrain
-void drawTerrain(Terrain* terrain) {
-	glDisable(GL_TEXTURE_2D);
-	glColor3f(0.3f, 0.9f, 0.0f);
-	for(int z = 0; z < terrain->length() - 1; z++) {
-		glBegin(GL_TRIANGLE_STRIP);
-		for(int x = 0; x < terrain->width(); x++) {
-			if (x>20 && x <40)
-			{
-				glColor3f(0.0f, 0.0f, 0.8f);
-			}
-			else
-			{
-				glColor3f(0.59f, 0.27f,0.08f);
-			}
-			Vec3f normal = terrain->getNormal(x, z);
-			glNormal3f(normal[0], normal[1], normal[2]);
-			glVertex3f(x, terrain->getHeight(x, z), z);
-			normal = terrain->getNormal(x, z + 1);
-			glNormal3f(normal[0], normal[1], normal[2]);
-			glVertex3f(x, terrain->getHeight(x, z + 1), z + 1);
-		}
-		glEnd();
-	}
-}
-
-void drawCollect(float rad)
-{
-	glPushMatrix();
-	glutSolidSphere(rad, 10, 10);
-	glPopMatrix();
-}
-
-void drawBike() {
-
-	glPushMatrix();
-	glColor3f(0.1f, 0.1f, 0.1f);
-	glTranslatef(1.0, 0.0, 0.0);
-	glutSolidSphere(0.25, 5, 5);
-	GLfloat light1_position[] = { -0.2, 0.0, 0.0, 1.0 };
-	GLfloat light1_ambient[] = { 1, 1, 1, 1 };
-	GLfloat light1_position[] = { -0.2, 0.0, 0.0, 1.0 };
-	
-	GLfloat spot_direction[] = { 0.0, 0.0, 0.0, 1.0 };
-	glLightfv(GL_LIGHT1, GL_POSITION, light1_position);
-	if (light == 1)
-	{
-		printf("\n\n\n\n");
-		glEnable(GL_LIGHT1);
-	}
-	else 
-	{
-		glEnable(GL_LIGHT1);
-	}
-	glPopMatrix();
-	glPushMatrix();
-	glColor3f(0.1f, 0.1f, 0.1f);
-	glTranslatef(-1.0, 0.0, 0.0);
-	glutSolidSphere(0.25, 5, 5); 
-	glPopMatrix();
-	glPushMatrix();
-	glColor3f(0.8f, 0.0f, 0.0f);
-	glTranslatef(0.0, 0.0, 0.0);
-	glutSolidCube(0.4);
-	glPopMatrix();
-	glPushMatrix();
-	glColor3f(0.2f, 0.2f, 0.2f);
-	glTranslatef(0.4, 0.0, 0.0);
-	glutSolidCube(0.5);
-	glPopMatrix();
-	glPushMatrix();
-	glColor3f(0.8f, 0.0f, 0.0f);
-	glTranslatef(-0.5, 0.0, 0.0);
-	glutSolidCube(0.5);
-	glPopMatrix();
+//Adds a bike's node to the scene, followed by a node for its rider, and
+//returns the bike's node
+int addBikeNodes(SceneGraph &scene) {
+	int bikeNode = scene.add();
+	//The model is 14.5 units tall and lies along its -x axis
+	scene.add(bikeNode,
+			  Mat4f::translation(Vec3f(0.0f, 0.75f, 0.0f)) *
+			  Mat4f::rotation(-90.0f, Vec3f(0.0f, 0.0f, 1.0f)) *
+			  Mat4f::scaling(Vec3f(0.1f, 0.1f, 0.1f)));
+	return bikeNode;
 }
 
 
 MD2Model* _model;
+BikeMesh* _bikeMesh;
+vector<float> _collectibleVerts; //A sphere, as positions and normals
 Terrain* _terrain;
+TerrainMesh* _terrainMesh;
+WaterMap* _water;
+TerrainRaycaster* _raycaster; //Keeps the camera from going behind hills
+Sim* _sim;
+Lockstep* _net;       //Keeps the Sim in step with the other players, if any
+int _player = 0;      //The rider we control
+int _numPlayers = 1;
+SimThread* _simThread; //Runs _sim while the GL thread draws
+int _shownInputSeq = 0; //The last input whose effect has been drawn
+vector<float> _inputLatencies; //From inputs to the swaps that showed them, in ms
+const int NUM_AI_RIDERS = 3;
+const int INPUT_DELAY = 6; //Ticks between an input and when it takes effect
 float _angle = 0;
 
+Hud _hud;
+Camera _camera;
+SceneGraph _scene;              //Where the riders and collectibles are drawn
+vector<int> _bikeNodes;         //Each rider's node in _scene
+int _collectibleNodes[NUM_COLLECTIBLES];
+const float VIEW_DISTANCE = 200.0f; //The far plane
+const int WINDOW_WIDTH = 800;
+const int WINDOW_HEIGHT = 600;
+
+//The frame's draws, sorted to keep state changes down
+RenderQueue _queue;
+CommandList* _terrainCommands;
+CommandList* _riderCommands;
+CommandList* _collectibleCommands;
+CommandList* _waterCommands;
+CommandList* _effectCommands;
+int _terrainMeshId, _bikeMeshId, _riderMesh, _collectibleMesh;
+int _terrainMaterial, _bikeMaterial, _riderMaterial, _collectibleMaterial;
+vector<int> _waterMeshes;    //Each water region's mesh
+vector<int> _waterMaterials; //And its material, coloured each frame
+int _particleMesh, _particleMaterial;
+float _riderTime = 0; //Where the riders are in their animation
+int _lastFrameTime = 0; //Milliseconds from startup to the last frame drawn
+AssetLoader* _loader;
+int _firstFrameTime = -1; //Milliseconds from startup to the first frame drawn
+
+//Dust, spray and sparks
+ParticleSystem _particles(MAX_PARTICLES);
+SimRandom _effectRandom(1);
+vector<float> _dustDue; //Particles owed to each rider's wheel, in part
+int _collectibleStates[NUM_COLLECTIBLES]; //As of the last frame
+
+//Prints the median and worst time from an input to the swap that first
+//showed its effect
+void printInputLatency() {
+	if (_inputLatencies.empty()) {
+		return;
+	}
+	sort(_inputLatencies.begin(), _inputLatencies.end());
+	printf("Input to swap: %.1f ms median, %.1f ms p99 over %d inputs\n",
+		   _inputLatencies[_inputLatencies.size() / 2],
+		   _inputLatencies[_inputLatencies.size() * 99 / 100],
+		   (int)_inputLatencies.size());
+}
+
 void cleanup() {
+	delete _loader; //Waits for any assets that are still loading
+	delete _simThread; //Stops the Sim before it's deleted
+	printInputLatency();
+	delete _sim;
+	delete _net;
+	delete _raycaster;
+	delete _terrainMesh;
+	delete _water;
 	delete _model;
+	delete _bikeMesh;
+	textureManager().clear();
 
 	t3dCleanup();
 }
@@ -367,26 +180,33 @@ void handleKeypress(unsigned char key, int x, int y) {
 			exit(0);
 			break;
 		case 49: // '1'
-			cam_fl = 1.0;
+			_camera.setMode(CAMERA_CHASE);
 			break;
 		case 50: // '2'
-			cam_fl = 2.0;
+			_camera.setMode(CAMERA_SIDE);
 			break;
 		case 51: // '3'
-			cam_fl = 3.0;
+			_camera.setMode(CAMERA_OVERHEAD);
 			break;
 		case 'l':
-			printf("here\n"); 
-			printf("\n");
 			if (light == 0)
 				light = 1;
 			else
 				light = 0;
+			glsSetEnabled(GL_LIGHT1, light == 1);
 			break;
 	}
 }
 
 
+//Passes the keyboard's input on to the Sim
+void inputChanged() {
+	if (_simThread != NULL) {
+		BikeInput input = {bike_deltaMove, bike_rot, bike_roll_fl};
+		_simThread->setInput(input);
+	}
+}
+
 void pressSpecialKey(int key, int xx, int yy) 
 {
 	switch (key) {
@@ -397,6 +217,7 @@ void pressSpecialKey(int key, int xx, int yy)
 		case GLUT_KEY_F1 : bike_roll_fl = -1.0; break;
 		case GLUT_KEY_F2 : bike_roll_fl = 1.0; break;
 	}   
+	inputChanged();
 } 
 
 void releaseSpecialKey(int key, int x, int y)  
@@ -404,224 +225,629 @@ void releaseSpecialKey(int key, int x, int y)
 	switch (key) {
 		case GLUT_KEY_UP : bike_deltaMove = 0.0; break;
 		case GLUT_KEY_DOWN : bike_deltaMove = 0.0; break;
-		case GLUT_KEY_LEFT : bike_rot = 0.0; bike_angle += bike_deltaAngle; bike_deltaAngle = 0.0; break;
-		case GLUT_KEY_RIGHT : bike_rot = 0.0; bike_angle += bike_deltaAngle; bike_deltaAngle = 0.0; break;
+		case GLUT_KEY_LEFT : bike_rot = 0.0; break;
+		case GLUT_KEY_RIGHT : bike_rot = 0.0; break;
 		case GLUT_KEY_F1 : bike_roll_fl = 0.0; break;
 		case GLUT_KEY_F2 : bike_roll_fl = 0.0; break;
 	}   
+	inputChanged();
 } 
 
-//Makes the image into a texture, and returns the id of the texture
-GLuint loadTexture(Image *image) {
-	GLuint textureId;
-	glGenTextures(1, &textureId);
-	glBindTexture(GL_TEXTURE_2D, textureId);
-	glTexImage2D(GL_TEXTURE_2D,
-			0,
-			GL_RGB,
-			image->width, image->height,
-			0,
-			GL_RGB,
-			GL_UNSIGNED_BYTE,
-			image->pixels);
-	return textureId;
-}
-
 void initRendering() {
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_LIGHTING);
-	glEnable(GL_LIGHT0);
-	glEnable(GL_NORMALIZE);
-	glEnable(GL_COLOR_MATERIAL);
-	glShadeModel(GL_SMOOTH);
+	glsEnable(GL_DEPTH_TEST);
+	glsEnable(GL_LIGHTING);
+	glsEnable(GL_LIGHT0);
+	glsSetEnabled(GL_LIGHT1, light == 1);
+	glsEnable(GL_NORMALIZE);
+	glsEnable(GL_COLOR_MATERIAL);
+	glsShadeModel(GL_SMOOTH);
 
 	t3dInit(); //Initialize text drawing functionality
+	_bikeMesh = new BikeMesh();
+	_collectibleVerts = sphereVertices(col_obj_size, 10, 10);
+}
+
+//The load functions run on the loader's worker threads; the upload functions
+//run on the GLUT thread once the matching load function has finished
+void loadTerrainAsset() {
+	_terrain = loadTerrain("heightmap.bmp", 30.0f); //Load the terrain
+	if (_terrain != NULL) {
+		_raycaster = new TerrainRaycaster(_terrain);
+		//Without a splat map, the terrain is painted by the rules alone
+		Image* splatMap = loadBMP("splatmap.bmp");
+		ThreadPool pool;
+		TerrainLightmap* lightmap =
+			TerrainLightmap::loadOrBake(_terrain, "heightmap.bmp", 30.0f,
+										SUN_DIRECTION, &pool);
+		_terrainMesh = new TerrainMesh(_terrain, splatMap,
+									   defaultTerrainPalette(), lightmap,
+									   &pool);
+		delete lightmap;
+		delete splatMap;
+		_water = new WaterMap(_terrain, WATER_LEVEL, MIN_WATER_VERTICES);
+	}
+}
+
+void uploadTerrainAsset() {
+	if (_terrain == NULL) {
+		printf("Could not load heightmap.bmp\n");
+		cleanup();
+		exit(1);
+	}
+	_camera.setRaycaster(_raycaster);
+}
+
+void loadModelAsset() {
+	_model = MD2Model::loadData("blockybalboa.md2");
+}
 
-	//Load the model
-	_model = MD2Model::load("blockybalboa.md2");
+void uploadModelAsset() {
 	if (_model != NULL) {
+		_model->uploadTexture();
 		_model->setAnimation("run");
 	}
 }
 
-void handleResize(int w, int h) {
-	glViewport(0, 0, w, h);
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(45.0, (float)w / (float)h, 1.0, 200.0);
+void assetLoaded(const char* name, int numDone, int total) {
+	printf("Loaded %s (%d/%d) after %d ms\n",
+		   name, numDone, total, glutGet(GLUT_ELAPSED_TIME));
 }
 
-void drawScene() {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+void startLoading() {
+	_loader = new AssetLoader();
+	_loader->setProgressFunc(assetLoaded);
+	_loader->add("heightmap.bmp", loadTerrainAsset, uploadTerrainAsset);
+	_loader->add("blockybalboa.md2", loadModelAsset, uploadModelAsset);
+}
 
+//Draws a progress bar over a blank screen while the assets load
+void drawLoadingScreen() {
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	gluOrtho2D(0.0, 1.0, 0.0, 1.0);
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
+	glsDisable(GL_LIGHTING);
+	glsDisable(GL_DEPTH_TEST);
+
+	float right = 0.2f + 0.6f * _loader->progress();
+	glBegin(GL_QUADS);
+	glColor3f(0.3f, 0.3f, 0.3f);
+	glVertex2f(0.2f, 0.47f);
+	glVertex2f(0.8f, 0.47f);
+	glVertex2f(0.8f, 0.53f);
+	glVertex2f(0.2f, 0.53f);
+	glColor3f(0.59f, 0.27f, 0.08f);
+	glVertex2f(0.2f, 0.47f);
+	glVertex2f(right, 0.47f);
+	glVertex2f(right, 0.53f);
+	glVertex2f(0.2f, 0.53f);
+	glEnd();
+
+	glsEnable(GL_DEPTH_TEST);
+	glsEnable(GL_LIGHTING);
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+}
 
+void handleResize(int w, int h) {
+	glViewport(0, 0, w, h);
+	_hud.resize(w, h);
+	_camera.setPerspective(45.0f, (float)w / (float)h, 1.0f, VIEW_DISTANCE);
+}
 
-	//The scaling factor for the terrain
-//	float scale = TERRAIN_WIDTH / (_terrain->width() - 1);
-
-//	glTranslatef(0, 0, -1.0f * scale * (_terrain->length() - 1));
-	//glRotatef(30, 1, 0, 0);
-	//glRotatef(_angle, 0, 1, 0);
-//	glTranslatef(-TERRAIN_WIDTH / 2, 0, -scale * (_terrain->length() - 1) / 2);
-	
-//	glScalef(scale, scale, scale);
+void startGame();
+void drawWorld(const FrameSnapshot &frame, float dt, float time);
+void drawHud(const FrameSnapshot &frame);
 
+void drawTerrainMesh(void* mesh, const RenderBackend* backend) {
+	((TerrainMesh*)mesh)->draw(backend);
+}
 
-	if (cam_fl == 1.0) 
-	{
-		glRotatef(cam_pitch*180/PI, 1.0, 0.0, 0.0);							//pitch of the bike.
-		gluLookAt (
-				bike_x - 3*(bike_lx), bike_y + 2.0, bike_z - 3*(bike_lz),
-				bike_x + 3*bike_lx, bike_y + 2.0, bike_z + 3*bike_lz,
-				0.0, 1.0, 0.0);
-	}
-	else if (cam_fl == 2.0)
-	{
-		gluLookAt (
-				bike_x-5.0, bike_y + 5.0, bike_z,
-				bike_x-5.0 + bike_lx, bike_y + 5.0, bike_z + bike_lz,
-				0.0, 1.0, 0.0);
-	}
-	else if (cam_fl == 3.0)
-	{
-		gluLookAt (
-				bike_x - (10.0*bike_lx), bike_y + 50.0, bike_z - (10.0*bike_lz),
-				bike_x + (10.0*bike_lx), bike_y, bike_z + (10.0*bike_lz),
-				0.0, 1.0, 0.0);
-	}	
+void drawWaterRegion(void* region, const RenderBackend* backend) {
+	((const WaterRegion*)region)->draw(backend);
+}
 
-	GLfloat ambientLight[] = {0.5f, 0.5f, 0.5f, 1.0f};
-	glLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambientLight);
+void drawParticles(void* particles, const RenderBackend* backend) {
+	((ParticleSystem*)particles)->draw(backend);
+}
 
-	GLfloat lightColor[] = {0.5f, 0.5f, 0.5f, 1.0f};
-	GLfloat lightPos[] = {-0.2f, 0.3f, -1, 0.0f};
-	glLightfv(GL_LIGHT0, GL_DIFFUSE, lightColor);
-	glLightfv(GL_LIGHT0, GL_POSITION, lightPos);
+void drawBikeMesh(void* mesh, const RenderBackend* backend) {
+	((BikeMesh*)mesh)->draw(backend);
+}
 
+void drawRiderMesh(void* model, const RenderBackend* backend) {
+	((MD2Model*)model)->draw(_riderTime, backend);
+}
 
-	//Draw the terrain
-	drawTerrain(_terrain);
+void drawCollectibleMesh(void*, const RenderBackend* backend) {
+	TriangleBatch batch = {&_collectibleVerts[0],
+						   (int)_collectibleVerts.size() / 6, 6, 3, -1, -1,
+						   NULL, 0};
+	backend->drawTriangles(batch);
+}
 
-	glPushMatrix();
-	glColor3f(0.0, 0.0, 1.0);
-	glTranslatef(bike_x, bike_y, bike_z);
-	glRotatef(bike_angle*180/PI, 0.0, 1000.0, 0.0);							//yaw of the bike.
-	glRotatef(bike_pitch*180/PI, 0.0, 0.0, 10.0);							//pitch of the bike.
-	glRotatef(bike_roll*180/PI, 10.0, 0.0, 0.0);							//roll of the bike.
-	drawBike();
-	glPopMatrix();
+//Returns how far in front of the camera a world matrix puts its origin, as a
+//fraction of the view distance
+float drawDepth(const Mat4f &view, const Mat4f &world) {
+	Vec3f origin = view.transformPoint(Vec3f(world[12], world[13], world[14]));
+	return -origin[2] / VIEW_DISTANCE;
+}
 
-	for (int i=0; i<10; i++)
+//Registers what the game draws with the render queue
+void setUpRenderQueue() {
+	_terrainCommands = _queue.addList();
+	_riderCommands = _queue.addList();
+	_collectibleCommands = _queue.addList();
+	_waterCommands = _queue.addList();
+	_effectCommands = _queue.addList();
+
+	_terrainMeshId = _queue.addMesh(drawTerrainMesh, _terrainMesh);
+	_bikeMeshId = _queue.addMesh(drawBikeMesh, _bikeMesh);
+	_riderMesh = _queue.addMesh(drawRiderMesh, _model);
+	_collectibleMesh = _queue.addMesh(drawCollectibleMesh);
+	_particleMesh = _queue.addMesh(drawParticles, &_particles);
+
+	//The terrain and bikes colour their own vertices
+	Material terrainMaterial = {0, true, {1.0f, 1.0f, 1.0f}};
+	_terrainMaterial = _queue.addMaterial(terrainMaterial);
+	_bikeMaterial = _queue.addMaterial(terrainMaterial);
+	Material riderMaterial = {_model != NULL ? _model->getTextureId() : 0, true,
+							  {1.0f, 1.0f, 1.0f}};
+	_riderMaterial = _queue.addMaterial(riderMaterial);
+	Material collectibleMaterial = {0, true, {1.0f, 0.0f, 0.0f}};
+	_collectibleMaterial = _queue.addMaterial(collectibleMaterial);
+	//The particles colour their own vertices, and aren't lit
+	Material particleMaterial = {0, false, {1.0f, 1.0f, 1.0f}};
+	_particleMaterial = _queue.addMaterial(particleMaterial);
+
+	//Each body of water is coloured by what it reflects from where it's seen
+	for (int i=0; i<_water->numRegions(); i++)
 	{
-		if (col_obj[i].state == 1)
-		{
-			glPushMatrix();
-			glTranslatef(col_obj[i].pos[0], col_obj[i].pos[1], col_obj[i].pos[2]);
-			glColor3f(1.0f, 0.0f, 0.0f);
-			drawCollect(col_obj_size);
-			glPopMatrix();
+		_waterMeshes.push_back(_queue.addMesh(drawWaterRegion,
+											  (void*)&_water->region(i)));
+		Material waterMaterial = {0, false, {0.0f, 0.0f, 0.0f}};
+		_waterMaterials.push_back(_queue.addMaterial(waterMaterial));
+	}
+}
+
+void drawScene() {
+	if (_firstFrameTime < 0) {
+		_firstFrameTime = glutGet(GLUT_ELAPSED_TIME);
+	}
+	if (!_loader->done()) {
+		_loader->poll();
+		if (_loader->done()) {
+			startGame();
 		}
 	}
 
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	if (!_loader->done()) {
+		drawLoadingScreen();
+		glutSwapBuffers();
+		glutPostRedisplay(); //Keep polling until everything is loaded
+		return;
+	}
+
+	//Draw the latest state the sim thread has finished
+	_simThread->update();
+	const FrameSnapshot &frame = _simThread->snapshot();
+	int now = glutGet(GLUT_ELAPSED_TIME);
+	drawWorld(frame, (now - _lastFrameTime) / 1000.0f, now / 1000.0f);
+	_lastFrameTime = now;
+	drawHud(frame);
+
 	glutSwapBuffers();
+	_hud.frameDone();
+	if (frame.inputSeq != _shownInputSeq) {
+		_shownInputSeq = frame.inputSeq;
+		double latency = SimThread::now() - frame.inputTime;
+		_inputLatencies.push_back((float)(latency * 1000));
+	}
 }
 
-void update(int value) {
-
+//Returns a random float from low to high, for effects that don't change the
+//game, so that they don't use up the Sim's random numbers
+float effectRandom(float low, float high) {
+	return low + (high - low) * _effectRandom.nextFloat();
+}
 
-	if (game_time <= 0)
+/* Throws up dust, or spray in water, behind the back wheel of each rider on
+ * the ground, and a burst of sparks from each collectible that was picked up
+ * since the last frame, then moves the particles on by dt seconds.
+ */
+void updateEffects(const FrameSnapshot &frame, float dt) {
+	const float HALF_BASE = defaultBikeParams().wheelBase / 2;
+	int numRiders = (int)frame.riders.size();
+	_dustDue.resize(numRiders, 0.0f);
+	for (int i=0; i<numRiders; i++)
 	{
-		exit(0);
-	}
+		const BikeState &rider = frame.riders[i];
+		float speed = sqrtf(rider.vx * rider.vx + rider.vz * rider.vz);
+		if (rider.airTime > 0 || speed < 1.0f)
+		{
+			_dustDue[i] = 0;
+			continue;
+		}
 
-	if (bike_rot) {
-		bike_deltaAngle = bike_deltaAngle + (bike_rot*0.05);
-		
-		bike_lx = cos(bike_angle + bike_deltaAngle);
-		bike_lz = -sin(bike_angle + bike_deltaAngle);
+		float fx = cosf(rider.yaw);
+		float fz = -sinf(rider.yaw);
+		float wheelX = rider.x - fx * HALF_BASE;
+		float wheelZ = rider.z - fz * HALF_BASE;
+		float ground = heightAt(_terrain, wheelX, wheelZ);
+		float level = 0;
+		bool wet = _water->surfaceAt(wheelX, wheelZ, level) && level > ground;
+		_dustDue[i] += speed * (wet ? SPRAY_PER_UNIT : DUST_PER_UNIT) * dt;
+		for (; _dustDue[i] >= 1; _dustDue[i] -= 1)
+		{
+			Vec3f pos(wheelX + effectRandom(-0.3f, 0.3f),
+					  (wet ? level : ground) + 0.1f,
+					  wheelZ + effectRandom(-0.3f, 0.3f));
+			Vec3f vel(-fx * speed * 0.3f + effectRandom(-1.0f, 1.0f),
+					  wet ? effectRandom(2.0f, 4.0f) : effectRandom(1.0f, 2.5f),
+					  -fz * speed * 0.3f + effectRandom(-1.0f, 1.0f));
+			float shade = effectRandom(0.8f, 1.1f);
+			Vec3f color = wet ? Vec3f(0.75f, 0.85f, 1.0f) :
+				Vec3f(0.55f * shade, 0.42f * shade, 0.3f * shade);
+			_particles.emit(pos, vel, effectRandom(0.5f, 1.0f), color);
+		}
 	}
 
-	if (bike_deltaMove) {
-		bike_x += bike_deltaMove * bike_lx * 0.5;
-		bike_z += bike_deltaMove * bike_lz * 0.5;
+	for (int i=0; i<NUM_COLLECTIBLES; i++)
+	{
+		const Collectible &object = frame.collectibles[i];
+		if (_collectibleStates[i] == 1 && object.state == 0)
+		{
+			for (int j=0; j<PICKUP_PARTICLES; j++)
+			{
+				Vec3f dir = Vec3f(effectRandom(-1.0f, 1.0f),
+								  effectRandom(0.2f, 1.0f),
+								  effectRandom(-1.0f, 1.0f)).normalize();
+				_particles.emit(Vec3f(object.pos[0], object.pos[1],
+									  object.pos[2]),
+								dir * effectRandom(3.0f, 6.0f),
+								effectRandom(0.6f, 1.0f),
+								Vec3f(1.0f, effectRandom(0.2f, 0.9f), 0.1f));
+			}
+		}
+		_collectibleStates[i] = object.state;
 	}
-	
-	float prev_y = bike_y;
 
-	bike_y = _terrain->getHeight(bike_x, bike_z)+0.5f;
+	//A few thousand particles move faster on one thread than spread over a
+	//pool
+	_particles.update(dt, _terrain);
+}
 
-	Vec3f curNorm = _terrain->getNormal(bike_x,bike_z);
-	Vec3f fixNorm(0.0, 1.0, 0.0);
+//Draws the terrain and everything on it, as of the snapshot.  dt is the time
+//since the last frame and time the time since startup, both in seconds.
+void drawWorld(const FrameSnapshot &frame, float dt, float time) {
+	int numRiders = (int)frame.riders.size();
+	bike = frame.riders[_player];
 
+	_camera.update(_terrain, bike, dt);
+	_camera.load();
 
-	if (prev_y < bike_y-0.2)
+	GLfloat ambientLight[] = {0.5f, 0.5f, 0.5f, 1.0f};
+	glsLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambientLight);
+
+	GLfloat lightColor[] = {0.5f, 0.5f, 0.5f, 1.0f};
+	GLfloat lightPos[] = {SUN_DIRECTION[0], SUN_DIRECTION[1], SUN_DIRECTION[2],
+						  0.0f};
+	glsLightfv(GL_LIGHT0, GL_DIFFUSE, lightColor);
+	glsLightfv(GL_LIGHT0, GL_POSITION, lightPos);
+
+
+	//Place everything, then draw it all with the finished matrices
+	for (int i=0; i<numRiders; i++)
 	{
-		cam_pitch = -acos((curNorm[1]*fixNorm[1])/sqrt((curNorm[0]*curNorm[0])+(curNorm[1]*curNorm[1])+(curNorm[2]*curNorm[2])));
-		bike_pitch = acos((curNorm[1]*fixNorm[1])/sqrt((curNorm[0]*curNorm[0])+(curNorm[1]*curNorm[1])+(curNorm[2]*curNorm[2])));
+		_scene.setLocal(_bikeNodes[i], bikeTransform(frame.riders[i]));
 	}
-	else if (prev_y > bike_y+0.2)
+	const Collectible* col_obj = frame.collectibles;
+	for (int i=0; i<NUM_COLLECTIBLES; i++)
 	{
-		cam_pitch = acos((curNorm[1]*fixNorm[1])/sqrt((curNorm[0]*curNorm[0])+(curNorm[1]*curNorm[1])+(curNorm[2]*curNorm[2])));
-		bike_pitch = -acos((curNorm[1]*fixNorm[1])/sqrt((curNorm[0]*curNorm[0])+(curNorm[1]*curNorm[1])+(curNorm[2]*curNorm[2])));
+		_scene.setLocal(_collectibleNodes[i],
+						Mat4f::translation(Vec3f(col_obj[i].pos[0],
+												 col_obj[i].pos[1],
+												 col_obj[i].pos[2])));
 	}
-	
-	if (bike_roll_fl)
+	_scene.update();
+	const Mat4f &view = _camera.viewMatrix();
+	updateEffects(frame, dt);
+	//The particles face the camera, so they're drawn along its x and y axes
+	_particles.buildQuads(Vec3f(view[0], view[4], view[8]),
+						  Vec3f(view[1], view[5], view[9]), PARTICLE_SIZE);
+
+	//The headlight, just behind the front wheel of our bike
+	GLfloat light1_position[] = { 0.8, 0.0, 0.0, 1.0 };
+	glLoadMatrixf((view * _scene.world(_bikeNodes[_player])).data());
+	glsLightfv(GL_LIGHT1, GL_POSITION, light1_position);
+	glLoadMatrixf(view.data());
+
+	//Each subsystem adds its draws, and the queue makes them in the order
+	//that needs the fewest state changes
+	_terrainCommands->add(RenderQueue::makeKey(0, _terrainMaterial, _terrainMeshId, 0),
+						  _terrainMeshId, _terrainMaterial,
+						  _terrainCommands->addTransform(Mat4f::identity()));
+	for (int i=0; i<numRiders; i++)
 	{
-		bike_roll += bike_roll_fl*(0.01);
+		const Mat4f &bikeWorld = _scene.world(_bikeNodes[i]);
+		int transform = _riderCommands->addTransform(bikeWorld);
+		float depth = drawDepth(view, bikeWorld);
+		_riderCommands->add(RenderQueue::makeKey(0, _bikeMaterial, _bikeMeshId, depth),
+							_bikeMeshId, _bikeMaterial, transform);
+		if (_model != NULL)
+		{
+			transform = _riderCommands->addTransform(_scene.world(_bikeNodes[i] + 1));
+			_riderCommands->add(RenderQueue::makeKey(0, _riderMaterial, _riderMesh, depth),
+								_riderMesh, _riderMaterial, transform);
+		}
 	}
-
-	printf("x:%f y:%f z:%f rot:%f pitch:%f roll:%f\n",bike_x, bike_y, bike_z, bike_angle, bike_pitch, bike_roll);
-
-	for (int i=0; i<10; i++)
+	for (int i=0; i<NUM_COLLECTIBLES; i++)
 	{
-		if ((col_obj[i].state == 1) && (col_obj[i].pos[0]-1.0f < bike_x && bike_x < col_obj[i].pos[0]+1.0f) && (col_obj[i].pos[2]-1.0f < bike_z && bike_z < col_obj[i].pos[2]+1.0f))
+		if (col_obj[i].state == 1)
 		{
-			col_obj[i].state = 0;
-			game_score += 10;
-			game_time += 5;
+			const Mat4f &world = _scene.world(_collectibleNodes[i]);
+			_collectibleCommands->add(RenderQueue::makeKey(0, _collectibleMaterial,
+														   _collectibleMesh,
+														   drawDepth(view, world)),
+									  _collectibleMesh, _collectibleMaterial,
+									  _collectibleCommands->addTransform(world));
 		}
 	}
+	int waterTransform = _waterCommands->addTransform(Mat4f::identity());
+	for (int i=0; i<_water->numRegions(); i++)
+	{
+		const WaterRegion &region = _water->region(i);
+		Material waterMaterial = {0, false, {0.0f, 0.0f, 0.0f}};
+		waterColor(region, _camera.eyePosition(), waterMaterial.color);
+		_queue.setMaterial(_waterMaterials[i], waterMaterial);
+		Mat4f center = Mat4f::translation(Vec3f(region.center[0],
+												region.center[1],
+												region.center[2]));
+		_waterCommands->add(RenderQueue::makeKey(0, _waterMaterials[i],
+												 _waterMeshes[i],
+												 drawDepth(view, center)),
+							_waterMeshes[i], _waterMaterials[i], waterTransform);
+	}
+	_effectCommands->add(RenderQueue::makeKey(0, _particleMaterial,
+											  _particleMesh, 0),
+						 _particleMesh, _particleMaterial,
+						 _effectCommands->addTransform(Mat4f::identity()));
+	_riderTime = time;
+	_queue.submit(view);
+}
+
+void drawHud(const FrameSnapshot &frame) {
+	_hud.setScore(frame.score);
+	_hud.setTimeLeft(frame.timeLeft);
+	_hud.draw();
+}
 
-	printf( "score:%d Time-Left:%d\n",game_score,game_time);
+void update(int value) {
+	if (_simThread->snapshot().over)
+	{
+		cleanup();
+		exit(0);
+	}
 
 	glutPostRedisplay();
 	glutTimerFunc(1, update, 0);
 }
 
-void collectCreate(int value) {
-	
-	for (int i=0; i<10; i++)
+//Makes the Sim and the scene for it to be drawn in
+void setUpGame(unsigned int seed) {
+	_sim = new Sim(_terrain, _numPlayers, NUM_AI_RIDERS, seed, _water);
+	bike = _sim->getRiders().state(_player);
+	for (int i=0; i<_sim->getRiders().size(); i++)
 	{
-		collect obj;
-		obj.pos[0] = 10.0f + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(180.0f)));
-		obj.pos[2] = 10.0f + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(180.0f)));
-		obj.pos[1] = _terrain->getHeight(obj.pos[0], obj.pos[2]) + 2.0f;
-		obj.state = 1;
+		_bikeNodes.push_back(addBikeNodes(_scene));
+	}
+	for (int i=0; i<NUM_COLLECTIBLES; i++)
+	{
+		_collectibleNodes[i] = _scene.add();
+	}
+	setUpRenderQueue();
+}
+
+//Starts the game, once every asset has been loaded
+void startGame() {
+	printf("First frame after %d ms, fully loaded after %d ms\n",
+		   _firstFrameTime, glutGet(GLUT_ELAPSED_TIME));
+
+	//Every player has to start from the same seed
+	setUpGame(_net != NULL ? 1 : (unsigned int)time(0));
+	_simThread = new SimThread(_sim, _net, _player);
+	_simThread->start();
+	_lastFrameTime = glutGet(GLUT_ELAPSED_TIME);
+	_camera.snap();
+	glutTimerFunc(25, update, 0);
+}
+
+/* Sets up a networked game from the command line, which is
+ * "-net <our player number> <host:port of player 0> <host:port of player 1>
+ * ...".  Returns false if the arguments are wrong or the socket can't be
+ * opened.
+ */
+bool startNetwork(int argc, char** argv) {
+	if (argc < 5 || strcmp(argv[1], "-net") != 0) {
+		return false;
+	}
+	_player = atoi(argv[2]);
+	_numPlayers = argc - 3;
+	if (_player < 0 || _player >= _numPlayers || _numPlayers > 255) {
+		return false;
+	}
+
+	_net = new Lockstep(_numPlayers, _player, INPUT_DELAY);
+	for (int i=0; i<_numPlayers; i++)
+	{
+		string address = argv[3 + i];
+		size_t colon = address.rfind(':');
+		if (colon == string::npos) {
+			return false;
+		}
+		unsigned short port = (unsigned short)atoi(address.c_str() + colon + 1);
+		if (i == _player) {
+			if (!_net->listen(port)) {
+				return false;
+			}
+		}
+		else if (!_net->setPeer(i, address.substr(0, colon).c_str(), port)) {
+			return false;
+		}
+	}
+	return true;
+}
 
-		col_obj[i] = obj;
+//The input the offscreen replay gives the player at a tick: full throttle,
+//steering left, then straight, then right, for two seconds each
+BikeInput replayInput(int tick) {
+	BikeInput input = {1.0f, (float)(1 - tick / 240 % 3), 0.0f};
+	return input;
+}
+
+//Returns the 64-bit FNV-1a hash of the bytes
+unsigned long long checksum(const char* bytes, int size) {
+	unsigned long long hash = 14695981039346656037ULL;
+	for (int i=0; i<size; i++)
+	{
+		hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ULL;
 	}
-	glutTimerFunc(10000, collectCreate, 1);
+	return hash;
 }
 
-void gameTimer(int value) {
+/* Draws numFrames frames of a replay with no window, and saves each to a
+ * bitmap in directory, or prints a checksum of each if directory is NULL.
+ * The replay always starts from the same seed and gives the same inputs, so
+ * the same build draws the same frames.  Prints how long the CPU spent
+ * submitting each part of the frame to OpenGL.
+ */
+int runOffscreen(int numFrames, const char* directory) {
+	if (!createOffscreenContext(WINDOW_WIDTH, WINDOW_HEIGHT)) {
+		return 1;
+	}
+	initRendering();
+	handleResize(WINDOW_WIDTH, WINDOW_HEIGHT);
+	loadTerrainAsset();
+	uploadTerrainAsset();
+	loadModelAsset();
+	uploadModelAsset();
+	setUpGame(1);
+	_queue.setTiming(true);
+
+	//The CPU time each part of a frame took, in seconds, over every frame
+	const char* partNames[] = {"terrain", "bikes", "riders", "collectibles",
+							   "water", "particles", "placing and sorting",
+							   "hud", "read back"};
+	const int NUM_PARTS = sizeof(partNames) / sizeof(partNames[0]);
+	double partTimes[NUM_PARTS] = {0};
+	const int TICKS_PER_FRAME = 2;
+
+	Image image(new char[WINDOW_WIDTH * WINDOW_HEIGHT * 3],
+				WINDOW_WIDTH, WINDOW_HEIGHT);
+	unsigned long long allFrames = 14695981039346656037ULL;
+	FrameSnapshot frame;
+	int numDrawn = 0;
+	for (; numDrawn<numFrames && !_sim->over(); numDrawn++)
+	{
+		for (int i=0; i<TICKS_PER_FRAME; i++)
+		{
+			BikeInput input = replayInput(_sim->tick());
+			_sim->step(&input);
+		}
+		takeSnapshot(*_sim, _player, frame);
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		double start = SimThread::now();
+		drawWorld(frame, TICKS_PER_FRAME * PHYSICS_STEP,
+				  frame.tick * PHYSICS_STEP);
+		double worldTime = SimThread::now() - start;
+		int meshes[4] = {_terrainMeshId, _bikeMeshId, _riderMesh,
+						 _collectibleMesh};
+		for (int i=0; i<4; i++)
+		{
+			partTimes[i] += _queue.meshTime(meshes[i]);
+			worldTime -= _queue.meshTime(meshes[i]);
+		}
+		for (int i=0; i<(int)_waterMeshes.size(); i++)
+		{
+			partTimes[4] += _queue.meshTime(_waterMeshes[i]);
+			worldTime -= _queue.meshTime(_waterMeshes[i]);
+		}
+		partTimes[5] += _queue.meshTime(_particleMesh);
+		worldTime -= _queue.meshTime(_particleMesh);
+		partTimes[6] += worldTime;
+
+		start = SimThread::now();
+		drawHud(frame);
+		partTimes[7] += SimThread::now() - start;
+
+		//Reading the pixels waits for them to be drawn
+		start = SimThread::now();
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGB,
+					 GL_UNSIGNED_BYTE, image.pixels);
+		partTimes[8] += SimThread::now() - start;
+
+		int size = WINDOW_WIDTH * WINDOW_HEIGHT * 3;
+		if (directory != NULL) {
+			char filename[1024];
+			snprintf(filename, sizeof(filename), "%s/frame%04d.bmp",
+					 directory, numDrawn);
+			if (!saveBMP(filename, &image)) {
+				printf("Could not write %s\n", filename);
+				break;
+			}
+		}
+		else {
+			printf("Frame %d: %016llx\n", numDrawn, checksum(image.pixels, size));
+		}
+		allFrames = (allFrames ^ checksum(image.pixels, size)) * 1099511628211ULL;
+	}
 
-	game_time --;
-	glutTimerFunc(1000, gameTimer, 2);
+	printf("%d frames, checksum %016llx\n", numDrawn, allFrames);
+	printf("CPU time per frame:\n");
+	for (int i=0; i<NUM_PARTS; i++)
+	{
+		printf("  %-20s %8.3f ms\n", partNames[i],
+			   numDrawn > 0 ? partTimes[i] * 1000 / numDrawn : 0.0);
+	}
+	cleanup();
+	destroyOffscreenContext();
+	return 0;
 }
 
 int main(int argc, char** argv) {
 	srand((unsigned int)time(0)); //Seed the random number generator
 
+	//Offscreen rendering doesn't need a display, so it has to start before
+	//GLUT looks for one
+	if (argc > 1 && strcmp(argv[1], "-offscreen") == 0) {
+		if (argc < 3 || argc > 4 || atoi(argv[2]) <= 0) {
+			printf("Usage: %s -offscreen <frames> [<directory>]\n", argv[0]);
+			return 1;
+		}
+		return runOffscreen(atoi(argv[2]), argc > 3 ? argv[3] : NULL);
+	}
+
 	glutInit(&argc, argv);
+	if (argc > 1 && !startNetwork(argc, argv)) {
+		printf("Usage: %s [-net <player> <host:port> <host:port> ...]\n"
+			   "       %s -offscreen <frames> [<directory>]\n",
+			   argv[0], argv[0]);
+		return 1;
+	}
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-	glutInitWindowSize(800, 600);
+	glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
 
 	glutCreateWindow("MotoCross Madness");
 	initRendering();
+	startLoading();
 
-	_terrain = loadTerrain("heightmap.bmp", 30.0f); //Load the terrain
 	//Compute the scaling factor for the terrain
 	//float scaledTerrainLength =
 	//	TERRAIN_WIDTH / (_terrain->width() - 1) * (_terrain->length() - 1);
@@ -631,10 +857,6 @@ int main(int argc, char** argv) {
 	glutSpecialFunc(pressSpecialKey);
 	glutSpecialUpFunc(releaseSpecialKey);
 	glutReshapeFunc(handleResize);
-	
-	glutTimerFunc(25, update, 0);
-	glutTimerFunc(5000, collectCreate, 1);
-	glutTimerFunc(2000, gameTimer, 2);
 
 	glutMainLoop();
 	return 0;
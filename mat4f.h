@@ -0,0 +1,140 @@
+#ifndef MAT4F_H_INCLUDED
+#define MAT4F_H_INCLUDED
+
+#include "vec4f.h"
+
+/* A 4x4 matrix, stored by columns like OpenGL's, so that data() can be given
+ * straight to glLoadMatrixf or glMultMatrixf.  The factories make the same
+ * matrices as the matching GL and GLU calls.
+ */
+class Mat4f {
+	private:
+		Vec4f cols[4];
+	public:
+		Mat4f() = default;
+		
+		constexpr Mat4f(const Vec4f &col0, const Vec4f &col1,
+						const Vec4f &col2, const Vec4f &col3) :
+			cols{col0, col1, col2, col3} {
+			
+		}
+		
+		static constexpr Mat4f identity() {
+			return Mat4f(Vec4f(1, 0, 0, 0), Vec4f(0, 1, 0, 0),
+						 Vec4f(0, 0, 1, 0), Vec4f(0, 0, 0, 1));
+		}
+		
+		//Like glTranslatef
+		static constexpr Mat4f translation(const Vec3f &offset) {
+			return Mat4f(Vec4f(1, 0, 0, 0), Vec4f(0, 1, 0, 0),
+						 Vec4f(0, 0, 1, 0), Vec4f(offset, 1));
+		}
+		
+		//Like glScalef
+		static constexpr Mat4f scaling(const Vec3f &scale) {
+			return Mat4f(Vec4f(scale[0], 0, 0, 0), Vec4f(0, scale[1], 0, 0),
+						 Vec4f(0, 0, scale[2], 0), Vec4f(0, 0, 0, 1));
+		}
+		
+		//Like glRotatef: a rotation of the given number of degrees about axis
+		static Mat4f rotation(float degrees, const Vec3f &axis) {
+			Vec3f a = axis.normalize();
+			float radians = degrees * 3.14159265f / 180;
+			float c = cosf(radians);
+			float s = sinf(radians);
+			float t = 1 - c;
+			return Mat4f(Vec4f(t * a[0] * a[0] + c,
+							   t * a[0] * a[1] + s * a[2],
+							   t * a[0] * a[2] - s * a[1], 0),
+						 Vec4f(t * a[0] * a[1] - s * a[2],
+							   t * a[1] * a[1] + c,
+							   t * a[1] * a[2] + s * a[0], 0),
+						 Vec4f(t * a[0] * a[2] + s * a[1],
+							   t * a[1] * a[2] - s * a[0],
+							   t * a[2] * a[2] + c, 0),
+						 Vec4f(0, 0, 0, 1));
+		}
+		
+		//Like gluLookAt
+		static Mat4f lookAt(const Vec3f &eye, const Vec3f &target,
+							const Vec3f &up) {
+			Vec3f f = (target - eye).normalize();
+			Vec3f s = f.cross(up).normalize();
+			Vec3f u = s.cross(f);
+			return Mat4f(Vec4f(s[0], u[0], -f[0], 0),
+						 Vec4f(s[1], u[1], -f[1], 0),
+						 Vec4f(s[2], u[2], -f[2], 0),
+						 Vec4f(-s.dot(eye), -u.dot(eye), f.dot(eye), 1));
+		}
+		
+		//Like gluPerspective
+		static Mat4f perspective(float fovy, float aspect, float zNear,
+								 float zFar) {
+			float f = 1 / tanf(fovy * 3.14159265f / 360);
+			return Mat4f(Vec4f(f / aspect, 0, 0, 0),
+						 Vec4f(0, f, 0, 0),
+						 Vec4f(0, 0, (zFar + zNear) / (zNear - zFar), -1),
+						 Vec4f(0, 0, 2 * zFar * zNear / (zNear - zFar), 0));
+		}
+		
+		//Returns the element at the given index in column-major order
+		constexpr float &operator[](int index) {
+			return cols[index / 4][index % 4];
+		}
+		
+		constexpr float operator[](int index) const {
+			return cols[index / 4][index % 4];
+		}
+		
+		constexpr Vec4f &column(int index) {
+			return cols[index];
+		}
+		
+		constexpr const Vec4f &column(int index) const {
+			return cols[index];
+		}
+		
+		//Returns the 16 elements in column-major order
+		const float* data() const {
+			return cols[0].data();
+		}
+		
+		Vec4f operator*(const Vec4f &v) const {
+			Vec4f result = cols[0] * v[0];
+			result = scaleAdd(cols[1], v[1], result);
+			result = scaleAdd(cols[2], v[2], result);
+			return scaleAdd(cols[3], v[3], result);
+		}
+		
+		Mat4f operator*(const Mat4f &other) const {
+			return Mat4f(*this * other.cols[0], *this * other.cols[1],
+						 *this * other.cols[2], *this * other.cols[3]);
+		}
+		
+		const Mat4f &operator*=(const Mat4f &other) {
+			*this = *this * other;
+			return *this;
+		}
+		
+		//Returns the point p moved by this matrix, ignoring any projection
+		Vec3f transformPoint(const Vec3f &p) const {
+			return (*this * Vec4f(p, 1)).xyz();
+		}
+		
+		//Returns the direction d turned by this matrix
+		Vec3f transformDirection(const Vec3f &d) const {
+			return (*this * Vec4f(d, 0)).xyz();
+		}
+		
+		Mat4f transpose() const {
+			Mat4f result;
+			for(int i = 0; i < 4; i++) {
+				for(int j = 0; j < 4; j++) {
+					result.cols[i][j] = cols[j][i];
+				}
+			}
+			return result;
+		}
+};
+
+#endif
@@ -26,6 +26,7 @@
 
 #include "imageloader.h"
 #include "md2model.h"
+#include "texture.h"
 #include <string.h>
 
 using namespace std;
@@ -278,22 +279,6 @@ namespace {
 		float z = readFloat(input);
 		return Vec3f(x, y, z);
 	}
-	
-	//Makes the image into a texture, and returns the id of the texture
-	GLuint loadTexture(Image *image) {
-		GLuint textureId;
-		glGenTextures(1, &textureId);
-		glBindTexture(GL_TEXTURE_2D, textureId);
-		glTexImage2D(GL_TEXTURE_2D,
-					 0,
-					 GL_RGB,
-					 image->width, image->height,
-					 0,
-					 GL_RGB,
-					 GL_UNSIGNED_BYTE,
-					 image->pixels);
-		return textureId;
-	}
 }
 
 MD2Model::~MD2Model() {
@@ -310,16 +295,36 @@ MD2Model::~MD2Model() {
 	if (triangles != NULL) {
 		delete[] triangles;
 	}
+	delete textureImage;
 }
 
 MD2Model::MD2Model() {
 	frames = NULL;
 	texCoords = NULL;
 	triangles = NULL;
+	textureId = 0;
+	textureName[0] = '\0';
+	textureImage = NULL;
 }
 
-//Loads the MD2 model
 MD2Model* MD2Model::load(const char* filename) {
+	MD2Model* model = loadData(filename);
+	if (model != NULL) {
+		model->uploadTexture();
+	}
+	return model;
+}
+
+void MD2Model::uploadTexture() {
+	if (textureImage != NULL) {
+		textureId = textureManager().upload(textureName, textureImage);
+		delete textureImage;
+		textureImage = NULL;
+	}
+}
+
+//Loads the MD2 model
+MD2Model* MD2Model::loadData(const char* filename) {
 	ifstream input;
 	input.open(filename, istream::binary);
 	
@@ -358,15 +363,18 @@ MD2Model* MD2Model::load(const char* filename) {
 	//Load the texture
 	input.seekg(textureOffset, ios_base::beg);
 	input.read(buffer, 64);
+	buffer[63] = '\0';
 	if (strlen(buffer) < 5 ||
 		strcmp(buffer + strlen(buffer) - 4, ".bmp") != 0) {
 		return NULL;
 	}
 	Image* image = loadBMP(buffer);
-	GLuint textureId = loadTexture(image);
-	delete image;
+	if (image == NULL) {
+		return NULL;
+	}
 	MD2Model* model = new MD2Model();
-	model->textureId = textureId;
+	model->textureImage = image;
+	strcpy(model->textureName, buffer);
 	
 	//Load the texture coordinates
 	input.seekg(texCoordOffset, ios_base::beg);
@@ -450,7 +458,7 @@ void MD2Model::setAnimation(const char* name) {
 	}
 }
 
-void MD2Model::draw(float time) {
+void MD2Model::draw(float time, const RenderBackend* backend) {
 	if (time > -100000000 && time < 1000000000) {
 		time -= (int)time;
 		if (time < 0) {
@@ -461,11 +469,6 @@ void MD2Model::draw(float time) {
 		time = 0;
 	}
 	
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, textureId);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	
 	//Figure out the two frames between which we are interpolating
 	int frameIndex1 = (int)(time * (endFrame - startFrame + 1)) + startFrame;
 	if (frameIndex1 > endFrame) {
@@ -489,25 +492,37 @@ void MD2Model::draw(float time) {
 		 (float)(endFrame - startFrame + 1)) * (endFrame - startFrame + 1);
 	
 	//Draw the model as an interpolation between the two frames
-	glBegin(GL_TRIANGLES);
+	drawVerts.resize(numTriangles * 3 * 8);
+	float* vert = drawVerts.data();
 	for(int i = 0; i < numTriangles; i++) {
 		MD2Triangle* triangle = triangles + i;
 		for(int j = 0; j < 3; j++) {
 			MD2Vertex* v1 = frame1->vertices + triangle->vertices[j];
 			MD2Vertex* v2 = frame2->vertices + triangle->vertices[j];
-			Vec3f pos = v1->pos * (1 - frac) + v2->pos * frac;
-			Vec3f normal = v1->normal * (1 - frac) + v2->normal * frac;
+			Vec3f pos = lerp(v1->pos, v2->pos, frac);
+			Vec3f normal = lerp(v1->normal, v2->normal, frac);
 			if (normal[0] == 0 && normal[1] == 0 && normal[2] == 0) {
 				normal = Vec3f(0, 0, 1);
 			}
-			glNormal3f(normal[0], normal[1], normal[2]);
-			
 			MD2TexCoord* texCoord = texCoords + triangle->texCoords[j];
-			glTexCoord2f(texCoord->texCoordX, texCoord->texCoordY);
-			glVertex3f(pos[0], pos[1], pos[2]);
+			vert[0] = pos[0];
+			vert[1] = pos[1];
+			vert[2] = pos[2];
+			vert[3] = normal[0];
+			vert[4] = normal[1];
+			vert[5] = normal[2];
+			vert[6] = texCoord->texCoordX;
+			vert[7] = texCoord->texCoordY;
+			vert += 8;
 		}
 	}
-	glEnd();
+	
+	if (backend == NULL) {
+		backend = openGLBackend();
+	}
+	TriangleBatch batch = {drawVerts.data(), numTriangles * 3, 8, 3, -1, 6,
+						   NULL, 0};
+	backend->drawTriangles(batch);
 }
 
 
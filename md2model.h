@@ -32,6 +32,10 @@
 #include <GL/glut.h>
 #endif
 
+#include <vector>
+
+#include "imageloader.h"
+#include "renderqueue.h"
 #include "vec3f.h"
 
 struct MD2Vertex {
@@ -62,6 +66,10 @@ class MD2Model {
 		MD2Triangle* triangles;
 		int numTriangles;
 		GLuint textureId;
+		char textureName[64]; //The file name of the texture
+		Image* textureImage; //The texture, until uploadTexture() is called
+		//The interpolated frame, kept between draws to save allocating it
+		std::vector<float> drawVerts;
 		
 		int startFrame; //The first frame of the current animation
 		int endFrame;   //The last frame of the current animation
@@ -72,16 +80,33 @@ class MD2Model {
 		
 		//Switches to the given animation
 		void setAnimation(const char* name);
+		
+		//Returns the model's texture, or 0 before uploadTexture() is called
+		GLuint getTextureId() const {
+			return textureId;
+		}
+		//Returns the texture's image, which is only kept in memory until
+		//uploadTexture() is called
+		const Image* getTextureImage() const {
+			return textureImage;
+		}
 		/* Draws the state of the animated model at the specified time in the
-		 * animation.  A time of i, integer i, indicates the beginning of the
-		 * animation, and a time of i + 0.5 indicates halfway through the
-		 * animation.
+		 * animation, through backend, or through OpenGL if it's NULL.  A time
+		 * of i, integer i, indicates the beginning of the animation, and a
+		 * time of i + 0.5 indicates halfway through the animation.  The
+		 * model's texture should be bound by the current material.
 		 */
-		void draw(float time);
+		void draw(float time, const RenderBackend* backend = NULL);
 		
 		//Loads an MD2Model from the specified file.  Returns NULL if there was
 		//an error loading it.
 		static MD2Model* load(const char* filename);
+		//Like load, but leaves the texture in memory rather than making it
+		//into an OpenGL texture, so it may be called from any thread.  Call
+		//uploadTexture() on the GL thread before drawing the model.
+		static MD2Model* loadData(const char* filename);
+		//Makes the loaded texture into an OpenGL texture
+		void uploadTexture();
 };
 
 
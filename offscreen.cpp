@@ -0,0 +1,108 @@
+#include <stdio.h>
+
+#ifdef OFFSCREEN
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <string.h>
+#endif
+
+#include "offscreen.h"
+
+#ifdef OFFSCREEN
+
+namespace {
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+	EGLSurface surface = EGL_NO_SURFACE;
+	
+	//Returns Mesa's surfaceless display, which needs no window system, or the
+	//default display if there isn't one
+	EGLDisplay getDisplay() {
+		const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)
+			eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (extensions != NULL && getPlatformDisplay != NULL &&
+			strstr(extensions, "EGL_MESA_platform_surfaceless") != NULL) {
+			return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+									  EGL_DEFAULT_DISPLAY, NULL);
+		}
+		return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+}
+
+bool createOffscreenContext(int width, int height) {
+	display = getDisplay();
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+		printf("Could not open an EGL display\n");
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		printf("EGL has no desktop OpenGL\n");
+		destroyOffscreenContext();
+		return false;
+	}
+	
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) ||
+		numConfigs == 0) {
+		printf("EGL has no config with a pbuffer and a depth buffer\n");
+		destroyOffscreenContext();
+		return false;
+	}
+	
+	const EGLint surfaceAttribs[] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_NONE
+	};
+	surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+		!eglMakeCurrent(display, surface, surface, context)) {
+		printf("Could not make an EGL context (error 0x%x)\n", eglGetError());
+		destroyOffscreenContext();
+		return false;
+	}
+	return true;
+}
+
+void destroyOffscreenContext() {
+	if (display == EGL_NO_DISPLAY) {
+		return;
+	}
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context != EGL_NO_CONTEXT) {
+		eglDestroyContext(display, context);
+	}
+	if (surface != EGL_NO_SURFACE) {
+		eglDestroySurface(display, surface);
+	}
+	eglTerminate(display);
+	display = EGL_NO_DISPLAY;
+	context = EGL_NO_CONTEXT;
+	surface = EGL_NO_SURFACE;
+}
+
+#else
+
+bool createOffscreenContext(int, int) {
+	printf("Offscreen rendering needs the game built with OFFSCREEN=1\n");
+	return false;
+}
+
+void destroyOffscreenContext() {
+	
+}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef OFFSCREEN_H_INCLUDED
+#define OFFSCREEN_H_INCLUDED
+
+/* Makes an OpenGL context that draws to a width x height buffer in memory,
+ * with no window and no display, through EGL.  With Mesa's surfaceless
+ * platform this works on a machine with no X11 and no GPU, with llvmpipe
+ * doing the drawing.  The context is current on the calling thread when this
+ * returns.  Returns false if there's no such context, which is always the case
+ * unless the game was built with OFFSCREEN=1.
+ */
+bool createOffscreenContext(int width, int height);
+//Destroys the context that createOffscreenContext made, if any
+void destroyOffscreenContext();
+
+#endif
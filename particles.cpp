@@ -0,0 +1,207 @@
+#include <algorithm>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "particles.h"
+
+using namespace std;
+
+namespace {
+	const float GRAVITY = 10.0f;
+	const float DRAG = 1.5f; //Per second
+	//The fractions of the speed into the ground and along it that a bounce
+	//keeps
+	const float BOUNCE = 0.3f;
+	const float FRICTION = 0.6f;
+}
+
+ParticleSystem::ParticleSystem(int capacity2) :
+	capacity(capacity2), count(0),
+	x(capacity2), y(capacity2), z(capacity2),
+	vx(capacity2), vy(capacity2), vz(capacity2),
+	age(capacity2), life(capacity2),
+	r(capacity2), g(capacity2), b(capacity2),
+	numQuads(0) {
+}
+
+bool ParticleSystem::emit(const Vec3f &pos, const Vec3f &vel, float life2,
+						  const Vec3f &color) {
+	if (count == capacity) {
+		return false;
+	}
+	x[count] = pos[0];
+	y[count] = pos[1];
+	z[count] = pos[2];
+	vx[count] = vel[0];
+	vy[count] = vel[1];
+	vz[count] = vel[2];
+	age[count] = 0;
+	life[count] = life2;
+	r[count] = color[0];
+	g[count] = color[1];
+	b[count] = color[2];
+	count++;
+	return true;
+}
+
+/* Moves particles [begin, end).  The motion is plain arithmetic on arrays, so
+ * it's done four particles at a time with SSE where it's available, doing the
+ * same operations in the same order as the scalar code.  The terrain lookups
+ * come after, one particle at a time.
+ */
+void ParticleSystem::updateRange(Terrain* terrain, int begin, int end,
+								 float dt) {
+	float* __restrict px = &x[0];
+	float* __restrict py = &y[0];
+	float* __restrict pz = &z[0];
+	float* __restrict pvx = &vx[0];
+	float* __restrict pvy = &vy[0];
+	float* __restrict pvz = &vz[0];
+	float* __restrict page = &age[0];
+	float slow = max(0.0f, 1 - DRAG * dt);
+	float fall = GRAVITY * dt;
+	
+	int i = begin;
+#ifdef __SSE__
+	__m128 dt4 = _mm_set1_ps(dt);
+	__m128 slow4 = _mm_set1_ps(slow);
+	__m128 fall4 = _mm_set1_ps(fall);
+	for(; i + 4 <= end; i += 4) {
+		__m128 vx4 = _mm_mul_ps(_mm_loadu_ps(pvx + i), slow4);
+		__m128 vy4 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pvy + i), fall4),
+								slow4);
+		__m128 vz4 = _mm_mul_ps(_mm_loadu_ps(pvz + i), slow4);
+		_mm_storeu_ps(pvx + i, vx4);
+		_mm_storeu_ps(pvy + i, vy4);
+		_mm_storeu_ps(pvz + i, vz4);
+		_mm_storeu_ps(px + i, _mm_add_ps(_mm_loadu_ps(px + i),
+										 _mm_mul_ps(vx4, dt4)));
+		_mm_storeu_ps(py + i, _mm_add_ps(_mm_loadu_ps(py + i),
+										 _mm_mul_ps(vy4, dt4)));
+		_mm_storeu_ps(pz + i, _mm_add_ps(_mm_loadu_ps(pz + i),
+										 _mm_mul_ps(vz4, dt4)));
+		_mm_storeu_ps(page + i, _mm_add_ps(_mm_loadu_ps(page + i), dt4));
+	}
+#endif
+	for(; i < end; i++) {
+		pvx[i] = pvx[i] * slow;
+		pvy[i] = (pvy[i] - fall) * slow;
+		pvz[i] = pvz[i] * slow;
+		px[i] += pvx[i] * dt;
+		py[i] += pvy[i] * dt;
+		pz[i] += pvz[i] * dt;
+		page[i] += dt;
+	}
+	
+	//Particles that went into the ground bounce back out of it
+	for(i = begin; i < end; i++) {
+		float ground = heightAt(terrain, px[i], pz[i]);
+		if (py[i] < ground) {
+			py[i] = ground;
+			pvx[i] *= FRICTION;
+			pvy[i] = pvy[i] < 0 ? -pvy[i] * BOUNCE : pvy[i];
+			pvz[i] *= FRICTION;
+		}
+	}
+}
+
+void ParticleSystem::update(float dt, Terrain* terrain, ThreadPool* pool) {
+	int numChunks = (count + CHUNK - 1) / CHUNK;
+	auto move = [&](int chunk) {
+		updateRange(terrain, chunk * CHUNK, min(count, (chunk + 1) * CHUNK),
+					dt);
+	};
+	if (pool != NULL && numChunks > 1) {
+		pool->parallelFor(numChunks, move);
+	}
+	else {
+		for(int chunk = 0; chunk < numChunks; chunk++) {
+			move(chunk);
+		}
+	}
+	
+	//Remove the dead by moving the last particle into each one's place
+	int i = 0;
+	while (i < count) {
+		if (age[i] < life[i]) {
+			i++;
+			continue;
+		}
+		count--;
+		x[i] = x[count];
+		y[i] = y[count];
+		z[i] = z[count];
+		vx[i] = vx[count];
+		vy[i] = vy[count];
+		vz[i] = vz[count];
+		age[i] = age[count];
+		life[i] = life[count];
+		r[i] = r[count];
+		g[i] = g[count];
+		b[i] = b[count];
+	}
+}
+
+void ParticleSystem::buildRange(const Vec3f &right, const Vec3f &up,
+								float size, int begin, int end) {
+	const float CORNERS[4][2] = {{-0.5f, -0.5f}, {0.5f, -0.5f},
+								 {-0.5f, 0.5f}, {0.5f, 0.5f}};
+	for(int i = begin; i < end; i++) {
+		float scale = size * max(0.0f, 1 - age[i] / life[i]);
+		float* vert = &quads[24 * i];
+		for(int j = 0; j < 4; j++) {
+			float u = CORNERS[j][0] * scale;
+			float v = CORNERS[j][1] * scale;
+			vert[0] = x[i] + right[0] * u + up[0] * v;
+			vert[1] = y[i] + right[1] * u + up[1] * v;
+			vert[2] = z[i] + right[2] * u + up[2] * v;
+			vert[3] = r[i];
+			vert[4] = g[i];
+			vert[5] = b[i];
+			vert += 6;
+		}
+	}
+}
+
+void ParticleSystem::buildQuads(const Vec3f &right, const Vec3f &up,
+								float size, ThreadPool* pool) {
+	numQuads = count;
+	if ((int)quads.size() < 24 * count) {
+		quads.resize(24 * count);
+	}
+	//Every quad is two triangles the same way round, so the indices only
+	//need making once for each quad
+	for(int i = (int)indices.size() / 6; i < count; i++) {
+		unsigned int corner = 4 * i;
+		const unsigned int quad[6] = {corner, corner + 1, corner + 2,
+									  corner + 2, corner + 1, corner + 3};
+		indices.insert(indices.end(), quad, quad + 6);
+	}
+	
+	int numChunks = (count + CHUNK - 1) / CHUNK;
+	auto build = [&](int chunk) {
+		buildRange(right, up, size, chunk * CHUNK,
+				   min(count, (chunk + 1) * CHUNK));
+	};
+	if (pool != NULL && numChunks > 1) {
+		pool->parallelFor(numChunks, build);
+	}
+	else {
+		for(int chunk = 0; chunk < numChunks; chunk++) {
+			build(chunk);
+		}
+	}
+}
+
+void ParticleSystem::draw(const RenderBackend* backend) const {
+	if (numQuads == 0) {
+		return;
+	}
+	if (backend == NULL) {
+		backend = openGLBackend();
+	}
+	TriangleBatch batch = {&quads[0], 4 * numQuads, 6, -1, 3, -1,
+						   &indices[0], 6 * numQuads};
+	backend->drawTriangles(batch);
+}
@@ -0,0 +1,85 @@
+#ifndef PARTICLES_H_INCLUDED
+#define PARTICLES_H_INCLUDED
+
+#include <vector>
+
+#include "renderqueue.h"
+#include "terrain.h"
+#include "threadpool.h"
+#include "vec3f.h"
+
+/* A pool of short-lived particles, such as dust and splashes, that fall under
+ * gravity, slow with drag and bounce off the terrain until they die.  Each
+ * field is kept in its own array, like the riders' (see RiderSystem), so an
+ * update works through memory in order and moves four particles at a time
+ * with SSE where it's available.  The pool has a fixed size, so emitting
+ * never allocates; a dead particle is removed by moving the last one into
+ * its place.
+ *
+ * Each frame, the particles are turned into one batch of quads facing the
+ * camera, which is drawn with a single call.
+ */
+class ParticleSystem {
+	private:
+		int capacity;
+		int count;
+		std::vector<float> x, y, z;
+		std::vector<float> vx, vy, vz;
+		std::vector<float> age, life; //In seconds
+		std::vector<float> r, g, b;
+		std::vector<float> quads; //x, y, z, r, g, b for each quad corner
+		std::vector<unsigned int> indices;
+		int numQuads;
+		
+		void updateRange(Terrain* terrain, int begin, int end, float dt);
+		void buildRange(const Vec3f &right, const Vec3f &up, float size,
+						int begin, int end);
+	public:
+		//The particles updated together as one job, when updating on a pool
+		static const int CHUNK = 16384;
+		
+		explicit ParticleSystem(int capacity2);
+		
+		int size() const {
+			return count;
+		}
+		
+		int getCapacity() const {
+			return capacity;
+		}
+		
+		//Returns the position of a particle
+		Vec3f position(int particle) const {
+			return Vec3f(x[particle], y[particle], z[particle]);
+		}
+		
+		/* Adds a particle at pos, moving at vel, that lives for life seconds,
+		 * with the given colour.  Returns false, and adds nothing, if the
+		 * pool is full.
+		 */
+		bool emit(const Vec3f &pos, const Vec3f &vel, float life2,
+				  const Vec3f &color);
+		//Removes every particle
+		void clear() {
+			count = 0;
+		}
+		
+		/* Advances every particle by dt seconds, keeping them above the
+		 * terrain, and removes the ones that have died.  If pool isn't NULL,
+		 * the particles are moved in chunks of CHUNK spread across it.
+		 */
+		void update(float dt, Terrain* terrain, ThreadPool* pool = NULL);
+		
+		/* Makes the quads that draw the particles, size across, in the plane
+		 * of right and up, which should be the camera's.  A particle shrinks
+		 * to nothing as it dies.  If pool isn't NULL, the quads are made on
+		 * it.
+		 */
+		void buildQuads(const Vec3f &right, const Vec3f &up, float size,
+						ThreadPool* pool = NULL);
+		//Draws the quads from the last buildQuads, unlit, through backend,
+		//or through OpenGL if it's NULL
+		void draw(const RenderBackend* backend = NULL) const;
+};
+
+#endif
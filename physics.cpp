@@ -0,0 +1,419 @@
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "physics.h"
+#include "water.h"
+
+BikeParams defaultBikeParams() {
+	BikeParams params;
+	params.wheelBase = 2.0f;
+	params.rideHeight = 0.5f;
+	params.maxCompression = 0.4f;
+	params.springRate = 100.0f;
+	params.damping = 8.0f;
+	params.mass = 1.0f;
+	params.pitchInertia = 0.33f;
+	params.pitchDamping = 1.0f;
+	params.gravity = 20.0f;
+	params.engineAccel = 16.0f;
+	params.reverseAccel = 8.0f;
+	params.rollingDrag = 0.5f;
+	params.airDrag = 0.3f;
+	params.grip = 8.0f;
+	params.turnRate = 2.5f;
+	params.maxLean = 0.5f;
+	params.leanRate = 5.0f;
+	params.waterDrag = 3.0f;
+	params.buoyancy = 30.0f;
+	return params;
+}
+
+namespace {
+	//Returns the unit normal of the terrain at the grid point nearest (x, z)
+	void groundNormal(Terrain* terrain, float x, float z, float* normal) {
+		int ix = (int)(x + 0.5f);
+		int iz = (int)(z + 0.5f);
+		ix = ix < 0 ? 0 : (ix > terrain->width() - 1 ? terrain->width() - 1 : ix);
+		iz = iz < 0 ? 0 : (iz > terrain->length() - 1 ? terrain->length() - 1 : iz);
+		Vec3f n = terrain->getNormal(ix, iz);
+		float m = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		normal[0] = n[0] / m;
+		normal[1] = n[1] / m;
+		normal[2] = n[2] / m;
+	}
+	
+	float clamp(float value, float low, float high) {
+		return value < low ? low : (value > high ? high : value);
+	}
+}
+
+void placeBike(Terrain* terrain,
+			   const BikeParams &params,
+			   float x, float z, float yaw,
+			   BikeState &bike) {
+	//Rest on the suspension, compressed enough to hold the bike up
+	float sag = params.mass * params.gravity / (2 * params.springRate);
+	bike.x = x;
+	bike.z = z;
+	bike.y = heightAt(terrain, x, z) + params.rideHeight - sag;
+	bike.vx = 0;
+	bike.vy = 0;
+	bike.vz = 0;
+	bike.yaw = yaw;
+	bike.pitch = 0;
+	bike.pitchVel = 0;
+	bike.roll = 0;
+	bike.compression[0] = sag;
+	bike.compression[1] = sag;
+	bike.airTime = 0;
+}
+
+Mat4f bikeTransform(const BikeState &bike) {
+	const float DEGREES = 180 / 3.1415926535f;
+	return Mat4f::translation(Vec3f(bike.x, bike.y, bike.z)) *
+		Mat4f::rotation(bike.yaw * DEGREES, Vec3f(0, 1, 0)) *
+		Mat4f::rotation(bike.pitch * DEGREES, Vec3f(0, 0, 1)) *
+		Mat4f::rotation(bike.roll * DEGREES, Vec3f(1, 0, 0));
+}
+
+void stepBike(Terrain* terrain,
+			  const BikeParams &params,
+			  const BikeInput &input,
+			  BikeState &bike,
+			  float dt,
+			  const WaterMap* water) {
+	BikeArrays bikes = {
+		&bike.x, &bike.y, &bike.z,
+		&bike.vx, &bike.vy, &bike.vz,
+		&bike.yaw, &bike.pitch, &bike.pitchVel, &bike.roll,
+		{&bike.compression[0], &bike.compression[1]},
+		&bike.airTime,
+		&input.throttle, &input.steer, &input.lean
+	};
+	stepBikes(terrain, params, bikes, 0, 1, dt, water);
+}
+
+namespace {
+	//The number of bikes stepped together.  Each stage of the step runs over
+	//a whole block before the next starts, so that the stages without
+	//terrain lookups or trigonometry are plain arithmetic on arrays, which
+	//is done four bikes at a time with SSE2 where it's available.  The SSE2
+	//code does the same operations in the same order as the scalar code, so
+	//a bike moves identically whichever path steps it.
+	const int BLOCK = 64;
+	
+#ifdef __SSE2__
+	//Returns mask ? a : b, for masks made by the comparison intrinsics
+	inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+	
+	inline __m128 clamp4(__m128 value, __m128 low, __m128 high) {
+		return _mm_min_ps(_mm_max_ps(value, low), high);
+	}
+#endif
+	
+	void stepBlock(Terrain* terrain,
+				   const BikeParams &params,
+				   const BikeArrays &bikes,
+				   int begin,
+				   int n,
+				   float dt,
+				   const WaterMap* water) {
+		float* __restrict x = bikes.x + begin;
+		float* __restrict y = bikes.y + begin;
+		float* __restrict z = bikes.z + begin;
+		float* __restrict vx = bikes.vx + begin;
+		float* __restrict vy = bikes.vy + begin;
+		float* __restrict vz = bikes.vz + begin;
+		float* __restrict yaw = bikes.yaw + begin;
+		float* __restrict pitch = bikes.pitch + begin;
+		float* __restrict pitchVel = bikes.pitchVel + begin;
+		float* __restrict roll = bikes.roll + begin;
+		float* __restrict airTime = bikes.airTime + begin;
+		const float* __restrict throttle = bikes.throttle + begin;
+		const float* __restrict steer = bikes.steer + begin;
+		const float* __restrict lean = bikes.lean + begin;
+		float halfBase = params.wheelBase / 2;
+		
+		float fx[BLOCK]; //The direction each bike faces
+		float fz[BLOCK];
+		float cosPitch[BLOCK];
+		float sinPitch[BLOCK];
+		for(int k = 0; k < n; k++) {
+			fx[k] = cosf(yaw[k]);
+			fz[k] = -sinf(yaw[k]);
+			cosPitch[k] = cosf(pitch[k]);
+			sinPitch[k] = sinf(pitch[k]);
+		}
+		
+		//Suspension forces at the front (w = 0) and rear (w = 1) wheels
+		float support[BLOCK]; //Total upward force
+		float torque[BLOCK];  //Total torque raising the front
+		float numGrounded[BLOCK];
+		for(int k = 0; k < n; k++) {
+			support[k] = 0;
+			torque[k] = 0;
+			numGrounded[k] = 0;
+		}
+		for(int w = 0; w < 2; w++) {
+			float arm = (w == 0 ? halfBase : -halfBase);
+			float ground[BLOCK];
+			for(int k = 0; k < n; k++) {
+				ground[k] = heightAt(terrain,
+									 x[k] + fx[k] * arm * cosPitch[k],
+									 z[k] + fz[k] * arm * cosPitch[k]);
+			}
+			
+			float* __restrict compression = bikes.compression[w] + begin;
+			int k = 0;
+#ifdef __SSE2__
+			__m128 zero = _mm_setzero_ps();
+			__m128 one = _mm_set1_ps(1);
+			__m128 arm4 = _mm_set1_ps(arm);
+			__m128 rideHeight = _mm_set1_ps(params.rideHeight);
+			__m128 springRate = _mm_set1_ps(params.springRate);
+			__m128 damping = _mm_set1_ps(params.damping);
+			for(; k + 4 <= n; k += 4) {
+				__m128 armCos = _mm_mul_ps(arm4, _mm_loadu_ps(cosPitch + k));
+				__m128 hubY = _mm_add_ps(_mm_loadu_ps(y + k),
+										 _mm_mul_ps(arm4, _mm_loadu_ps(sinPitch + k)));
+				__m128 hubVY = _mm_add_ps(_mm_loadu_ps(vy + k),
+										  _mm_mul_ps(armCos, _mm_loadu_ps(pitchVel + k)));
+				__m128 c = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(ground + k), rideHeight),
+									  hubY);
+				__m128 force = _mm_sub_ps(_mm_mul_ps(springRate, c),
+										  _mm_mul_ps(damping, hubVY));
+				__m128 touching = _mm_cmpgt_ps(c, zero);
+				force = _mm_and_ps(touching, _mm_max_ps(force, zero));
+				_mm_storeu_ps(numGrounded + k,
+							  _mm_add_ps(_mm_loadu_ps(numGrounded + k),
+										 _mm_and_ps(touching, one)));
+				_mm_storeu_ps(compression + k, _mm_and_ps(touching, c));
+				_mm_storeu_ps(support + k,
+							  _mm_add_ps(_mm_loadu_ps(support + k), force));
+				_mm_storeu_ps(torque + k,
+							  _mm_add_ps(_mm_loadu_ps(torque + k),
+										 _mm_mul_ps(armCos, force)));
+			}
+#endif
+			for(; k < n; k++) {
+				float hubY = y[k] + arm * sinPitch[k];
+				float hubVY = vy[k] + arm * cosPitch[k] * pitchVel[k];
+				float c = ground[k] + params.rideHeight - hubY;
+				float force = params.springRate * c - params.damping * hubVY;
+				//The ground can only push, and only when it's touching
+				force = force > 0 ? force : 0;
+				force = c > 0 ? force : 0;
+				numGrounded[k] += (c > 0 ? 1 : 0);
+				compression[k] = (c > 0 ? c : 0);
+				support[k] += force;
+				torque[k] += arm * cosPitch[k] * force;
+			}
+		}
+		
+		//The ground pushes along its normal, so on a slope part of the
+		//support pushes the bike downhill
+		float normalX[BLOCK];
+		float normalY[BLOCK];
+		float normalZ[BLOCK];
+		for(int k = 0; k < n; k++) {
+			float normal[3] = {0, 1, 0};
+			if (numGrounded[k] > 0) {
+				groundNormal(terrain, x[k], z[k], normal);
+			}
+			normalX[k] = normal[0];
+			normalY[k] = normal[1];
+			normalZ[k] = normal[2];
+		}
+		
+		//A bike in the air has no support and no contact, so the ground
+		//terms below all come to zero for it
+		int k = 0;
+#ifdef __SSE2__
+		__m128 zero = _mm_setzero_ps();
+		__m128 one = _mm_set1_ps(1);
+		__m128 two = _mm_set1_ps(2);
+		__m128 signBit = _mm_set1_ps(-0.0f);
+		__m128 dt4 = _mm_set1_ps(dt);
+		__m128 engineAccel = _mm_set1_ps(params.engineAccel);
+		__m128 reverseAccel = _mm_set1_ps(params.reverseAccel);
+		__m128 mass = _mm_set1_ps(params.mass);
+		__m128 gravity = _mm_set1_ps(params.gravity);
+		__m128 rollingDrag = _mm_set1_ps(params.rollingDrag);
+		__m128 airDrag = _mm_set1_ps(params.airDrag);
+		__m128 pitchInertia = _mm_set1_ps(params.pitchInertia);
+		__m128 pitchDamping = _mm_set1_ps(params.pitchDamping);
+		__m128 turnRate = _mm_set1_ps(params.turnRate);
+		__m128 gripDt = _mm_mul_ps(_mm_set1_ps(params.grip), dt4);
+		__m128 minPitch = _mm_set1_ps(-1.2f);
+		__m128 maxPitch = _mm_set1_ps(1.2f);
+		for(; k + 4 <= n; k += 4) {
+			__m128 fx4 = _mm_loadu_ps(fx + k);
+			__m128 fz4 = _mm_loadu_ps(fz + k);
+			__m128 vx4 = _mm_loadu_ps(vx + k);
+			__m128 vy4 = _mm_loadu_ps(vy + k);
+			__m128 vz4 = _mm_loadu_ps(vz + k);
+			__m128 pitchVel4 = _mm_loadu_ps(pitchVel + k);
+			__m128 throttle4 = _mm_loadu_ps(throttle + k);
+			__m128 normalY4 = _mm_loadu_ps(normalY + k);
+			
+			__m128 contact = _mm_div_ps(_mm_loadu_ps(numGrounded + k), two);
+			__m128 accel = _mm_mul_ps(throttle4,
+									  select(_mm_cmpgt_ps(throttle4, zero),
+											 engineAccel,
+											 reverseAccel));
+			__m128 lift = _mm_div_ps(_mm_loadu_ps(support + k), mass);
+			__m128 ax = _mm_div_ps(_mm_mul_ps(lift, _mm_loadu_ps(normalX + k)),
+								   normalY4);
+			__m128 ay = _mm_sub_ps(lift, gravity);
+			__m128 az = _mm_div_ps(_mm_mul_ps(lift, _mm_loadu_ps(normalZ + k)),
+								   normalY4);
+			ax = _mm_add_ps(ax, _mm_mul_ps(_mm_mul_ps(fx4, accel), contact));
+			az = _mm_add_ps(az, _mm_mul_ps(_mm_mul_ps(fz4, accel), contact));
+			ax = _mm_sub_ps(ax, _mm_mul_ps(_mm_mul_ps(vx4, rollingDrag), contact));
+			az = _mm_sub_ps(az, _mm_mul_ps(_mm_mul_ps(vz4, rollingDrag), contact));
+			ax = _mm_sub_ps(ax, _mm_mul_ps(vx4, airDrag));
+			az = _mm_sub_ps(az, _mm_mul_ps(vz4, airDrag));
+			__m128 pitchAccel =
+				_mm_sub_ps(_mm_div_ps(_mm_loadu_ps(torque + k), pitchInertia),
+						   _mm_mul_ps(pitchDamping, pitchVel4));
+			
+			_mm_storeu_ps(yaw + k,
+						  _mm_add_ps(_mm_loadu_ps(yaw + k),
+									 _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(steer + k),
+														   turnRate),
+												dt4)));
+			
+			vx4 = _mm_add_ps(vx4, _mm_mul_ps(ax, dt4));
+			vy4 = _mm_add_ps(vy4, _mm_mul_ps(ay, dt4));
+			vz4 = _mm_add_ps(vz4, _mm_mul_ps(az, dt4));
+			pitchVel4 = _mm_add_ps(pitchVel4, _mm_mul_ps(pitchAccel, dt4));
+			
+			__m128 negFz = _mm_xor_ps(fz4, signBit);
+			__m128 sideways = _mm_add_ps(_mm_mul_ps(vx4, negFz),
+										 _mm_mul_ps(vz4, fx4));
+			__m128 slip = clamp4(_mm_mul_ps(gripDt, contact), zero, one);
+			vx4 = _mm_sub_ps(vx4, _mm_mul_ps(_mm_mul_ps(negFz, sideways), slip));
+			vz4 = _mm_sub_ps(vz4, _mm_mul_ps(_mm_mul_ps(fx4, sideways), slip));
+			
+			_mm_storeu_ps(vx + k, vx4);
+			_mm_storeu_ps(vy + k, vy4);
+			_mm_storeu_ps(vz + k, vz4);
+			_mm_storeu_ps(pitchVel + k, pitchVel4);
+			_mm_storeu_ps(x + k, _mm_add_ps(_mm_loadu_ps(x + k), _mm_mul_ps(vx4, dt4)));
+			_mm_storeu_ps(y + k, _mm_add_ps(_mm_loadu_ps(y + k), _mm_mul_ps(vy4, dt4)));
+			_mm_storeu_ps(z + k, _mm_add_ps(_mm_loadu_ps(z + k), _mm_mul_ps(vz4, dt4)));
+			__m128 newPitch = _mm_add_ps(_mm_loadu_ps(pitch + k),
+										 _mm_mul_ps(pitchVel4, dt4));
+			_mm_storeu_ps(pitch + k, clamp4(newPitch, minPitch, maxPitch));
+		}
+#endif
+		for(; k < n; k++) {
+			float contact = numGrounded[k] / 2.0f;
+			float accel = throttle[k] *
+				(throttle[k] > 0 ? params.engineAccel : params.reverseAccel);
+			float ax = support[k] / params.mass * normalX[k] / normalY[k];
+			float ay = support[k] / params.mass - params.gravity;
+			float az = support[k] / params.mass * normalZ[k] / normalY[k];
+			ax += fx[k] * accel * contact;
+			az += fz[k] * accel * contact;
+			ax -= vx[k] * params.rollingDrag * contact;
+			az -= vz[k] * params.rollingDrag * contact;
+			ax -= vx[k] * params.airDrag;
+			az -= vz[k] * params.airDrag;
+			float pitchAccel = torque[k] / params.pitchInertia -
+				params.pitchDamping * pitchVel[k];
+			
+			yaw[k] += steer[k] * params.turnRate * dt;
+			
+			//Semi-implicit Euler: update the velocities, then move with the
+			//new ones
+			vx[k] += ax * dt;
+			vy[k] += ay * dt;
+			vz[k] += az * dt;
+			pitchVel[k] += pitchAccel * dt;
+			
+			//The tyres stop the bike sliding sideways
+			float sideways = vx[k] * -fz[k] + vz[k] * fx[k];
+			float slip = clamp(params.grip * dt * contact, 0, 1);
+			vx[k] -= -fz[k] * sideways * slip;
+			vz[k] -= fx[k] * sideways * slip;
+			
+			x[k] += vx[k] * dt;
+			y[k] += vy[k] * dt;
+			z[k] += vz[k] * dt;
+			pitch[k] = clamp(pitch[k] + pitchVel[k] * dt, -1.2f, 1.2f);
+		}
+		
+		//Water drags on a bike and floats it, in proportion to how far into
+		//it the bike is
+		if (water != NULL) {
+			for(int k = 0; k < n; k++) {
+				float level;
+				if (!water->surfaceAt(x[k], z[k], level)) {
+					continue;
+				}
+				float under = clamp((level - y[k] + params.rideHeight) /
+									(2 * params.rideHeight), 0, 1);
+				float drag = clamp(params.waterDrag * under * dt, 0, 1);
+				vx[k] -= vx[k] * drag;
+				vy[k] -= vy[k] * drag;
+				vz[k] -= vz[k] * drag;
+				vy[k] += params.buoyancy * under * dt;
+			}
+		}
+		
+		//If the suspension bottoms out, the frame hits the ground and stops
+		for(int k = 0; k < n; k++) {
+			float c = cosf(pitch[k]);
+			float s = sinf(pitch[k]);
+			for(int w = 0; w < 2; w++) {
+				float arm = (w == 0 ? halfBase : -halfBase);
+				float hubY = y[k] + arm * s;
+				float lowest = heightAt(terrain,
+										x[k] + fx[k] * arm * c,
+										z[k] + fz[k] * arm * c) +
+					params.rideHeight - params.maxCompression;
+				if (hubY < lowest) {
+					y[k] += lowest - hubY;
+					if (vy[k] < 0) {
+						vy[k] = 0;
+					}
+				}
+			}
+		}
+		
+		//Keep the bikes on the terrain
+		float maxX = (float)(terrain->width() - 1);
+		float maxZ = (float)(terrain->length() - 1);
+		float follow = clamp(params.leanRate * dt, 0, 1);
+		for(int k = 0; k < n; k++) {
+			float clampedX = clamp(x[k], 0, maxX);
+			float clampedZ = clamp(z[k], 0, maxZ);
+			vx[k] = clampedX != x[k] ? 0 : vx[k];
+			vz[k] = clampedZ != z[k] ? 0 : vz[k];
+			x[k] = clampedX;
+			z[k] = clampedZ;
+			
+			roll[k] += (lean[k] * params.maxLean - roll[k]) * follow;
+			float air = airTime[k] + dt;
+			airTime[k] = numGrounded[k] > 0 ? 0 : air;
+		}
+	}
+}
+
+void stepBikes(Terrain* terrain,
+			   const BikeParams &params,
+			   const BikeArrays &bikes,
+			   int begin,
+			   int end,
+			   float dt,
+			   const WaterMap* water) {
+	for(int i = begin; i < end; i += BLOCK) {
+		stepBlock(terrain, params, bikes, i, end - i < BLOCK ? end - i : BLOCK, dt,
+				  water);
+	}
+}
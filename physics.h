@@ -0,0 +1,116 @@
+#ifndef PHYSICS_H_INCLUDED
+#define PHYSICS_H_INCLUDED
+
+#include "mat4f.h"
+#include "terrain.h"
+
+class WaterMap;
+
+//The length of one physics step, in seconds.  The physics always advances in
+//steps of this length, however often the game updates.
+const float PHYSICS_STEP = 1.0f / 120.0f;
+
+//The controls for a bike during one step
+struct BikeInput {
+	float throttle; //From -1 (full reverse) to 1 (full throttle)
+	float steer;    //From -1 (full right) to 1 (full left)
+	float lean;     //From -1 (lean left) to 1 (lean right)
+};
+
+//Constants that describe how a bike handles
+struct BikeParams {
+	float wheelBase;      //The distance between the two wheel hubs
+	float rideHeight;     //The rest length of the suspension, hub to ground
+	float maxCompression; //How far the suspension can compress
+	float springRate;     //Suspension force per unit of compression
+	float damping;        //Suspension force per unit of hub velocity
+	float mass;
+	float pitchInertia;   //Moment of inertia about the bike's side axis
+	float pitchDamping;   //Angular drag on pitching, per second
+	float gravity;
+	float engineAccel;    //Acceleration at full throttle
+	float reverseAccel;   //Acceleration at full reverse
+	float rollingDrag;    //Drag from the ground, per second, on the ground
+	float airDrag;        //Drag from the air, per second
+	float grip;           //How fast sideways sliding is stopped, per second
+	float turnRate;       //Radians per second at full steer
+	float maxLean;        //Radians of roll at full lean
+	float leanRate;       //How fast the roll follows the lean, per second
+	float waterDrag;      //Drag from water, per second, when under it
+	float buoyancy;       //Upward acceleration when under water
+};
+
+//Returns the parameters of the standard bike
+BikeParams defaultBikeParams();
+
+/* The state of one bike.  The position is the center of the body, midway
+ * between the wheel hubs.  A yaw of 0 faces down the positive x axis, and a
+ * positive yaw turns toward the negative z axis.  A positive pitch raises the
+ * front wheel.
+ */
+struct BikeState {
+	float x, y, z;
+	float vx, vy, vz;
+	float yaw;
+	float pitch;
+	float pitchVel;
+	float roll;
+	float compression[2]; //The compression of the front and rear suspension
+	float airTime;        //How long both wheels have been off the ground
+};
+
+/* Many bikes stored as one array per field.  Every pointer must point to at
+ * least as many elements as the number of bikes being stepped.
+ */
+struct BikeArrays {
+	float* x;
+	float* y;
+	float* z;
+	float* vx;
+	float* vy;
+	float* vz;
+	float* yaw;
+	float* pitch;
+	float* pitchVel;
+	float* roll;
+	float* compression[2];
+	float* airTime;
+	const float* throttle;
+	const float* steer;
+	const float* lean;
+};
+
+//Puts a bike at rest on the terrain at (x, z), facing yaw
+void placeBike(Terrain* terrain,
+			   const BikeParams &params,
+			   float x, float z, float yaw,
+			   BikeState &bike);
+//Returns the matrix that places a bike model, whose +x points forward and +y
+//up, where the bike is: yawed, then pitched, then rolled
+Mat4f bikeTransform(const BikeState &bike);
+/* Advances a bike by dt seconds, which should normally be PHYSICS_STEP.  Each
+ * wheel touches the terrain at a single point under its hub, through a spring
+ * and damper, and the bike moves as a rigid body under gravity, using a
+ * semi-implicit Euler step.  If water isn't NULL, a bike in it is slowed and
+ * lifted in proportion to how far into it the bike is, from its wheels'
+ * contact points to twice its ride height above them.  This doesn't allocate
+ * memory, and only reads the terrain and the water, so many bikes may be
+ * stepped at once on different threads.
+ */
+void stepBike(Terrain* terrain,
+			  const BikeParams &params,
+			  const BikeInput &input,
+			  BikeState &bike,
+			  float dt,
+			  const WaterMap* water = NULL);
+//Advances bikes [begin, end) of the given arrays by dt seconds, exactly as
+//stepBike would advance each of them
+void stepBikes(Terrain* terrain,
+			   const BikeParams &params,
+			   const BikeArrays &bikes,
+			   int begin,
+			   int end,
+			   float dt,
+			   const WaterMap* water = NULL);
+
+#endif
@@ -0,0 +1,252 @@
+#include <math.h>
+
+#include "raycast.h"
+
+using namespace std;
+
+namespace {
+	const float FAR = 1e30f;
+	const int RAYS_PER_JOB = 256;
+	
+	//Returns which of count cells of the given size p lies in, taking a point
+	//on a boundary to be in the cell that a ray heading in direction d is
+	//about to enter
+	int cellIndex(float p, int size, float d, int count) {
+		float f = p / size;
+		int i = (int)floorf(f);
+		if (d < 0 && f == (float)i) {
+			i--;
+		}
+		return i < 0 ? 0 : (i > count - 1 ? count - 1 : i);
+	}
+	
+	//Returns the distance along a ray with the given origin and direction
+	//coordinates at which it leaves the cell [cell * size, (cell + 1) * size]
+	float exitDist(float origin, float dir, int cell, int size) {
+		if (dir > 0) {
+			return ((cell + 1) * size - origin) / dir;
+		}
+		else if (dir < 0) {
+			return (cell * size - origin) / dir;
+		}
+		return FAR;
+	}
+}
+
+TerrainRaycaster::TerrainRaycaster(Terrain* terrain) {
+	w = terrain->width() - 1;
+	l = terrain->length() - 1;
+	heights.resize((w + 1) * (l + 1));
+	for(int z = 0; z <= l; z++) {
+		for(int x = 0; x <= w; x++) {
+			heights[z * (w + 1) + x] = terrain->getHeight(x, z);
+		}
+	}
+	
+	//Each cell's patch lies between the lowest and highest of its corners
+	mins.push_back(vector<float>(w * l));
+	maxs.push_back(vector<float>(w * l));
+	levelWidths.push_back(w);
+	levelLengths.push_back(l);
+	for(int z = 0; z < l; z++) {
+		for(int x = 0; x < w; x++) {
+			float h00 = height(x, z);
+			float h10 = height(x + 1, z);
+			float h01 = height(x, z + 1);
+			float h11 = height(x + 1, z + 1);
+			mins[0][z * w + x] = fminf(fminf(h00, h10), fminf(h01, h11));
+			maxs[0][z * w + x] = fmaxf(fmaxf(h00, h10), fmaxf(h01, h11));
+		}
+	}
+	
+	//Each block of the next level up covers 2x2 blocks of the one below
+	while (levelWidths.back() > 1 || levelLengths.back() > 1) {
+		int level = (int)mins.size() - 1;
+		int childWidth = levelWidths[level];
+		int childLength = levelLengths[level];
+		int width = (childWidth + 1) / 2;
+		int length = (childLength + 1) / 2;
+		vector<float> levelMins(width * length);
+		vector<float> levelMaxs(width * length);
+		for(int z = 0; z < length; z++) {
+			for(int x = 0; x < width; x++) {
+				float low = FAR;
+				float high = -FAR;
+				for(int cz = 2 * z; cz < 2 * z + 2 && cz < childLength; cz++) {
+					for(int cx = 2 * x; cx < 2 * x + 2 && cx < childWidth; cx++) {
+						low = fminf(low, mins[level][cz * childWidth + cx]);
+						high = fmaxf(high, maxs[level][cz * childWidth + cx]);
+					}
+				}
+				levelMins[z * width + x] = low;
+				levelMaxs[z * width + x] = high;
+			}
+		}
+		mins.push_back(levelMins);
+		maxs.push_back(levelMaxs);
+		levelWidths.push_back(width);
+		levelLengths.push_back(length);
+	}
+}
+
+bool TerrainRaycaster::hitCell(int x, int z, const float* origin,
+							   const float* dir, float t0, float t1,
+							   float &t) const {
+	//Along the ray, the height of the bilinear patch is a quadratic in the
+	//distance, so the ray's height above it is too
+	float h00 = height(x, z);
+	float b = height(x + 1, z) - h00;
+	float c = height(x, z + 1) - h00;
+	float d = h00 - height(x + 1, z) - height(x, z + 1) + height(x + 1, z + 1);
+	float u0 = origin[0] + dir[0] * t0 - x;
+	float v0 = origin[2] + dir[2] * t0 - z;
+	float y0 = origin[1] + dir[1] * t0;
+	
+	float qa = -d * dir[0] * dir[2];
+	float qb = dir[1] - b * dir[0] - c * dir[2] - d * (u0 * dir[2] + v0 * dir[0]);
+	float qc = y0 - h00 - b * u0 - c * v0 - d * u0 * v0;
+	if (qc <= 0) {
+		t = t0; //Already under the surface
+		return true;
+	}
+	
+	float length = t1 - t0;
+	float s = FAR;
+	if (fabsf(qa) < 1e-12f) {
+		if (qb < 0) {
+			s = -qc / qb;
+		}
+	}
+	else {
+		float discriminant = qb * qb - 4 * qa * qc;
+		if (discriminant < 0) {
+			return false;
+		}
+		float q = -0.5f * (qb + copysignf(sqrtf(discriminant), qb));
+		float r1 = q / qa;
+		float r2 = q != 0 ? qc / q : FAR;
+		if (r1 > r2) {
+			float temp = r1;
+			r1 = r2;
+			r2 = temp;
+		}
+		s = r1 >= 0 ? r1 : r2;
+	}
+	
+	if (s >= 0 && s <= length) {
+		t = t0 + s;
+		return true;
+	}
+	return false;
+}
+
+bool TerrainRaycaster::cast(const float* origin, const float* dir,
+							float maxDist, float &dist) const {
+	int top = (int)mins.size() - 1;
+	float highest = maxs[top][0];
+	
+	//Clip the ray to the box around the terrain; nothing above the highest
+	//point can hit it
+	float tEnter = 0;
+	float tLeave = maxDist;
+	const float bounds[2] = {(float)w, (float)l};
+	for(int axis = 0; axis < 2; axis++) {
+		float o = origin[axis * 2];
+		float d = dir[axis * 2];
+		if (d == 0) {
+			if (o < 0 || o > bounds[axis]) {
+				return false;
+			}
+			continue;
+		}
+		float ta = (0 - o) / d;
+		float tb = (bounds[axis] - o) / d;
+		tEnter = fmaxf(tEnter, fminf(ta, tb));
+		tLeave = fminf(tLeave, fmaxf(ta, tb));
+	}
+	if (dir[1] < 0) {
+		tEnter = fmaxf(tEnter, (highest - origin[1]) / dir[1]);
+	}
+	else if (dir[1] > 0) {
+		tLeave = fminf(tLeave, (highest - origin[1]) / dir[1]);
+	}
+	else if (origin[1] > highest) {
+		return false;
+	}
+	if (tEnter > tLeave) {
+		return false;
+	}
+	
+	//How far to step past a cell boundary to be clear of it
+	float step = 1e-3f / fmaxf(fmaxf(fabsf(dir[0]), fabsf(dir[2])), 1e-6f);
+	
+	//Start with blocks about as big as the stretch of terrain the ray
+	//crosses, so that short rays don't climb down from the top
+	float span = (tLeave - tEnter) * fmaxf(fabsf(dir[0]), fabsf(dir[2]));
+	int level = 0;
+	while (level < top && (1 << level) < span) {
+		level++;
+	}
+	float t = tEnter;
+	while (t <= tLeave) {
+		int size = 1 << level;
+		float x = origin[0] + dir[0] * t;
+		float z = origin[2] + dir[2] * t;
+		int cx = cellIndex(x, size, dir[0], levelWidths[level]);
+		int cz = cellIndex(z, size, dir[2], levelLengths[level]);
+		float tExit = fminf(fminf(exitDist(origin[0], dir[0], cx, size),
+								  exitDist(origin[2], dir[2], cz, size)),
+							tLeave);
+		
+		//Skip the block if the ray stays above it
+		float lowest = origin[1] + dir[1] * (dir[1] < 0 ? tExit : t);
+		if (lowest > maxs[level][cz * levelWidths[level] + cx]) {
+			t = tExit + step;
+			if (level < top) {
+				level++;
+			}
+			continue;
+		}
+		
+		if (level > 0) {
+			level--;
+			continue;
+		}
+		
+		if (hitCell(cx, cz, origin, dir, t, tExit, dist)) {
+			return true;
+		}
+		t = tExit + step;
+	}
+	return false;
+}
+
+bool TerrainRaycaster::cast(const TerrainRay &ray, TerrainHit &hit) const {
+	hit.hit = cast(ray.origin, ray.dir, ray.maxDist, hit.dist);
+	if (!hit.hit) {
+		hit.dist = ray.maxDist;
+	}
+	for(int i = 0; i < 3; i++) {
+		hit.pos[i] = ray.origin[i] + ray.dir[i] * hit.dist;
+	}
+	return hit.hit;
+}
+
+void TerrainRaycaster::castMany(const TerrainRay* rays, TerrainHit* hits,
+								int count, ThreadPool* pool) const {
+	int numJobs = (count + RAYS_PER_JOB - 1) / RAYS_PER_JOB;
+	auto castJob = [this, rays, hits, count](int job) {
+		int end = (job + 1) * RAYS_PER_JOB < count ? (job + 1) * RAYS_PER_JOB : count;
+		for(int i = job * RAYS_PER_JOB; i < end; i++) {
+			cast(rays[i], hits[i]);
+		}
+	};
+	if (pool != NULL) {
+		pool->parallelFor(numJobs, castJob);
+	}
+	else {
+		for(int i = 0; i < numJobs; i++) {
+			castJob(i);
+		}
+	}
+}
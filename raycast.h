@@ -0,0 +1,69 @@
+#ifndef RAYCAST_H_INCLUDED
+#define RAYCAST_H_INCLUDED
+
+#include <vector>
+
+#include "terrain.h"
+#include "threadpool.h"
+
+//A ray to cast at the terrain
+struct TerrainRay {
+	float origin[3];
+	float dir[3];   //Needn't be unit length
+	float maxDist;  //How far along dir, in units of dir's length, to look
+};
+
+//Where a ray hit the terrain
+struct TerrainHit {
+	bool hit;
+	float dist;   //How far along the ray, in the same units as maxDist
+	float pos[3];
+};
+
+/* Finds where rays first hit a terrain.  The terrain's surface is taken to
+ * be the one heightAt describes, i.e. each grid cell is a bilinear patch.
+ *
+ * This keeps a pyramid of the lowest and highest heights in blocks of 1x1,
+ * 2x2, 4x4, ... grid cells.  A ray skips over any block that it passes
+ * above in one step, and only tests the cells of blocks it might hit, so
+ * long rays over open ground are cheap.
+ *
+ * The pyramid is a copy of the heights when the raycaster was made, so it
+ * must be rebuilt if the terrain changes.
+ */
+class TerrainRaycaster {
+	private:
+		int w; //The number of grid cells across, i.e. the terrain's width - 1
+		int l; //The number of grid cells along
+		std::vector<float> heights;
+		std::vector<std::vector<float> > mins; //[level][cell]
+		std::vector<std::vector<float> > maxs;
+		std::vector<int> levelWidths;
+		std::vector<int> levelLengths;
+		
+		float height(int x, int z) const {
+			return heights[z * (w + 1) + x];
+		}
+		
+		//Finds where the ray first meets the patch of the given cell between
+		//distances t0 and t1
+		bool hitCell(int x, int z, const float* origin, const float* dir,
+					 float t0, float t1, float &t) const;
+	public:
+		//Builds the pyramid.  The terrain must be at least 2x2.
+		explicit TerrainRaycaster(Terrain* terrain);
+		
+		/* Casts one ray.  Returns whether it hits the terrain within maxDist
+		 * of its origin, and if so sets dist to the distance of the first
+		 * hit.  A ray that starts below the surface hits it at distance 0.
+		 */
+		bool cast(const float* origin, const float* dir, float maxDist,
+				  float &dist) const;
+		bool cast(const TerrainRay &ray, TerrainHit &hit) const;
+		//Casts count rays, splitting them between the pool's threads if pool
+		//isn't NULL
+		void castMany(const TerrainRay* rays, TerrainHit* hits, int count,
+					  ThreadPool* pool = NULL) const;
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include <chrono>
+
+#include "glstate.h"
+#include "renderqueue.h"
+
+using namespace std;
+
+namespace {
+	void setMaterialGL(const Material &material) {
+		glsSetEnabled(GL_LIGHTING, material.lighting);
+		glsSetEnabled(GL_TEXTURE_2D, material.texture != 0);
+		if (material.texture != 0) {
+			glsBindTexture(material.texture);
+		}
+		glColor3f(material.color[0], material.color[1], material.color[2]);
+	}
+	
+	void drawTrianglesGL(const TriangleBatch &batch) {
+		GLsizei stride = batch.stride * sizeof(float);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(3, GL_FLOAT, stride, batch.vertices);
+		if (batch.normalOffset >= 0) {
+			glEnableClientState(GL_NORMAL_ARRAY);
+			glNormalPointer(GL_FLOAT, stride,
+							batch.vertices + batch.normalOffset);
+		}
+		if (batch.colorOffset >= 0) {
+			glEnableClientState(GL_COLOR_ARRAY);
+			glColorPointer(3, GL_FLOAT, stride,
+						   batch.vertices + batch.colorOffset);
+		}
+		if (batch.texCoordOffset >= 0) {
+			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+			glTexCoordPointer(2, GL_FLOAT, stride,
+							  batch.vertices + batch.texCoordOffset);
+		}
+		
+		if (batch.indices != NULL) {
+			glDrawElements(GL_TRIANGLES, batch.numIndices, GL_UNSIGNED_INT,
+						   batch.indices);
+		}
+		else {
+			glDrawArrays(GL_TRIANGLES, 0, batch.numVertices);
+		}
+		
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glDisableClientState(GL_COLOR_ARRAY);
+		glDisableClientState(GL_NORMAL_ARRAY);
+		glDisableClientState(GL_VERTEX_ARRAY);
+	}
+	
+	const RenderBackend OPENGL_BACKEND = {
+		glLoadMatrixf,
+		setMaterialGL,
+		drawTrianglesGL
+	};
+	
+	const int RADIX_BITS = 8;
+	const int RADIX_SIZE = 1 << RADIX_BITS;
+	const int NUM_PASSES = 64 / RADIX_BITS;
+}
+
+const RenderBackend* openGLBackend() {
+	return &OPENGL_BACKEND;
+}
+
+RenderQueue::RenderQueue() : numStateChanges(0), timing(false) {
+	
+}
+
+RenderQueue::~RenderQueue() {
+	for(size_t i = 0; i < lists.size(); i++) {
+		delete lists[i];
+	}
+}
+
+int RenderQueue::addMesh(MeshDrawFunc draw, void* data) {
+	meshFuncs.push_back(draw);
+	meshData.push_back(data);
+	return (int)meshFuncs.size() - 1;
+}
+
+int RenderQueue::addMaterial(const Material &material) {
+	materials.push_back(material);
+	return (int)materials.size() - 1;
+}
+
+CommandList* RenderQueue::addList() {
+	lists.push_back(new CommandList());
+	return lists.back();
+}
+
+uint64_t RenderQueue::makeKey(int layer, int material, int mesh, float depth,
+							  bool backToFront) {
+	if (depth < 0) {
+		depth = 0;
+	}
+	else if (depth > 1) {
+		depth = 1;
+	}
+	uint64_t maxDepth = (1 << DEPTH_BITS) - 1;
+	uint64_t depthBits = (uint64_t)(depth * maxDepth);
+	uint64_t key = (uint64_t)layer << (MATERIAL_BITS + MESH_BITS + DEPTH_BITS);
+	if (backToFront) {
+		//Depth takes the place of the material and mesh
+		return key | (maxDepth - depthBits) << (MATERIAL_BITS + MESH_BITS) |
+			(uint64_t)material << MESH_BITS | (uint64_t)mesh;
+	}
+	return key | (uint64_t)material << (MESH_BITS + DEPTH_BITS) |
+		(uint64_t)mesh << DEPTH_BITS | depthBits;
+}
+
+void RenderQueue::gather() {
+	commands.clear();
+	transforms.clear();
+	for(size_t i = 0; i < lists.size(); i++) {
+		CommandList* list = lists[i];
+		uint32_t offset = (uint32_t)transforms.size();
+		transforms.insert(transforms.end(),
+						  list->transforms.begin(),
+						  list->transforms.end());
+		for(size_t j = 0; j < list->commands.size(); j++) {
+			DrawCommand command = list->commands[j];
+			command.transform += offset;
+			commands.push_back(command);
+		}
+		list->clear();
+	}
+}
+
+void RenderQueue::sort() {
+	//Count every digit of every key in one pass, and skip the passes where
+	//every key has the same digit, which most do, since keys share most of
+	//their high bits
+	int counts[NUM_PASSES][RADIX_SIZE];
+	for(int pass = 0; pass < NUM_PASSES; pass++) {
+		for(int i = 0; i < RADIX_SIZE; i++) {
+			counts[pass][i] = 0;
+		}
+	}
+	int count = (int)commands.size();
+	for(int i = 0; i < count; i++) {
+		uint64_t key = commands[i].key;
+		for(int pass = 0; pass < NUM_PASSES; pass++) {
+			counts[pass][(key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+		}
+	}
+	
+	sortBuffer.resize(count);
+	for(int pass = 0; pass < NUM_PASSES; pass++) {
+		int* passCounts = counts[pass];
+		int shift = pass * RADIX_BITS;
+		if (count == 0 ||
+			passCounts[(commands[0].key >> shift) & (RADIX_SIZE - 1)] == count) {
+			continue;
+		}
+		
+		int offsets[RADIX_SIZE];
+		int total = 0;
+		for(int i = 0; i < RADIX_SIZE; i++) {
+			offsets[i] = total;
+			total += passCounts[i];
+		}
+		for(int i = 0; i < count; i++) {
+			int digit = (int)((commands[i].key >> shift) & (RADIX_SIZE - 1));
+			sortBuffer[offsets[digit]++] = commands[i];
+		}
+		commands.swap(sortBuffer);
+	}
+}
+
+void RenderQueue::submit(const Mat4f &view, const RenderBackend* backend) {
+	if (backend == NULL) {
+		backend = &OPENGL_BACKEND;
+	}
+	gather();
+	sort();
+	
+	numStateChanges = 0;
+	meshTimes.assign(timing ? meshFuncs.size() : 0, 0.0);
+	int material = -1;
+	for(size_t i = 0; i < commands.size(); i++) {
+		const DrawCommand &command = commands[i];
+		chrono::steady_clock::time_point start;
+		if (timing) {
+			start = chrono::steady_clock::now();
+		}
+		if (command.material != material) {
+			material = command.material;
+			backend->material(materials[material]);
+			numStateChanges++;
+		}
+		
+		Mat4f modelview = view * transforms[command.transform];
+		backend->loadMatrix(modelview.data());
+		meshFuncs[command.mesh](meshData[command.mesh], backend);
+		if (timing) {
+			meshTimes[command.mesh] += chrono::duration<double>(
+				chrono::steady_clock::now() - start).count();
+		}
+	}
+	backend->loadMatrix(view.data());
+}
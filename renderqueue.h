@@ -0,0 +1,194 @@
+#ifndef RENDER_QUEUE_H_INCLUDED
+#define RENDER_QUEUE_H_INCLUDED
+
+#include <stdint.h>
+#include <vector>
+
+#ifdef __APPLE__
+#include <OpenGL/OpenGL.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/glut.h>
+#endif
+
+#include "mat4f.h"
+
+struct RenderBackend;
+
+//Draws a mesh through the backend, with its current matrix and material
+typedef void (*MeshDrawFunc)(void* data, const RenderBackend* backend);
+
+//The state a draw needs set up before it
+struct Material {
+	GLuint texture;  //The texture to bind, or 0 to draw untextured
+	bool lighting;
+	float color[3];  //The current colour, which GL_COLOR_MATERIAL lights
+};
+
+//One draw: a mesh, with a material, at a transform.  The key decides the
+//order draws are made in.
+struct DrawCommand {
+	uint64_t key;
+	uint32_t transform; //Index into the transforms of the command's list
+	uint16_t mesh;
+	uint16_t material;
+};
+
+/* The draws one subsystem, such as the riders or the terrain, adds in a
+ * frame.  Each list is filled by one thread, so that subsystems can make
+ * their commands in parallel.  Clearing a list keeps its memory, so after
+ * the first few frames adding commands doesn't allocate.
+ */
+class CommandList {
+	private:
+		std::vector<DrawCommand> commands;
+		std::vector<Mat4f> transforms;
+		
+		friend class RenderQueue;
+	public:
+		void clear() {
+			commands.clear();
+			transforms.clear();
+		}
+		
+		int size() const {
+			return (int)commands.size();
+		}
+		
+		//Adds a transform for the commands to use, and returns its index
+		int addTransform(const Mat4f &transform) {
+			transforms.push_back(transform);
+			return (int)transforms.size() - 1;
+		}
+		
+		void add(uint64_t key, int mesh, int material, int transform) {
+			DrawCommand command = {key, (uint32_t)transform, (uint16_t)mesh,
+								   (uint16_t)material};
+			commands.push_back(command);
+		}
+};
+
+/* Triangles for a backend to draw, as interleaved vertices that are each
+ * stride floats long.  Each vertex starts with its position, and has a
+ * normal, a colour and texture coordinates at the given offsets, or -1 where
+ * the vertices don't have one.  Vertices without a colour take the material's
+ * colour.  If indices isn't NULL, each three indices make a triangle;
+ * otherwise each three vertices do.
+ */
+struct TriangleBatch {
+	const float* vertices;
+	int numVertices;
+	int stride;
+	int normalOffset;
+	int colorOffset;
+	int texCoordOffset;
+	const unsigned int* indices;
+	int numIndices;
+};
+
+/* What draws go to: OpenGL, or something that stands in for it, such as a
+ * software rasterizer or a mock in a test.  Meshes draw through a backend
+ * rather than calling OpenGL themselves, so the same scene can be drawn by
+ * any of them.
+ */
+struct RenderBackend {
+	//Sets the modelview matrix, stored by columns
+	void (*loadMatrix)(const GLfloat* m);
+	void (*material)(const Material &material);
+	void (*drawTriangles)(const TriangleBatch &batch);
+};
+
+//Returns the backend that draws with OpenGL, through the GL state cache
+const RenderBackend* openGLBackend();
+
+/* Collects a frame's draws from any number of command lists, sorts them by
+ * key and makes them.  Keys made by makeKey put the draws with the same
+ * material, then the same mesh, together, and draw those front to back, so
+ * that texture and state changes are as few as they can be and the depth
+ * test rejects as much as it can.
+ *
+ * Meshes and materials are registered once, and commands refer to them by
+ * index.  The sort is a radix sort, which takes time proportional to the
+ * number of commands.
+ */
+class RenderQueue {
+	private:
+		std::vector<CommandList*> lists;
+		std::vector<MeshDrawFunc> meshFuncs;
+		std::vector<void*> meshData;
+		std::vector<Material> materials;
+		//The frame's commands and transforms, gathered from the lists
+		std::vector<DrawCommand> commands;
+		std::vector<DrawCommand> sortBuffer;
+		std::vector<Mat4f> transforms;
+		int numStateChanges; //Material changes in the last submit
+		bool timing;
+		std::vector<double> meshTimes; //Each mesh's share of the last submit
+		
+		void gather();
+		void sort();
+	public:
+		//The bits of a key, from the most significant down
+		static const int LAYER_BITS = 4;
+		static const int MATERIAL_BITS = 16;
+		static const int MESH_BITS = 16;
+		static const int DEPTH_BITS = 28;
+		
+		RenderQueue();
+		~RenderQueue();
+		
+		//Registers a mesh and returns its index
+		int addMesh(MeshDrawFunc draw, void* data = NULL);
+		//Registers a material and returns its index
+		int addMaterial(const Material &material);
+		//Changes a registered material, for the draws of the next submit
+		void setMaterial(int index, const Material &material) {
+			materials[index] = material;
+		}
+		
+		//Makes a command list whose commands are included in each submit.
+		//The queue owns the list.
+		CommandList* addList();
+		
+		/* Returns a key that sorts by layer, then material, then mesh, then
+		 * depth from near to far.  depth is a fraction of the far distance,
+		 * from 0 to 1.  With backToFront, draws in the layer are sorted by
+		 * depth first, from far to near, as transparent draws need.
+		 */
+		static uint64_t makeKey(int layer, int material, int mesh, float depth,
+								bool backToFront = false);
+		
+		/* Sorts the commands in every list and makes them, with the given
+		 * view matrix, then clears the lists.  Draws through backend, or
+		 * through OpenGL if it's NULL.
+		 */
+		void submit(const Mat4f &view, const RenderBackend* backend = NULL);
+		
+		//Returns the commands from the last submit, in the order they were
+		//made
+		const std::vector<DrawCommand> &lastCommands() const {
+			return commands;
+		}
+		
+		//Returns how many times the last submit changed material
+		int lastStateChanges() const {
+			return numStateChanges;
+		}
+		
+		//Sets whether submit times the commands for each mesh, which costs
+		//two clock reads per command
+		void setTiming(bool timing2) {
+			timing = timing2;
+		}
+		
+		/* Returns the CPU time, in seconds, that the last submit spent on the
+		 * mesh's commands: changing material for them, loading their matrices
+		 * and drawing them.  Only measured while timing is on.  With OpenGL,
+		 * this is the cost of submitting the calls, not of drawing them.
+		 */
+		double meshTime(int mesh) const {
+			return mesh < (int)meshTimes.size() ? meshTimes[mesh] : 0;
+		}
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include <math.h>
+#include <string.h>
+
+#include "riders.h"
+
+using namespace std;
+
+RiderSystem::RiderSystem(Terrain* terrain2, const BikeParams &params2) :
+	terrain(terrain2), params(params2), collectibles(NULL), numCollectibles(0),
+	water(NULL) {
+}
+
+int RiderSystem::add(float x2, float z2, float yaw2) {
+	BikeState bike;
+	placeBike(terrain, params, x2, z2, yaw2, bike);
+	x.push_back(bike.x);
+	y.push_back(bike.y);
+	z.push_back(bike.z);
+	vx.push_back(bike.vx);
+	vy.push_back(bike.vy);
+	vz.push_back(bike.vz);
+	yaw.push_back(bike.yaw);
+	pitch.push_back(bike.pitch);
+	pitchVel.push_back(bike.pitchVel);
+	roll.push_back(bike.roll);
+	compression[0].push_back(bike.compression[0]);
+	compression[1].push_back(bike.compression[1]);
+	airTime.push_back(bike.airTime);
+	throttle.push_back(0);
+	steer.push_back(0);
+	lean.push_back(0);
+	touched.push_back(-1);
+	numCollected.push_back(0);
+	return size() - 1;
+}
+
+void RiderSystem::setInput(int rider, const BikeInput &input) {
+	throttle[rider] = input.throttle;
+	steer[rider] = input.steer;
+	lean[rider] = input.lean;
+}
+
+void RiderSystem::followField(const FlowField &field, int begin, int end) {
+	const float PI = 3.1415926535f;
+	for(int i = begin; i < end; i++) {
+		float dx;
+		float dz;
+		if (!field.direction(x[i], z[i], dx, dz)) {
+			throttle[i] = 0; //Nowhere to go
+			steer[i] = 0;
+			lean[i] = 0;
+			continue;
+		}
+		
+		//Turn toward the direction of the field, and slow down for sharp
+		//turns and near the goal, where the turns get tight
+		float turn = atan2f(-dz, dx) - yaw[i];
+		turn = turn - 2 * PI * floorf((turn + PI) / (2 * PI));
+		float amount = turn * 2;
+		amount = amount < -1 ? -1 : (amount > 1 ? 1 : amount);
+		if (fabsf(turn) > PI / 4) {
+			throttle[i] = 0.2f;
+		}
+		else if (field.distance(x[i], z[i]) < 10) {
+			throttle[i] = 0.5f;
+		}
+		else {
+			throttle[i] = 1.0f;
+		}
+		steer[i] = amount;
+		lean[i] = -0.5f * amount;
+	}
+}
+
+BikeState RiderSystem::state(int rider) const {
+	BikeState bike;
+	bike.x = x[rider];
+	bike.y = y[rider];
+	bike.z = z[rider];
+	bike.vx = vx[rider];
+	bike.vy = vy[rider];
+	bike.vz = vz[rider];
+	bike.yaw = yaw[rider];
+	bike.pitch = pitch[rider];
+	bike.pitchVel = pitchVel[rider];
+	bike.roll = roll[rider];
+	bike.compression[0] = compression[0][rider];
+	bike.compression[1] = compression[1][rider];
+	bike.airTime = airTime[rider];
+	return bike;
+}
+
+namespace {
+	//The number of float arrays saved by RiderSystem::saveState
+	const int NUM_SAVED_ARRAYS = 13;
+}
+
+int RiderSystem::stateSize() const {
+	return NUM_SAVED_ARRAYS * size() * (int)sizeof(float);
+}
+
+void RiderSystem::saveState(unsigned char* dest) const {
+	const vector<float>* arrays[NUM_SAVED_ARRAYS] = {
+		&x, &y, &z, &vx, &vy, &vz, &yaw, &pitch, &pitchVel, &roll,
+		&compression[0], &compression[1], &airTime
+	};
+	int bytes = size() * (int)sizeof(float);
+	for(int i = 0; i < NUM_SAVED_ARRAYS && bytes > 0; i++) {
+		memcpy(dest + i * bytes, &(*arrays[i])[0], bytes);
+	}
+}
+
+void RiderSystem::restoreState(const unsigned char* src) {
+	vector<float>* arrays[NUM_SAVED_ARRAYS] = {
+		&x, &y, &z, &vx, &vy, &vz, &yaw, &pitch, &pitchVel, &roll,
+		&compression[0], &compression[1], &airTime
+	};
+	int bytes = size() * (int)sizeof(float);
+	for(int i = 0; i < NUM_SAVED_ARRAYS && bytes > 0; i++) {
+		memcpy(&(*arrays[i])[0], src + i * bytes, bytes);
+	}
+}
+
+void RiderSystem::setCollectibles(Collectible* objects, int count) {
+	collectibles = objects;
+	numCollectibles = count;
+}
+
+BikeArrays RiderSystem::arrays() {
+	BikeArrays bikes = {
+		&x[0], &y[0], &z[0],
+		&vx[0], &vy[0], &vz[0],
+		&yaw[0], &pitch[0], &pitchVel[0], &roll[0],
+		{&compression[0][0], &compression[1][0]},
+		&airTime[0],
+		&throttle[0], &steer[0], &lean[0]
+	};
+	return bikes;
+}
+
+void RiderSystem::stepChunk(int chunk, float dt) {
+	int begin = chunk * RIDER_CHUNK;
+	int end = begin + RIDER_CHUNK < size() ? begin + RIDER_CHUNK : size();
+	stepBikes(terrain, params, arrays(), begin, end, dt, water);
+	
+	//Only note which collectible each rider touches here; collecting them
+	//would race with the other chunks
+	for(int i = begin; i < end; i++) {
+		touched[i] = -1;
+		for(int j = 0; j < numCollectibles; j++) {
+			const Collectible &object = collectibles[j];
+			if (object.state == 1 &&
+				object.pos[0] - 1.0f < x[i] && x[i] < object.pos[0] + 1.0f &&
+				object.pos[2] - 1.0f < z[i] && z[i] < object.pos[2] + 1.0f) {
+				touched[i] = j;
+				break;
+			}
+		}
+	}
+}
+
+void RiderSystem::step(float dt, ThreadPool* pool) {
+	if (size() == 0) {
+		return;
+	}
+	
+	int numChunks = (size() + RIDER_CHUNK - 1) / RIDER_CHUNK;
+	if (pool != NULL) {
+		pool->parallelFor(numChunks, [this, dt](int chunk) {
+			stepChunk(chunk, dt);
+		});
+	}
+	else {
+		for(int i = 0; i < numChunks; i++) {
+			stepChunk(i, dt);
+		}
+	}
+	
+	for(int i = 0; i < size(); i++) {
+		numCollected[i] = 0;
+		if (touched[i] >= 0 && collectibles[touched[i]].state == 1) {
+			collectibles[touched[i]].state = 0;
+			numCollected[i] = 1;
+		}
+	}
+}
@@ -0,0 +1,95 @@
+#ifndef RIDERS_H_INCLUDED
+#define RIDERS_H_INCLUDED
+
+#include <vector>
+
+#include "flowfield.h"
+#include "physics.h"
+#include "terrain.h"
+#include "threadpool.h"
+#include "water.h"
+
+//An object on the course that a rider can collect by driving through it
+struct Collectible {
+	float pos[3];
+	int state; //1 if it's waiting to be collected, 0 if it's gone
+};
+
+//The number of riders stepped together as one job when stepping in parallel
+const int RIDER_CHUNK = 512;
+
+/* Simulates any number of riders on one terrain.  Each field of the riders'
+ * state is kept in its own array, so that a step works through memory in
+ * order and can do the arithmetic for several riders at once (see
+ * stepBikes).
+ */
+class RiderSystem {
+	private:
+		Terrain* terrain;
+		BikeParams params;
+		std::vector<float> x, y, z;
+		std::vector<float> vx, vy, vz;
+		std::vector<float> yaw, pitch, pitchVel, roll;
+		std::vector<float> compression[2];
+		std::vector<float> airTime;
+		std::vector<float> throttle, steer, lean;
+		std::vector<int> touched; //The collectible each rider is touching
+		std::vector<int> numCollected; //How many each collected last step
+		Collectible* collectibles;
+		int numCollectibles;
+		const WaterMap* water;
+		
+		BikeArrays arrays();
+		//Steps and checks the riders in one chunk, without changing anything
+		//outside of the chunk
+		void stepChunk(int chunk, float dt);
+	public:
+		RiderSystem(Terrain* terrain, const BikeParams &params);
+		
+		int size() const {
+			return (int)x.size();
+		}
+		
+		//Adds a rider at rest on the terrain and returns its index
+		int add(float x, float z, float yaw);
+		//Sets the controls used by the rider from the next step on
+		void setInput(int rider, const BikeInput &input);
+		//Sets the controls of riders [begin, end) to follow the flow field
+		//toward its nearest goal.  Takes constant time per rider.
+		void followField(const FlowField &field, int begin, int end);
+		//Returns a copy of the rider's state
+		BikeState state(int rider) const;
+		
+		//Sets the collectibles the riders can collect.  The array isn't
+		//copied, and collected objects have their state set to 0.
+		void setCollectibles(Collectible* objects, int count);
+		//Returns how many collectibles the rider collected in the last step
+		int collected(int rider) const {
+			return numCollected[rider];
+		}
+		
+		//Sets the water the riders ride through, or NULL for none.  The water
+		//isn't copied.
+		void setWater(const WaterMap* water2) {
+			water = water2;
+		}
+		
+		//Returns the size in bytes of the riders' state, as saved by saveState
+		int stateSize() const;
+		//Copies the position and motion of every rider to dest, which must
+		//have room for stateSize() bytes
+		void saveState(unsigned char* dest) const;
+		//Sets every rider back to a state saved by saveState.  The number of
+		//riders must not have changed since.
+		void restoreState(const unsigned char* src);
+		
+		/* Advances every rider by dt seconds, which should normally be
+		 * PHYSICS_STEP.  If pool isn't NULL, the riders are stepped in
+		 * chunks of RIDER_CHUNK spread across the pool.  When several riders
+		 * reach the same collectible in one step, the one with the lowest
+		 * index gets it, so the result doesn't depend on the pool.
+		 */
+		void step(float dt, ThreadPool* pool = NULL);
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "scenegraph.h"
+
+using namespace std;
+
+SceneGraph::SceneGraph() : numUpdates(0) {
+	
+}
+
+int SceneGraph::add(int parent, const Mat4f &local) {
+	locals.push_back(local);
+	worlds.push_back(local);
+	parents.push_back(parent);
+	dirty.push_back(1);
+	updatedIn.push_back(-1);
+	return (int)parents.size() - 1;
+}
+
+void SceneGraph::clear() {
+	locals.clear();
+	worlds.clear();
+	parents.clear();
+	dirty.clear();
+	updatedIn.clear();
+}
+
+int SceneGraph::update() {
+	numUpdates++;
+	int numChanged = 0;
+	int count = (int)parents.size();
+	for(int i = 0; i < count; i++) {
+		int parent = parents[i];
+		bool parentChanged = parent >= 0 && updatedIn[parent] == numUpdates;
+		if (!dirty[i] && !parentChanged) {
+			continue;
+		}
+		
+		if (parent >= 0) {
+			worlds[i] = worlds[parent] * locals[i];
+		}
+		else {
+			worlds[i] = locals[i];
+		}
+		dirty[i] = 0;
+		updatedIn[i] = numUpdates;
+		numChanged++;
+	}
+	return numChanged;
+}
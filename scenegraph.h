@@ -0,0 +1,63 @@
+#ifndef SCENEGRAPH_H_INCLUDED
+#define SCENEGRAPH_H_INCLUDED
+
+#include <vector>
+
+#include "mat4f.h"
+
+/* A hierarchy of transforms.  Each node has a local matrix, which places it
+ * relative to its parent, and a world matrix, which is its parent's world
+ * matrix times its local matrix.  Nodes without a parent are placed in
+ * world space.
+ *
+ * A node's parent is always added before it, so one pass over the nodes in
+ * the order they were added brings every world matrix up to date.  The pass
+ * only recomputes the nodes whose local matrix, or one of whose ancestors'
+ * local matrices, changed since the last pass.
+ */
+class SceneGraph {
+	private:
+		//The nodes' fields are kept in separate arrays, so that finding the
+		//few nodes to update in a big scene doesn't read all the matrices
+		std::vector<Mat4f> locals;
+		std::vector<Mat4f> worlds;
+		std::vector<int> parents;     //-1 for a node without a parent
+		std::vector<char> dirty;      //Whether local changed since the last update
+		std::vector<int> updatedIn;   //The update in which world was last recomputed
+		int numUpdates;
+	public:
+		SceneGraph();
+		
+		//Adds a node and returns its index.  parent must be -1 or an
+		//existing node.
+		int add(int parent = -1, const Mat4f &local = Mat4f::identity());
+		void clear();
+		
+		int size() const {
+			return (int)parents.size();
+		}
+		
+		int parent(int node) const {
+			return parents[node];
+		}
+		
+		void setLocal(int node, const Mat4f &local) {
+			locals[node] = local;
+			dirty[node] = 1;
+		}
+		
+		const Mat4f &getLocal(int node) const {
+			return locals[node];
+		}
+		
+		//Returns the node's world matrix as of the last update
+		const Mat4f &world(int node) const {
+			return worlds[node];
+		}
+		
+		//Recomputes the world matrices that are out of date, and returns how
+		//many there were
+		int update();
+};
+
+#endif
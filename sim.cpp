@@ -0,0 +1,194 @@
+#include <string.h>
+
+#include "sim.h"
+#include "simhistory.h"
+
+using namespace std;
+
+namespace {
+	const int TICKS_PER_SECOND = 120; //1 / PHYSICS_STEP
+	const int FIRST_SPAWN = 5 * TICKS_PER_SECOND;
+	const int SPAWN_INTERVAL = 10 * TICKS_PER_SECOND;
+	const int FIRST_SECOND = 2 * TICKS_PER_SECOND; //When the clock starts
+	//Tell goal changes that add goals from ones that remove them
+	const unsigned int SPAWN_CHANGE = 1;
+	const unsigned int PICKUP_CHANGE = 2;
+	
+	//Adds bytes to a 32-bit FNV-1a hash
+	unsigned int hashBytes(unsigned int hash, const void* data, size_t size) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for(size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 16777619u;
+		}
+		return hash;
+	}
+	
+	//Returns the change that adds or removes the given goals from the field
+	//with the given version
+	GoalChange goalChange(unsigned int version, bool adds,
+						  const float goals[][2], int numGoals) {
+		GoalChange change;
+		change.version = version;
+		change.adds = adds;
+		change.numGoals = numGoals;
+		memcpy(change.goals, goals, numGoals * sizeof(goals[0]));
+		unsigned int kind = adds ? SPAWN_CHANGE : PICKUP_CHANGE;
+		change.hash = hashBytes(2166136261u, &version, sizeof(version));
+		change.hash = hashBytes(change.hash, &kind, sizeof(kind));
+		change.hash = hashBytes(change.hash, goals, numGoals * sizeof(goals[0]));
+		return change;
+	}
+}
+
+Sim::Sim(Terrain* terrain2, int numPlayers2, int numAIRiders, unsigned int seed,
+		 const WaterMap* water) :
+	terrain(terrain2),
+	riders(terrain2, defaultBikeParams()),
+	flow(terrain2),
+	scores(numPlayers2, 0),
+	numPlayers(numPlayers2),
+	currentTick(0),
+	timeLeft(20),
+	random(seed),
+	history(NULL),
+	flowChange() {
+	memset(collectibles, 0, sizeof(collectibles));
+	riders.setCollectibles(collectibles, NUM_COLLECTIBLES);
+	riders.setWater(water);
+	
+	const float PI = 3.1415926535f;
+	for(int i = 0; i < numPlayers; i++) {
+		riders.add(50.0f, 50.0f + 5.0f * i, 0.0f);
+	}
+	for(int i = 0; i < numAIRiders; i++) {
+		riders.add(40.0f + 10.0f * i, 40.0f, PI / 2);
+	}
+}
+
+void Sim::spawnCollectibles() {
+	float goals[NUM_COLLECTIBLES][2];
+	for(int i = 0; i < NUM_COLLECTIBLES; i++) {
+		Collectible &object = collectibles[i];
+		object.pos[0] = 10.0f + random.nextFloat() * 180.0f;
+		object.pos[2] = 10.0f + random.nextFloat() * 180.0f;
+		object.pos[1] = heightAt(terrain, object.pos[0], object.pos[2]) + 2.0f;
+		object.state = 1;
+		goals[i][0] = object.pos[0];
+		goals[i][1] = object.pos[2];
+	}
+	
+	GoalChange change = goalChange(flow.getVersion(), true, goals,
+								   NUM_COLLECTIBLES);
+	if (!reuseFlow(change)) {
+		flow.clearGoals();
+		flow.addGoals(goals, NUM_COLLECTIBLES);
+		flowChange = change;
+	}
+}
+
+bool Sim::reuseFlow(const GoalChange &change) {
+	return history != NULL && history->findFlow(change, *this);
+}
+
+void Sim::step(const BikeInput* inputs) {
+	if (currentTick >= FIRST_SPAWN &&
+		(currentTick - FIRST_SPAWN) % SPAWN_INTERVAL == 0) {
+		spawnCollectibles();
+	}
+	if (currentTick >= FIRST_SECOND &&
+		(currentTick - FIRST_SECOND) % TICKS_PER_SECOND == 0) {
+		timeLeft--;
+	}
+	
+	for(int i = 0; i < numPlayers; i++) {
+		riders.setInput(i, inputs[i]);
+	}
+	riders.followField(flow, numPlayers, riders.size());
+	riders.step(PHYSICS_STEP);
+	
+	for(int i = 0; i < numPlayers; i++) {
+		scores[i] += 10 * riders.collected(i);
+		timeLeft += 5 * riders.collected(i);
+	}
+	
+	//Collected objects stop being goals for the AI riders
+	float removed[NUM_COLLECTIBLES][2];
+	int numRemoved = 0;
+	for(int i = 0; i < NUM_COLLECTIBLES; i++) {
+		const Collectible &object = collectibles[i];
+		if (object.state == 0 && flow.isGoal(object.pos[0], object.pos[2])) {
+			removed[numRemoved][0] = object.pos[0];
+			removed[numRemoved][1] = object.pos[2];
+			numRemoved++;
+		}
+	}
+	if (numRemoved > 0) {
+		GoalChange change = goalChange(flow.getVersion(), false, removed,
+									   numRemoved);
+		if (!reuseFlow(change)) {
+			for(int i = 0; i < numRemoved; i++) {
+				flow.removeGoal(removed[i][0], removed[i][1]);
+			}
+			flowChange = change;
+		}
+	}
+	
+	currentTick++;
+}
+
+unsigned int Sim::checksum() const {
+	unsigned int hash = 2166136261u;
+	for(int i = 0; i < riders.size(); i++) {
+		BikeState bike = riders.state(i);
+		hash = hashBytes(hash, &bike, sizeof(bike));
+	}
+	hash = hashBytes(hash, collectibles, sizeof(collectibles));
+	hash = hashBytes(hash, &scores[0], scores.size() * sizeof(int));
+	hash = hashBytes(hash, &currentTick, sizeof(currentTick));
+	hash = hashBytes(hash, &timeLeft, sizeof(timeLeft));
+	unsigned int randomState = random.getState();
+	return hashBytes(hash, &randomState, sizeof(randomState));
+}
+
+namespace {
+	//Copies size bytes to dest and returns the end of the copy
+	unsigned char* save(unsigned char* dest, const void* src, size_t size) {
+		memcpy(dest, src, size);
+		return dest + size;
+	}
+	
+	//Copies size bytes from src and returns the end of the bytes copied
+	const unsigned char* restore(void* dest, const unsigned char* src, size_t size) {
+		memcpy(dest, src, size);
+		return src + size;
+	}
+}
+
+int Sim::stateSize() const {
+	return riders.stateSize() +
+		(int)(sizeof(collectibles) + numPlayers * sizeof(int) +
+			  sizeof(currentTick) + sizeof(timeLeft) + sizeof(unsigned int));
+}
+
+void Sim::saveState(unsigned char* dest) const {
+	riders.saveState(dest);
+	dest += riders.stateSize();
+	dest = save(dest, collectibles, sizeof(collectibles));
+	dest = save(dest, &scores[0], numPlayers * sizeof(int));
+	dest = save(dest, &currentTick, sizeof(currentTick));
+	dest = save(dest, &timeLeft, sizeof(timeLeft));
+	unsigned int randomState = random.getState();
+	save(dest, &randomState, sizeof(randomState));
+}
+
+void Sim::restoreState(const unsigned char* src) {
+	riders.restoreState(src);
+	src += riders.stateSize();
+	src = restore(collectibles, src, sizeof(collectibles));
+	src = restore(&scores[0], src, numPlayers * sizeof(int));
+	src = restore(&currentTick, src, sizeof(currentTick));
+	src = restore(&timeLeft, src, sizeof(timeLeft));
+	unsigned int randomState;
+	restore(&randomState, src, sizeof(randomState));
+	random.setState(randomState);
+}
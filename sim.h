@@ -0,0 +1,159 @@
+#ifndef SIM_H_INCLUDED
+#define SIM_H_INCLUDED
+
+#include <string.h>
+#include <vector>
+
+#include "flowfield.h"
+#include "physics.h"
+#include "riders.h"
+#include "terrain.h"
+
+class SimHistory;
+
+//The number of collectibles on the course at once
+const int NUM_COLLECTIBLES = 10;
+
+//A small random number generator whose sequence is the same on every machine
+class SimRandom {
+	private:
+		unsigned int state;
+	public:
+		explicit SimRandom(unsigned int seed) : state(seed != 0 ? seed : 1) {
+		}
+		
+		//Returns the next number of the sequence (xorshift32)
+		unsigned int next() {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+		
+		//Returns a random float from 0 to < 1
+		float nextFloat() {
+			return (next() >> 8) / 16777216.0f;
+		}
+		
+		unsigned int getState() const {
+			return state;
+		}
+		
+		void setState(unsigned int state2) {
+			state = state2;
+		}
+};
+
+/* A change to the flow field's goals: the field it changes, whether goals
+ * were added or removed, and which.  The same change to the same field always
+ * makes the same field.  hash is a hash of the rest, for telling most
+ * different changes apart quickly.
+ */
+struct GoalChange {
+	unsigned int hash;
+	unsigned int version; //The field's version before the change
+	bool adds;            //Whether the goals were added rather than removed
+	int numGoals;
+	float goals[NUM_COLLECTIBLES][2];
+	
+	bool matches(const GoalChange &other) const {
+		return hash == other.hash && version == other.version &&
+			adds == other.adds && numGoals == other.numGoals &&
+			memcmp(goals, other.goals, numGoals * sizeof(goals[0])) == 0;
+	}
+};
+
+/* The whole state of a game, advanced one PHYSICS_STEP at a time.  The game's
+ * timers count ticks and its random numbers come from a seeded SimRandom, so
+ * two Sims made with the same arguments and given the same inputs stay
+ * bit-for-bit identical, which is what lets several machines run the same
+ * game by exchanging only their inputs.
+ *
+ * Riders 0 to numPlayers - 1 are steered by the inputs passed to step(), and
+ * the rest by the flow field.  The riders ride through water, which isn't
+ * copied, if it isn't NULL.
+ */
+class Sim {
+	private:
+		Terrain* terrain;
+		RiderSystem riders;
+		FlowField flow;
+		Collectible collectibles[NUM_COLLECTIBLES];
+		std::vector<int> scores;
+		int numPlayers;
+		int currentTick;
+		int timeLeft; //In seconds
+		SimRandom random;
+		const SimHistory* history;
+		GoalChange flowChange; //The goal change that made the flow field
+		
+		void spawnCollectibles();
+		//Takes the flow field that follows the goal change from history, if
+		//it holds one, and returns whether it did
+		bool reuseFlow(const GoalChange &change);
+		
+		friend class SimHistory; //Saves and restores the flow field
+	public:
+		Sim(Terrain* terrain, int numPlayers, int numAIRiders, unsigned int seed,
+			const WaterMap* water = NULL);
+		Sim(const Sim &other) = delete;
+		Sim &operator=(const Sim &other) = delete;
+		
+		/* Sets the history whose flow fields to reuse, or NULL for none.
+		 * When a step changes the goals in the same way as a step that
+		 * history saved the result of, such as when simulating forward
+		 * again after a rollback, the field is copied from it instead of
+		 * being recomputed.
+		 */
+		void setHistory(const SimHistory* history2) {
+			history = history2;
+		}
+		
+		//Advances the game by one PHYSICS_STEP, with one input per player
+		void step(const BikeInput* inputs);
+		
+		int tick() const {
+			return currentTick;
+		}
+		
+		int getNumPlayers() const {
+			return numPlayers;
+		}
+		
+		int getTimeLeft() const {
+			return timeLeft;
+		}
+		
+		//Returns whether the time has run out
+		bool over() const {
+			return timeLeft <= 0;
+		}
+		
+		int score(int player) const {
+			return scores[player];
+		}
+		
+		const RiderSystem &getRiders() const {
+			return riders;
+		}
+		
+		const Collectible* getCollectibles() const {
+			return collectibles;
+		}
+		
+		//Returns a hash of the whole state, for checking that two Sims agree
+		unsigned int checksum() const;
+		
+		//Returns the size in bytes of the state saved by saveState
+		int stateSize() const;
+		/* Copies everything that changes from tick to tick, apart from the
+		 * flow field, to dest, which must have room for stateSize() bytes.
+		 * The flow field changes rarely and is large, so SimHistory saves it
+		 * separately, only when it has changed.
+		 */
+		void saveState(unsigned char* dest) const;
+		//Sets the Sim back to a state saved by saveState
+		void restoreState(const unsigned char* src);
+};
+
+#endif
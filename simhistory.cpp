@@ -0,0 +1,82 @@
+#include "simhistory.h"
+
+using namespace std;
+
+SimHistory::SimHistory(const Sim &sim, int numSlots2) :
+	numSlots(numSlots2),
+	stateSize(sim.stateSize()),
+	flowSize(sim.flow.stateSize()),
+	states((size_t)numSlots2 * sim.stateSize()),
+	flows((size_t)numSlots2 * sim.flow.stateSize()),
+	ticks(numSlots2, -1),
+	flowVersions(numSlots2, 0),
+	flowChanges(numSlots2, GoalChange()),
+	latestFlow(sim.flow.stateSize()),
+	latestVersion(0),
+	latestChange() {
+}
+
+void SimHistory::save(const Sim &sim) {
+	int slot = sim.tick() % numSlots;
+	sim.saveState(&states[(size_t)slot * stateSize]);
+	if (flowVersions[slot] != sim.flow.getVersion()) {
+		sim.flow.saveState(&flows[(size_t)slot * flowSize]);
+		flowVersions[slot] = sim.flow.getVersion();
+		flowChanges[slot] = sim.flowChange;
+	}
+	ticks[slot] = sim.tick();
+}
+
+bool SimHistory::has(int tick) const {
+	return tick >= 0 && ticks[tick % numSlots] == tick;
+}
+
+bool SimHistory::restore(Sim &sim, int tick) {
+	if (!has(tick)) {
+		return false;
+	}
+	
+	int slot = tick % numSlots;
+	if (flowVersions[slot] != sim.flow.getVersion() &&
+		!holds(sim.flow.getVersion())) {
+		sim.flow.saveState(&latestFlow[0]);
+		latestVersion = sim.flow.getVersion();
+		latestChange = sim.flowChange;
+	}
+	sim.restoreState(&states[(size_t)slot * stateSize]);
+	if (flowVersions[slot] != sim.flow.getVersion()) {
+		sim.flow.restoreState(&flows[(size_t)slot * flowSize]);
+		sim.flowChange = flowChanges[slot];
+	}
+	return true;
+}
+
+bool SimHistory::holds(unsigned int version) const {
+	if (version == latestVersion) {
+		return true;
+	}
+	for(int slot = 0; slot < numSlots; slot++) {
+		if (flowVersions[slot] == version) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SimHistory::findFlow(const GoalChange &change, Sim &sim) const {
+	const unsigned char* found = NULL;
+	for(int slot = 0; slot < numSlots && found == NULL; slot++) {
+		if (flowVersions[slot] != 0 && flowChanges[slot].matches(change)) {
+			found = &flows[(size_t)slot * flowSize];
+		}
+	}
+	if (found == NULL && latestVersion != 0 && latestChange.matches(change)) {
+		found = &latestFlow[0];
+	}
+	if (found == NULL) {
+		return false;
+	}
+	sim.flow.restoreState(found);
+	sim.flowChange = change;
+	return true;
+}
@@ -0,0 +1,71 @@
+#ifndef SIM_HISTORY_H_INCLUDED
+#define SIM_HISTORY_H_INCLUDED
+
+#include <vector>
+
+#include "sim.h"
+
+/* Saved states of a Sim on each of its last few ticks, for rolling back to
+ * one of them and simulating forward again once late inputs arrive.  All of
+ * the memory is allocated up front, one fixed-size slot per tick, so saving
+ * and restoring are just copies.
+ *
+ * The flow field is big and only changes when collectibles appear or are
+ * collected, so it's only copied when it differs from what the slot (or the
+ * Sim, when restoring) already holds.  Recomputing it costs milliseconds, so
+ * a Sim given the history (see Sim::setHistory) takes the field that follows
+ * a goal change from it when simulating that change again.
+ */
+class SimHistory {
+	private:
+		int numSlots;
+		int stateSize; //The size of each slot's Sim state, in bytes
+		int flowSize;  //The size of each slot's flow field, in bytes
+		std::vector<unsigned char> states;
+		std::vector<unsigned char> flows;
+		std::vector<int> ticks;                 //The tick in each slot, or -1
+		std::vector<unsigned int> flowVersions; //The field in each slot
+		std::vector<GoalChange> flowChanges;    //The change that made it
+		//The Sim's field when it was last rolled back, if no slot held it
+		std::vector<unsigned char> latestFlow;
+		unsigned int latestVersion;
+		GoalChange latestChange;
+		
+		//Returns whether any slot, or latestFlow, holds the given field
+		bool holds(unsigned int version) const;
+	public:
+		//Makes room for numSlots ticks of the given Sim, or of any Sim with
+		//the same terrain and number of riders and players
+		SimHistory(const Sim &sim, int numSlots);
+		
+		//Saves the Sim's current tick, replacing the oldest tick saved
+		void save(const Sim &sim);
+		//Returns whether the given tick is still saved
+		bool has(int tick) const;
+		/* Sets the Sim back to the given tick.  Returns false, leaving the Sim
+		 * alone, if that tick isn't saved.  The field the Sim had is kept,
+		 * if no slot holds it, so that simulating forward again can reach
+		 * it without recomputing it.
+		 */
+		bool restore(Sim &sim, int tick);
+		/* Copies the flow field that the given goal change made to the Sim,
+		 * and returns whether there was one.  The whole change is compared,
+		 * not just its hash, so a hash collision can't give the Sim the
+		 * wrong field.  Takes time proportional to the number of slots when
+		 * there isn't one.
+		 */
+		bool findFlow(const GoalChange &change, Sim &sim) const;
+		
+		//Returns the bytes copied to save a tick when the flow field hasn't
+		//changed
+		int snapshotSize() const {
+			return stateSize;
+		}
+		
+		//Returns the bytes copied for the flow field when it has changed
+		int flowSnapshotSize() const {
+			return flowSize;
+		}
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include <chrono>
+#include <stdio.h>
+
+#include "simthread.h"
+
+using namespace std;
+
+namespace {
+	//The most time to catch up on at once, after a stall
+	const double MAX_STEP_TIME = 0.25;
+	//How long to sleep when a step is due but can't be taken
+	const double IDLE_WAIT = 0.001;
+}
+
+void takeSnapshot(const Sim &sim, int player, FrameSnapshot &snapshot) {
+	const RiderSystem &riders = sim.getRiders();
+	snapshot.tick = sim.tick();
+	snapshot.riders.resize(riders.size());
+	for(int i = 0; i < riders.size(); i++) {
+		snapshot.riders[i] = riders.state(i);
+	}
+	const Collectible* collectibles = sim.getCollectibles();
+	for(int i = 0; i < NUM_COLLECTIBLES; i++) {
+		snapshot.collectibles[i] = collectibles[i];
+	}
+	snapshot.score = sim.score(player);
+	snapshot.timeLeft = sim.getTimeLeft();
+	snapshot.over = sim.over();
+}
+
+SimThread::SimThread(Sim* sim2, Lockstep* net2, int player2) :
+	sim(sim2), net(net2), player(player2), stopping(false),
+	desyncReported(false), numInputs(0) {
+	
+}
+
+SimThread::~SimThread() {
+	stop();
+}
+
+double SimThread::now() {
+	return chrono::duration<double>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SimThread::start() {
+	TimedInput none = {{0, 0, 0}, 0, now()};
+	inputs.writeSlot() = none;
+	inputs.publish();
+	publish(none);
+	snapshots.update();
+	
+	stopping = false;
+	thread = std::thread(&SimThread::run, this);
+}
+
+void SimThread::stop() {
+	stopping = true;
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void SimThread::setInput(const BikeInput &input) {
+	numInputs++;
+	TimedInput &slot = inputs.writeSlot();
+	slot.input = input;
+	slot.seq = numInputs;
+	slot.time = now();
+	inputs.publish();
+}
+
+void SimThread::run() {
+	TimedInput input = {{0, 0, 0}, 0, now()};
+	double last = now();
+	double stepTime = 0;
+	while (!stopping) {
+		if (inputs.update()) {
+			input = inputs.readSlot();
+		}
+		
+		double time = now();
+		stepTime += time - last;
+		last = time;
+		if (stepTime > MAX_STEP_TIME) {
+			stepTime = MAX_STEP_TIME; //Don't try to catch up after a long stall
+		}
+		bool stepped = !sim->over() && step(input.input, stepTime);
+		if (stepped) {
+			publish(input);
+		}
+		
+		//Sleep until the next step is due.  If it was due and couldn't be
+		//taken, because the game is over or the other players' inputs
+		//haven't arrived, it stays due, so sleep a little instead of
+		//spinning.
+		double wait = PHYSICS_STEP - stepTime;
+		if (wait <= 0 && !stepped) {
+			wait = IDLE_WAIT;
+		}
+		if (wait > 0) {
+			this_thread::sleep_for(chrono::duration<double>(wait));
+		}
+	}
+}
+
+bool SimThread::step(const BikeInput &input, double &stepTime) {
+	bool stepped = false;
+	while (stepTime >= PHYSICS_STEP) {
+		BikeInput stepInputs[256];
+		if (net != NULL) {
+			if (net->needsInput()) {
+				net->addLocalInput(input);
+			}
+			net->poll();
+			if (!net->ready()) {
+				break; //Wait for the other players
+			}
+			net->getInputs(stepInputs);
+		}
+		else {
+			stepInputs[0] = input;
+		}
+		sim->step(stepInputs);
+		stepped = true;
+		if (net != NULL) {
+			net->advance(sim->checksum());
+			if (net->desynced() && !desyncReported) {
+				printf("Out of sync with the other players at tick %d\n",
+					   net->desyncTick());
+				desyncReported = true;
+			}
+		}
+		stepTime -= PHYSICS_STEP;
+	}
+	if (net != NULL) {
+		net->poll(); //Send anything still waiting
+	}
+	return stepped;
+}
+
+void SimThread::publish(const TimedInput &input) {
+	FrameSnapshot &snapshot = snapshots.writeSlot();
+	takeSnapshot(*sim, player, snapshot);
+	snapshot.inputSeq = input.seq;
+	snapshot.inputTime = input.time;
+	snapshots.publish();
+}
@@ -0,0 +1,95 @@
+#ifndef SIM_THREAD_H_INCLUDED
+#define SIM_THREAD_H_INCLUDED
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "lockstep.h"
+#include "physics.h"
+#include "sim.h"
+#include "triplebuffer.h"
+
+//What the GL thread needs of the game to draw a frame
+struct FrameSnapshot {
+	int tick;
+	std::vector<BikeState> riders;
+	Collectible collectibles[NUM_COLLECTIBLES];
+	int score;     //The local player's
+	int timeLeft;
+	bool over;
+	//The local input the last step used: its number and when it was made, in
+	//seconds on SimThread::now()'s clock
+	int inputSeq;
+	double inputTime;
+};
+
+//Copies what a frame needs from sim into snapshot, with player as the local
+//player.  Leaves the input fields alone.
+void takeSnapshot(const Sim &sim, int player, FrameSnapshot &snapshot);
+
+/* Runs a Sim on its own thread, in fixed steps at real time, so that the GL
+ * thread can draw one frame while the next is simulated.  Input goes in and
+ * snapshots of the game come out through triple buffers, so neither thread
+ * ever waits for the other.
+ *
+ * Once started, the SimThread has the Sim and the Lockstep, if any, to itself
+ * until it's stopped.
+ */
+class SimThread {
+	private:
+		//A local input, numbered so that the snapshots can say which one
+		//they've used
+		struct TimedInput {
+			BikeInput input;
+			int seq;
+			double time;
+		};
+		
+		Sim* sim;
+		Lockstep* net;
+		int player;
+		std::thread thread;
+		std::atomic<bool> stopping;
+		bool desyncReported;
+		TripleBuffer<TimedInput> inputs;
+		TripleBuffer<FrameSnapshot> snapshots;
+		int numInputs; //Inputs given so far, on the GL thread
+		
+		void run();
+		//Steps the Sim as far as the time since the last step allows, and
+		//returns whether it stepped
+		bool step(const BikeInput &input, double &stepTime);
+		void publish(const TimedInput &input);
+	public:
+		//player is the local player, whose inputs are passed to setInput.  net
+		//is NULL for a game on this machine only.
+		SimThread(Sim* sim2, Lockstep* net2, int player2);
+		//Stops the thread
+		~SimThread();
+		
+		//Starts stepping.  The first snapshot is ready when this returns.
+		void start();
+		//Stops stepping and waits for the thread to finish
+		void stop();
+		
+		//Sets the local player's input.  GL thread only.
+		void setInput(const BikeInput &input);
+		
+		//Takes the latest snapshot, if there's a new one, and returns whether
+		//there was.  GL thread only.
+		bool update() {
+			return snapshots.update();
+		}
+		
+		//Returns the snapshot the last update took.  GL thread only.
+		const FrameSnapshot &snapshot() const {
+			return snapshots.readSlot();
+		}
+		
+		//Returns the time in seconds since an arbitrary point, on a clock
+		//both threads can read
+		static double now();
+};
+
+#endif
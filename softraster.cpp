@@ -0,0 +1,468 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "softraster.h"
+
+using namespace std;
+
+namespace {
+	//Bits of a pixel below the grid that edges are snapped to
+	const int SUBPIXEL_BITS = 8;
+	const int SUBPIXEL = 1 << SUBPIXEL_BITS;
+	const int NUM_CLIP_PLANES = 6;
+	//Batches with fewer vertices than this are transformed on one thread
+	const int PARALLEL_VERTICES = 4096;
+	
+	SoftRasterizer* currentRasterizer = NULL;
+	
+	void loadMatrixSoft(const GLfloat* m) {
+		currentRasterizer->loadMatrix(m);
+	}
+	
+	void setMaterialSoft(const Material &material) {
+		currentRasterizer->setMaterial(material);
+	}
+	
+	void drawTrianglesSoft(const TriangleBatch &batch) {
+		currentRasterizer->drawTriangles(batch);
+	}
+	
+	const RenderBackend SOFT_BACKEND = {
+		loadMatrixSoft,
+		setMaterialSoft,
+		drawTrianglesSoft
+	};
+	
+	//Returns how far inside the clip plane the vertex is: x > -w, x < w, y >
+	//-w, y < w, z > -w and z < w in turn
+	float planeDistance(const float* pos, int plane) {
+		float d = pos[plane / 2];
+		return pos[3] + (plane % 2 == 0 ? d : -d);
+	}
+	
+	int outcode(const float* pos) {
+		int code = 0;
+		for(int plane = 0; plane < NUM_CLIP_PLANES; plane++) {
+			if (planeDistance(pos, plane) < 0) {
+				code |= 1 << plane;
+			}
+		}
+		return code;
+	}
+	
+	float clamp01(float f) {
+		return f < 0 ? 0 : (f > 1 ? 1 : f);
+	}
+	
+	//Returns whether the pixels on an edge from (x0, y0) to (x1, y1) belong
+	//to the triangle to its left, which is when it's a left or top edge
+	bool isTopLeft(int64_t x0, int64_t y0, int64_t x1, int64_t y1) {
+		return y1 < y0 || (y1 == y0 && x1 < x0);
+	}
+	
+	int wrap(int i, int size) {
+		i %= size;
+		return i < 0 ? i + size : i;
+	}
+}
+
+SoftRasterizer::SoftRasterizer(int width2, int height2) :
+	w(width2), h(height2), projection(Mat4f::identity()),
+	modelview(Mat4f::identity()), lightDir(0, 0, 1), diffuse(0, 0, 0),
+	ambient(0.2f, 0.2f, 0.2f), bilinear(true), pool(NULL) {
+	tilesX = (w + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (h + TILE_SIZE - 1) / TILE_SIZE;
+	colors.resize(w * h * 3);
+	depths.resize(w * h);
+	bins.resize(tilesX * tilesY);
+	Material white = {0, false, {1, 1, 1}};
+	material = white;
+	clear();
+}
+
+void SoftRasterizer::setLight(const Vec3f &direction, const Vec3f &diffuse2,
+							  const Vec3f &ambient2) {
+	lightDir = direction.normalize();
+	diffuse = diffuse2;
+	ambient = ambient2;
+}
+
+void SoftRasterizer::addTexture(GLuint id, const Image* image) {
+	textures[id] = image;
+}
+
+void SoftRasterizer::clear(float red, float green, float blue) {
+	unsigned char color[3] = {(unsigned char)(clamp01(red) * 255 + 0.5f),
+							  (unsigned char)(clamp01(green) * 255 + 0.5f),
+							  (unsigned char)(clamp01(blue) * 255 + 0.5f)};
+	for(int i = 0; i < w * h; i++) {
+		memcpy(&colors[3 * i], color, 3);
+	}
+	fill(depths.begin(), depths.end(), 1.0f);
+	triangles.clear();
+	for(size_t i = 0; i < bins.size(); i++) {
+		bins[i].clear();
+	}
+}
+
+const RenderBackend* SoftRasterizer::backend() {
+	currentRasterizer = this;
+	return &SOFT_BACKEND;
+}
+
+void SoftRasterizer::loadMatrix(const float* m) {
+	for(int i = 0; i < 16; i++) {
+		modelview[i] = m[i];
+	}
+}
+
+void SoftRasterizer::setMaterial(const Material &material2) {
+	material = material2;
+}
+
+void SoftRasterizer::transformVertices(const TriangleBatch &batch, int first,
+									   int last, const Image* texture) {
+	Mat4f mvp = projection * modelview;
+	for(int i = first; i < last; i++) {
+		const float* vert = batch.vertices + i * batch.stride;
+		ClipVertex &clip = clipVerts[i];
+		Vec4f pos = mvp * Vec4f(vert[0], vert[1], vert[2], 1);
+		for(int j = 0; j < 4; j++) {
+			clip.pos[j] = pos[j];
+		}
+		clip.outcode = outcode(clip.pos);
+		
+		const float* base = batch.colorOffset >= 0 ?
+			vert + batch.colorOffset : material.color;
+		float light[3] = {1, 1, 1};
+		if (material.lighting) {
+			Vec3f normal(0, 0, 1);
+			if (batch.normalOffset >= 0) {
+				const float* n = vert + batch.normalOffset;
+				normal = modelview.transformDirection(Vec3f(n[0], n[1], n[2]));
+				normal = normal.normalize();
+			}
+			float lambert = max(0.0f, normal.dot(lightDir));
+			for(int j = 0; j < 3; j++) {
+				light[j] = ambient[j] + diffuse[j] * lambert;
+			}
+		}
+		for(int j = 0; j < 3; j++) {
+			clip.color[j] = clamp01(base[j] * light[j]);
+		}
+		
+		if (texture != NULL && batch.texCoordOffset >= 0) {
+			clip.texCoord[0] = vert[batch.texCoordOffset];
+			clip.texCoord[1] = vert[batch.texCoordOffset + 1];
+		}
+		else {
+			clip.texCoord[0] = 0;
+			clip.texCoord[1] = 0;
+		}
+	}
+}
+
+void SoftRasterizer::drawTriangles(const TriangleBatch &batch) {
+	const Image* texture = NULL;
+	if (material.texture != 0) {
+		map<GLuint, const Image*>::const_iterator it =
+			textures.find(material.texture);
+		if (it != textures.end()) {
+			texture = it->second;
+		}
+	}
+	
+	clipVerts.resize(batch.numVertices);
+	if (pool != NULL && batch.numVertices >= PARALLEL_VERTICES) {
+		int numChunks = pool->size() + 1;
+		int chunkSize = (batch.numVertices + numChunks - 1) / numChunks;
+		pool->parallelFor(numChunks, [&](int chunk) {
+			int first = chunk * chunkSize;
+			int last = min(first + chunkSize, batch.numVertices);
+			if (first < last) {
+				transformVertices(batch, first, last, texture);
+			}
+		});
+	}
+	else {
+		transformVertices(batch, 0, batch.numVertices, texture);
+	}
+	
+	int numCorners = batch.indices != NULL ? batch.numIndices :
+		batch.numVertices;
+	for(int i = 0; i + 2 < numCorners; i += 3) {
+		if (batch.indices != NULL) {
+			addTriangle(clipVerts[batch.indices[i]],
+						clipVerts[batch.indices[i + 1]],
+						clipVerts[batch.indices[i + 2]], texture);
+		}
+		else {
+			addTriangle(clipVerts[i], clipVerts[i + 1], clipVerts[i + 2],
+						texture);
+		}
+	}
+}
+
+void SoftRasterizer::addTriangle(const ClipVertex &v0, const ClipVertex &v1,
+								 const ClipVertex &v2, const Image* texture) {
+	if ((v0.outcode & v1.outcode & v2.outcode) != 0) {
+		return; //Wholly outside one of the planes
+	}
+	if ((v0.outcode | v1.outcode | v2.outcode) != 0) {
+		clipTriangle(v0, v1, v2, texture);
+		return;
+	}
+	const ClipVertex* verts[3] = {&v0, &v1, &v2};
+	setUpTriangle(verts, texture);
+}
+
+void SoftRasterizer::clipTriangle(const ClipVertex &v0, const ClipVertex &v1,
+								  const ClipVertex &v2, const Image* texture) {
+	//Clip the polygon by each plane in turn.  Each plane can add at most one
+	//corner.
+	const int MAX_CORNERS = 3 + NUM_CLIP_PLANES;
+	ClipVertex buffers[2][MAX_CORNERS];
+	ClipVertex* in = buffers[0];
+	ClipVertex* out = buffers[1];
+	in[0] = v0;
+	in[1] = v1;
+	in[2] = v2;
+	int numIn = 3;
+	for(int plane = 0; plane < NUM_CLIP_PLANES && numIn >= 3; plane++) {
+		int numOut = 0;
+		for(int i = 0; i < numIn; i++) {
+			const ClipVertex &a = in[i];
+			const ClipVertex &b = in[(i + 1) % numIn];
+			float da = planeDistance(a.pos, plane);
+			float db = planeDistance(b.pos, plane);
+			if (da >= 0) {
+				out[numOut++] = a;
+			}
+			if ((da >= 0) != (db >= 0)) {
+				float t = da / (da - db);
+				ClipVertex &c = out[numOut++];
+				for(int j = 0; j < 4; j++) {
+					c.pos[j] = a.pos[j] + (b.pos[j] - a.pos[j]) * t;
+				}
+				for(int j = 0; j < 3; j++) {
+					c.color[j] = a.color[j] + (b.color[j] - a.color[j]) * t;
+				}
+				for(int j = 0; j < 2; j++) {
+					c.texCoord[j] =
+						a.texCoord[j] + (b.texCoord[j] - a.texCoord[j]) * t;
+				}
+				c.outcode = 0;
+			}
+		}
+		swap(in, out);
+		numIn = numOut;
+	}
+	
+	for(int i = 1; i + 1 < numIn; i++) {
+		const ClipVertex* verts[3] = {&in[0], &in[i], &in[i + 1]};
+		setUpTriangle(verts, texture);
+	}
+}
+
+void SoftRasterizer::setUpTriangle(const ClipVertex* verts[3],
+								   const Image* texture) {
+	Triangle tri;
+	for(int i = 0; i < 3; i++) {
+		const float* pos = verts[i]->pos;
+		float invW = 1 / pos[3];
+		float sx = (pos[0] * invW * 0.5f + 0.5f) * w;
+		float sy = (pos[1] * invW * 0.5f + 0.5f) * h;
+		tri.x[i] = (int64_t)lrintf(sx * SUBPIXEL);
+		tri.y[i] = (int64_t)lrintf(sy * SUBPIXEL);
+		tri.depth[i] = pos[2] * invW * 0.5f + 0.5f;
+		tri.invW[i] = invW;
+		for(int j = 0; j < 3; j++) {
+			tri.attrs[i][j] = verts[i]->color[j] * invW;
+		}
+		tri.attrs[i][3] = verts[i]->texCoord[0] * invW;
+		tri.attrs[i][4] = verts[i]->texCoord[1] * invW;
+	}
+	
+	int64_t area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) -
+		(tri.y[1] - tri.y[0]) * (tri.x[2] - tri.x[0]);
+	if (area == 0) {
+		return;
+	}
+	if (area < 0) {
+		//Nothing is culled, so wind every triangle the same way
+		swap(tri.x[1], tri.x[2]);
+		swap(tri.y[1], tri.y[2]);
+		swap(tri.depth[1], tri.depth[2]);
+		swap(tri.invW[1], tri.invW[2]);
+		for(int j = 0; j < 5; j++) {
+			swap(tri.attrs[1][j], tri.attrs[2][j]);
+		}
+		area = -area;
+	}
+	tri.invArea = 1.0f / (float)area;
+	tri.texture = texture;
+	
+	//The pixels whose centres may be inside
+	int64_t minX = min(tri.x[0], min(tri.x[1], tri.x[2]));
+	int64_t maxX = max(tri.x[0], max(tri.x[1], tri.x[2]));
+	int64_t minY = min(tri.y[0], min(tri.y[1], tri.y[2]));
+	int64_t maxY = max(tri.y[0], max(tri.y[1], tri.y[2]));
+	tri.minX = max(0, (int)((minX - SUBPIXEL / 2) >> SUBPIXEL_BITS));
+	tri.maxX = min(w - 1, (int)((maxX - SUBPIXEL / 2) >> SUBPIXEL_BITS) + 1);
+	tri.minY = max(0, (int)((minY - SUBPIXEL / 2) >> SUBPIXEL_BITS));
+	tri.maxY = min(h - 1, (int)((maxY - SUBPIXEL / 2) >> SUBPIXEL_BITS) + 1);
+	if (tri.minX > tri.maxX || tri.minY > tri.maxY) {
+		return;
+	}
+	
+	int index = (int)triangles.size();
+	triangles.push_back(tri);
+	for(int ty = tri.minY / TILE_SIZE; ty <= tri.maxY / TILE_SIZE; ty++) {
+		for(int tx = tri.minX / TILE_SIZE; tx <= tri.maxX / TILE_SIZE; tx++) {
+			bins[ty * tilesX + tx].push_back(index);
+		}
+	}
+}
+
+void SoftRasterizer::sampleTexture(const Image* texture, float u, float v,
+								   float* texel) const {
+	const unsigned char* pixels = (const unsigned char*)texture->pixels;
+	int tw = texture->width;
+	int th = texture->height;
+	if (!bilinear) {
+		int x = wrap((int)floorf(u * tw), tw);
+		int y = wrap((int)floorf(v * th), th);
+		const unsigned char* p = pixels + 3 * (y * tw + x);
+		for(int i = 0; i < 3; i++) {
+			texel[i] = p[i] / 255.0f;
+		}
+		return;
+	}
+	
+	float fx = u * tw - 0.5f;
+	float fy = v * th - 0.5f;
+	float x0f = floorf(fx);
+	float y0f = floorf(fy);
+	float ax = fx - x0f;
+	float ay = fy - y0f;
+	int x0 = wrap((int)x0f, tw);
+	int y0 = wrap((int)y0f, th);
+	int x1 = (x0 + 1) % tw;
+	int y1 = (y0 + 1) % th;
+	const unsigned char* p00 = pixels + 3 * (y0 * tw + x0);
+	const unsigned char* p10 = pixels + 3 * (y0 * tw + x1);
+	const unsigned char* p01 = pixels + 3 * (y1 * tw + x0);
+	const unsigned char* p11 = pixels + 3 * (y1 * tw + x1);
+	for(int i = 0; i < 3; i++) {
+		float bottom = p00[i] + (p10[i] - p00[i]) * ax;
+		float top = p01[i] + (p11[i] - p01[i]) * ax;
+		texel[i] = (bottom + (top - bottom) * ay) / 255.0f;
+	}
+}
+
+void SoftRasterizer::fillTile(int tile) {
+	int tileX0 = tile % tilesX * TILE_SIZE;
+	int tileY0 = tile / tilesX * TILE_SIZE;
+	int tileX1 = min(tileX0 + TILE_SIZE, w) - 1;
+	int tileY1 = min(tileY0 + TILE_SIZE, h) - 1;
+	const vector<int> &bin = bins[tile];
+	for(size_t b = 0; b < bin.size(); b++) {
+		const Triangle &tri = triangles[bin[b]];
+		int x0 = max(tri.minX, tileX0);
+		int x1 = min(tri.maxX, tileX1);
+		int y0 = max(tri.minY, tileY0);
+		int y1 = min(tri.maxY, tileY1);
+		if (x0 > x1 || y0 > y1) {
+			continue;
+		}
+		
+		//Edge i is the one opposite corner i, and is positive on the
+		//triangle's side of it.  Pixels exactly on an edge belong to the
+		//triangle only if it's a top or left edge, so triangles that share
+		//an edge never both fill a pixel, and never both miss one.
+		int64_t stepX[3];
+		int64_t stepY[3];
+		int64_t rowStart[3];
+		int64_t px = ((int64_t)x0 << SUBPIXEL_BITS) + SUBPIXEL / 2;
+		int64_t py = ((int64_t)y0 << SUBPIXEL_BITS) + SUBPIXEL / 2;
+		for(int i = 0; i < 3; i++) {
+			int a = (i + 1) % 3;
+			int c = (i + 2) % 3;
+			int64_t dx = tri.x[c] - tri.x[a];
+			int64_t dy = tri.y[c] - tri.y[a];
+			stepX[i] = -dy * SUBPIXEL;
+			stepY[i] = dx * SUBPIXEL;
+			rowStart[i] = dx * (py - tri.y[a]) - dy * (px - tri.x[a]);
+			if (!isTopLeft(tri.x[a], tri.y[a], tri.x[c], tri.y[c])) {
+				rowStart[i]--;
+			}
+		}
+		
+		for(int y = y0; y <= y1; y++) {
+			int64_t e0 = rowStart[0];
+			int64_t e1 = rowStart[1];
+			int64_t e2 = rowStart[2];
+			for(int x = x0; x <= x1; x++) {
+				if ((e0 | e1 | e2) >= 0) {
+					float l0 = (float)e0 * tri.invArea;
+					float l1 = (float)e1 * tri.invArea;
+					float l2 = 1 - l0 - l1;
+					float depth = l0 * tri.depth[0] + l1 * tri.depth[1] +
+						l2 * tri.depth[2];
+					int pixel = y * w + x;
+					if (depth < depths[pixel]) {
+						depths[pixel] = depth;
+						float q = 1 / (l0 * tri.invW[0] + l1 * tri.invW[1] +
+									   l2 * tri.invW[2]);
+						float attrs[5];
+						for(int j = 0; j < 5; j++) {
+							attrs[j] = (l0 * tri.attrs[0][j] +
+										l1 * tri.attrs[1][j] +
+										l2 * tri.attrs[2][j]) * q;
+						}
+						if (tri.texture != NULL) {
+							float texel[3];
+							sampleTexture(tri.texture, attrs[3], attrs[4],
+										  texel);
+							for(int j = 0; j < 3; j++) {
+								attrs[j] *= texel[j];
+							}
+						}
+						unsigned char* color = &colors[3 * pixel];
+						for(int j = 0; j < 3; j++) {
+							color[j] =
+								(unsigned char)(clamp01(attrs[j]) * 255 + 0.5f);
+						}
+					}
+				}
+				e0 += stepX[0];
+				e1 += stepX[1];
+				e2 += stepX[2];
+			}
+			rowStart[0] += stepY[0];
+			rowStart[1] += stepY[1];
+			rowStart[2] += stepY[2];
+		}
+	}
+}
+
+void SoftRasterizer::finish() {
+	int numTiles = tilesX * tilesY;
+	if (pool != NULL) {
+		pool->parallelFor(numTiles, [this](int tile) {
+			fillTile(tile);
+		});
+	}
+	else {
+		for(int tile = 0; tile < numTiles; tile++) {
+			fillTile(tile);
+		}
+	}
+}
+
+Image* SoftRasterizer::toImage() const {
+	char* pixels = new char[w * h * 3];
+	memcpy(pixels, &colors[0], w * h * 3);
+	return new Image(pixels, w, h);
+}
@@ -0,0 +1,146 @@
+#ifndef SOFT_RASTER_H_INCLUDED
+#define SOFT_RASTER_H_INCLUDED
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+#include "imageloader.h"
+#include "mat4f.h"
+#include "renderqueue.h"
+#include "threadpool.h"
+#include "vec3f.h"
+
+/* Draws triangles into a framebuffer in memory, without OpenGL, so that the
+ * game's scenes can be drawn where there's no GPU.  It does what the game's
+ * fixed-function state asks of OpenGL: a depth test, Gouraud shading lit by
+ * one directional light plus ambient light (with GL_NORMALIZE and
+ * GL_COLOR_MATERIAL), and textures that modulate the lit colour, sampled
+ * nearest or bilinear.
+ *
+ * Drawing transforms and lights the vertices, clips the triangles to the view
+ * and sorts them into the tiles of the screen they touch.  finish() then
+ * fills each tile, on the thread pool if there is one.  A tile's triangles
+ * are filled in the order they were drawn, and edges are snapped to a fixed
+ * grid, so the image is the same whatever the number of threads.
+ */
+class SoftRasterizer {
+	private:
+		//A vertex in clip space, with its lit colour
+		struct ClipVertex {
+			float pos[4];
+			float color[3];
+			float texCoord[2];
+			int outcode; //A bit for each clip plane the vertex is outside
+		};
+		
+		//A triangle, in fixed point screen coordinates, ready to be filled
+		struct Triangle {
+			int64_t x[3];
+			int64_t y[3];
+			int minX, minY, maxX, maxY; //The pixels it may cover
+			float invArea;
+			float depth[3];
+			float invW[3];
+			float attrs[3][5]; //r, g, b, u, v divided by w at each corner
+			const Image* texture;
+		};
+		
+		int w;
+		int h;
+		int tilesX;
+		int tilesY;
+		std::vector<unsigned char> colors; //RGB, from the bottom row up
+		std::vector<float> depths;
+		
+		Mat4f projection;
+		Mat4f modelview;
+		Vec3f lightDir; //Towards the light, in eye space
+		Vec3f diffuse;
+		Vec3f ambient;
+		bool bilinear;
+		Material material;
+		std::map<GLuint, const Image*> textures;
+		ThreadPool* pool;
+		
+		std::vector<ClipVertex> clipVerts;
+		std::vector<Triangle> triangles;
+		std::vector<std::vector<int> > bins; //The triangles touching each tile
+		
+		void transformVertices(const TriangleBatch &batch, int first, int last,
+							   const Image* texture);
+		void addTriangle(const ClipVertex &v0, const ClipVertex &v1,
+						 const ClipVertex &v2, const Image* texture);
+		void clipTriangle(const ClipVertex &v0, const ClipVertex &v1,
+						  const ClipVertex &v2, const Image* texture);
+		void setUpTriangle(const ClipVertex* verts[3], const Image* texture);
+		void fillTile(int tile);
+		void sampleTexture(const Image* texture, float u, float v,
+						   float* texel) const;
+	public:
+		//The width and height of the tiles, in pixels
+		static const int TILE_SIZE = 64;
+		
+		SoftRasterizer(int width2, int height2);
+		
+		int width() const {
+			return w;
+		}
+		
+		int height() const {
+			return h;
+		}
+		
+		//Sets the pool that transforms vertices and fills tiles, or NULL to
+		//do everything on the calling thread
+		void setThreadPool(ThreadPool* pool2) {
+			pool = pool2;
+		}
+		
+		void setProjection(const Mat4f &projection2) {
+			projection = projection2;
+		}
+		
+		/* Sets the light, as GL_LIGHT0 with a w of 0 and the light model's
+		 * ambient colour would.  direction points towards the light, in eye
+		 * space.
+		 */
+		void setLight(const Vec3f &direction, const Vec3f &diffuse2,
+					  const Vec3f &ambient2);
+		
+		//Sets whether textures are sampled bilinearly rather than nearest
+		void setBilinear(bool bilinear2) {
+			bilinear = bilinear2;
+		}
+		
+		//Makes materials with the given texture id sample image, which must
+		//outlive the rasterizer
+		void addTexture(GLuint id, const Image* image);
+		
+		//Clears the colour and depth buffers, and forgets what was drawn
+		void clear(float red = 0, float green = 0, float blue = 0);
+		
+		/* Returns a backend that draws to this rasterizer.  Like a GL
+		 * context, the backend draws to whichever rasterizer last called
+		 * backend().
+		 */
+		const RenderBackend* backend();
+		
+		//Sets the modelview matrix, stored by columns
+		void loadMatrix(const float* m);
+		void setMaterial(const Material &material2);
+		void drawTriangles(const TriangleBatch &batch);
+		
+		//Fills in the triangles drawn since the last clear
+		void finish();
+		
+		//Returns the triangles drawn since the last clear, after clipping
+		int numTriangles() const {
+			return (int)triangles.size();
+		}
+		
+		//Returns a copy of the colour buffer.  The caller owns the image.
+		Image* toImage() const;
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include "imageloader.h"
+#include "terrain.h"
+
+using namespace std;
+
+Terrain::Terrain(int w2, int l2) {
+	w = w2;
+	l = l2;
+	
+	hs = new float*[l];
+	for(int i = 0; i < l; i++) {
+		hs[i] = new float[w];
+	}
+	
+	normals = new Vec3f*[l];
+	for(int i = 0; i < l; i++) {
+		normals[i] = new Vec3f[w];
+	}
+	
+	computedNormals = false;
+}
+
+Terrain::~Terrain() {
+	for(int i = 0; i < l; i++) {
+		delete[] hs[i];
+	}
+	delete[] hs;
+	
+	for(int i = 0; i < l; i++) {
+		delete[] normals[i];
+	}
+	delete[] normals;
+}
+
+//Computes the normals, if they haven't been computed yet
+void Terrain::computeNormals() {
+	if (computedNormals) {
+		return;
+	}
+	
+	//Compute the rough version of the normals
+	Vec3f** normals2 = new Vec3f*[l];
+	for(int i = 0; i < l; i++) {
+		normals2[i] = new Vec3f[w];
+	}
+	
+	for(int z = 0; z < l; z++) {
+		for(int x = 0; x < w; x++) {
+			Vec3f sum(0.0f, 0.0f, 0.0f);
+			
+			Vec3f out;
+			if (z > 0) {
+				out = Vec3f(0.0f, hs[z - 1][x] - hs[z][x], -1.0f);
+			}
+			Vec3f in;
+			if (z < l - 1) {
+				in = Vec3f(0.0f, hs[z + 1][x] - hs[z][x], 1.0f);
+			}
+			Vec3f left;
+			if (x > 0) {
+				left = Vec3f(-1.0f, hs[z][x - 1] - hs[z][x], 0.0f);
+			}
+			Vec3f right;
+			if (x < w - 1) {
+				right = Vec3f(1.0f, hs[z][x + 1] - hs[z][x], 0.0f);
+			}
+			
+			if (x > 0 && z > 0) {
+				sum += out.cross(left).normalize();
+			}
+			if (x > 0 && z < l - 1) {
+				sum += left.cross(in).normalize();
+			}
+			if (x < w - 1 && z < l - 1) {
+				sum += in.cross(right).normalize();
+			}
+			if (x < w - 1 && z > 0) {
+				sum += right.cross(out).normalize();
+			}
+			
+			normals2[z][x] = sum;
+		}
+	}
+	
+	//Smooth out the normals
+	const float FALLOUT_RATIO = 0.5f;
+	for(int z = 0; z < l; z++) {
+		for(int x = 0; x < w; x++) {
+			Vec3f sum = normals2[z][x];
+			
+			if (x > 0) {
+				sum += normals2[z][x - 1] * FALLOUT_RATIO;
+			}
+			if (x < w - 1) {
+				sum += normals2[z][x + 1] * FALLOUT_RATIO;
+			}
+			if (z > 0) {
+				sum += normals2[z - 1][x] * FALLOUT_RATIO;
+			}
+			if (z < l - 1) {
+				sum += normals2[z + 1][x] * FALLOUT_RATIO;
+			}
+			
+			if (sum.magnitude() == 0) {
+				sum = Vec3f(0.0f, 1.0f, 0.0f);
+			}
+			normals[z][x] = sum;
+		}
+	}
+	
+	for(int i = 0; i < l; i++) {
+		delete[] normals2[i];
+	}
+	delete[] normals2;
+	
+	computedNormals = true;
+}
+
+Terrain* loadTerrain(const char* filename, float height) {
+	Image* image = loadBMP(filename);
+	if (image == NULL) {
+		return NULL;
+	}
+	Terrain* t = new Terrain(image->width, image->height);
+	for(int y = 0; y < image->height; y++) {
+		for(int x = 0; x < image->width; x++) {
+			unsigned char color =
+				(unsigned char)image->pixels[3 * (y * image->width + x)];
+			float h = height * ((color / 255.0f) - 0.5f);
+			t->setHeight(x, y, h);
+		}
+	}
+	
+	delete image;
+	t->computeNormals();
+	return t;
+}
+
+//Returns the approximate height of the terrain at the specified (x, z) position
+float heightAt(Terrain* terrain, float x, float z) {
+	//Make (x, z) lie within the bounds of the terrain
+	if (x < 0) {
+		x = 0;
+	}
+	else if (x > terrain->width() - 1) {
+		x = terrain->width() - 1;
+	}
+	if (z < 0) {
+		z = 0;
+	}
+	else if (z > terrain->length() - 1) {
+		z = terrain->length() - 1;
+	}
+	
+	//Compute the grid cell in which (x, z) lies and how close we are to the
+	//left and outward edges
+	int leftX = (int)x;
+	if (leftX == terrain->width() - 1) {
+		leftX--;
+	}
+	float fracX = x - leftX;
+	
+	int outZ = (int)z;
+	if (outZ == terrain->length() - 1) {
+		outZ--;
+	}
+	float fracZ = z - outZ;
+	
+	//Compute the four heights for the grid cell
+	float h11 = terrain->getHeight(leftX, outZ);
+	float h12 = terrain->getHeight(leftX, outZ + 1);
+	float h21 = terrain->getHeight(leftX + 1, outZ);
+	float h22 = terrain->getHeight(leftX + 1, outZ + 1);
+	
+	//Take a weighted average of the four heights
+	return (1 - fracX) * ((1 - fracZ) * h11 + fracZ * h12) +
+		fracX * ((1 - fracZ) * h21 + fracZ * h22);
+}
@@ -0,0 +1,360 @@
+#include <fstream>
+#include <math.h>
+#include <string>
+#include <string.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "terrainlight.h"
+
+using namespace std;
+
+namespace {
+	//Rows of vertices baked together as one job
+	const int ROWS_PER_JOB = 8;
+	
+	//How quickly the sun fades out as the horizon rises past it, per unit of
+	//the tangent of its elevation
+	const float SHADOW_SHARPNESS = 8.0f;
+	
+	//The directions the sky is scanned in.  Each is a whole step on the grid,
+	//so every sample lands on a vertex.
+	const int NUM_SKY_DIRECTIONS = 16;
+	const int SKY_DIRECTIONS[NUM_SKY_DIRECTIONS][2] = {
+		{1, 0}, {-1, 0}, {0, 1}, {0, -1},
+		{1, 1}, {1, -1}, {-1, 1}, {-1, -1},
+		{2, 1}, {2, -1}, {-2, 1}, {-2, -1},
+		{1, 2}, {1, -2}, {-1, 2}, {-1, -2}
+	};
+	
+	const char CACHE_MAGIC[4] = {'T', 'L', 'M', '1'};
+	
+	//The terrain's heights, with a border around them as wide as the scans
+	//reach, so that they never need bounds checks.  The border repeats the
+	//nearest edge.
+	struct PaddedHeights {
+		int pad;
+		int w;
+		vector<float> hs;
+		
+		PaddedHeights(Terrain* terrain, int pad2) {
+			pad = pad2;
+			w = terrain->width() + 2 * pad;
+			int l = terrain->length() + 2 * pad;
+			hs.resize(w * l);
+			for(int z = 0; z < l; z++) {
+				int tz = min(max(z - pad, 0), terrain->length() - 1);
+				for(int x = 0; x < w; x++) {
+					int tx = min(max(x - pad, 0), terrain->width() - 1);
+					hs[z * w + x] = terrain->getHeight(tx, tz);
+				}
+			}
+		}
+		
+		//Returns the heights starting at the terrain's vertex (x, z)
+		const float* at(int x, int z) const {
+			return &hs[(z + pad) * w + x + pad];
+		}
+	};
+	
+	//A step of the sun's scan: where it samples, relative to the vertex, and
+	//how far that is
+	struct SunStep {
+		int dx, dz;       //The corner of the square it samples in
+		float fx, fz;     //Where in the square
+		float invDistance;
+	};
+	
+	//Returns the fraction of the sky a vertex sees, given the tangent of the
+	//horizon's elevation in each direction
+	float skyVisibility(const float* horizons) {
+		float sum = 0;
+		for(int i = 0; i < NUM_SKY_DIRECTIONS; i++) {
+			float t = horizons[i];
+			sum += 1 - t / sqrtf(1 + t * t);
+		}
+		return sum / NUM_SKY_DIRECTIONS;
+	}
+	
+	float clamp(float value, float low, float high) {
+		return value < low ? low : (value > high ? high : value);
+	}
+	
+	/* Bakes the rows from firstRow to lastRow - 1.  The scans are done four
+	 * vertices at a time with SSE where it's available: neighbouring vertices
+	 * in a row scan neighbouring heights, so each step is one unaligned load.
+	 * The SSE code does the same operations in the same order as the scalar
+	 * code, so the bake is the same whichever path does it.
+	 */
+	void bakeRows(Terrain* terrain, const PaddedHeights &heights,
+				  const vector<SunStep> &sunSteps, const Vec3f &sunDir,
+				  float sunTan, float* sky, float* sun,
+				  int firstRow, int lastRow) {
+		int w = terrain->width();
+		int numSkySteps[NUM_SKY_DIRECTIONS];
+		float skyInvDistance[NUM_SKY_DIRECTIONS];
+		for(int d = 0; d < NUM_SKY_DIRECTIONS; d++) {
+			int dx = SKY_DIRECTIONS[d][0];
+			int dz = SKY_DIRECTIONS[d][1];
+			float length = sqrtf((float)(dx * dx + dz * dz));
+			numSkySteps[d] = (int)ceilf(TerrainLightmap::SCAN_DISTANCE /
+										length);
+			skyInvDistance[d] = 1 / length;
+		}
+		int numSunSteps = (int)sunSteps.size();
+		
+		for(int z = firstRow; z < lastRow; z++) {
+			int x = 0;
+#ifdef __SSE__
+			__m128 zero = _mm_setzero_ps();
+			__m128 one = _mm_set1_ps(1);
+			for(; x + 4 <= w; x += 4) {
+				const float* row = heights.at(x, z);
+				__m128 h0 = _mm_loadu_ps(row);
+				
+				__m128 skySum = zero;
+				for(int d = 0; d < NUM_SKY_DIRECTIONS; d++) {
+					int offset = SKY_DIRECTIONS[d][1] * heights.w +
+						SKY_DIRECTIONS[d][0];
+					__m128 horizon = zero;
+					for(int s = 1; s <= numSkySteps[d]; s++) {
+						__m128 rise = _mm_sub_ps(_mm_loadu_ps(row + s * offset),
+												 h0);
+						__m128 invDistance =
+							_mm_set1_ps(skyInvDistance[d] / s);
+						horizon = _mm_max_ps(horizon,
+											 _mm_mul_ps(rise, invDistance));
+					}
+					__m128 sine = _mm_div_ps(horizon, _mm_sqrt_ps(
+						_mm_add_ps(one, _mm_mul_ps(horizon, horizon))));
+					skySum = _mm_add_ps(skySum, _mm_sub_ps(one, sine));
+				}
+				_mm_storeu_ps(sky + z * w + x,
+							  _mm_div_ps(skySum,
+										 _mm_set1_ps(NUM_SKY_DIRECTIONS)));
+				
+				__m128 horizon = _mm_set1_ps(-1e10f);
+				for(int s = 0; s < numSunSteps; s++) {
+					const SunStep &step = sunSteps[s];
+					const float* corner = row + step.dz * heights.w + step.dx;
+					__m128 fx = _mm_set1_ps(step.fx);
+					__m128 front = _mm_loadu_ps(corner);
+					front = _mm_add_ps(front, _mm_mul_ps(_mm_sub_ps(
+						_mm_loadu_ps(corner + 1), front), fx));
+					__m128 back = _mm_loadu_ps(corner + heights.w);
+					back = _mm_add_ps(back, _mm_mul_ps(_mm_sub_ps(
+						_mm_loadu_ps(corner + heights.w + 1), back), fx));
+					__m128 sample = _mm_add_ps(front, _mm_mul_ps(
+						_mm_sub_ps(back, front), _mm_set1_ps(step.fz)));
+					horizon = _mm_max_ps(horizon, _mm_mul_ps(
+						_mm_sub_ps(sample, h0),
+						_mm_set1_ps(step.invDistance)));
+				}
+				float horizons[4];
+				_mm_storeu_ps(horizons, horizon);
+				for(int k = 0; k < 4; k++) {
+					Vec3f normal = terrain->getNormal(x + k, z).normalize();
+					float lambert = max(0.0f, normal.dot(sunDir));
+					float shadow = clamp((sunTan - horizons[k]) *
+										 SHADOW_SHARPNESS + 0.5f, 0, 1);
+					sun[z * w + x + k] = lambert * shadow;
+				}
+			}
+#endif
+			for(; x < w; x++) {
+				const float* row = heights.at(x, z);
+				float h0 = row[0];
+				
+				float horizons[NUM_SKY_DIRECTIONS];
+				for(int d = 0; d < NUM_SKY_DIRECTIONS; d++) {
+					int offset = SKY_DIRECTIONS[d][1] * heights.w +
+						SKY_DIRECTIONS[d][0];
+					float horizon = 0;
+					for(int s = 1; s <= numSkySteps[d]; s++) {
+						float rise = row[s * offset] - h0;
+						horizon = max(horizon, rise * (skyInvDistance[d] / s));
+					}
+					horizons[d] = horizon;
+				}
+				sky[z * w + x] = skyVisibility(horizons);
+				
+				float horizon = -1e10f;
+				for(int s = 0; s < numSunSteps; s++) {
+					const SunStep &step = sunSteps[s];
+					const float* corner = row + step.dz * heights.w + step.dx;
+					float front = corner[0] + (corner[1] - corner[0]) * step.fx;
+					float back = corner[heights.w] +
+						(corner[heights.w + 1] - corner[heights.w]) * step.fx;
+					float sample = front + (back - front) * step.fz;
+					horizon = max(horizon, (sample - h0) * step.invDistance);
+				}
+				Vec3f normal = terrain->getNormal(x, z).normalize();
+				float lambert = max(0.0f, normal.dot(sunDir));
+				float shadow = clamp((sunTan - horizon) * SHADOW_SHARPNESS +
+									 0.5f, 0, 1);
+				sun[z * w + x] = lambert * shadow;
+			}
+		}
+	}
+	
+	//Adds bytes to a 64-bit FNV-1a hash
+	void hashBytes(unsigned long long &hash, const void* data, size_t size) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for(size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+	}
+}
+
+TerrainLightmap::TerrainLightmap(int w2, int l2) {
+	w = w2;
+	l = l2;
+	sky.resize(w * l);
+	sun.resize(w * l);
+}
+
+TerrainLightmap::TerrainLightmap(Terrain* terrain, const Vec3f &sunDirection,
+								 ThreadPool* pool) {
+	w = terrain->width();
+	l = terrain->length();
+	sky.resize(w * l);
+	sun.resize(w * l);
+	terrain->computeNormals(); //Before the threads read them
+	
+	//The sun's scan takes a unit step across the ground towards the sun each
+	//time, sampling the heights bilinearly.  Every vertex samples at the same
+	//offsets, so the steps are worked out once.
+	sunDir = sunDirection.normalize();
+	float across = sqrtf(sunDir[0] * sunDir[0] + sunDir[2] * sunDir[2]);
+	float sunTan = across > 0 ? sunDir[1] / across : 1e10f;
+	vector<SunStep> sunSteps;
+	if (across > 0) {
+		for(int s = 1; s <= SCAN_DISTANCE; s++) {
+			float px = s * sunDir[0] / across;
+			float pz = s * sunDir[2] / across;
+			SunStep step;
+			step.dx = (int)floorf(px);
+			step.dz = (int)floorf(pz);
+			step.fx = px - step.dx;
+			step.fz = pz - step.dz;
+			step.invDistance = 1.0f / s;
+			sunSteps.push_back(step);
+		}
+	}
+	
+	//The sun's samples reach one vertex further, for the bilinear lookup.
+	//The SSE path also reads up to three vertices past the end of a row.
+	PaddedHeights heights(terrain, SCAN_DISTANCE + 4);
+	int numJobs = (l + ROWS_PER_JOB - 1) / ROWS_PER_JOB;
+	auto bake = [&](int job) {
+		bakeRows(terrain, heights, sunSteps, sunDir, sunTan, &sky[0], &sun[0],
+				 job * ROWS_PER_JOB, min(l, (job + 1) * ROWS_PER_JOB));
+	};
+	if (pool != NULL) {
+		pool->parallelFor(numJobs, bake);
+	}
+	else {
+		for(int job = 0; job < numJobs; job++) {
+			bake(job);
+		}
+	}
+}
+
+unsigned long long TerrainLightmap::cacheKey(const char* heightmapFile,
+											 float height,
+											 const Vec3f &sunDirection) {
+	ifstream input;
+	input.open(heightmapFile, ifstream::binary);
+	if (input.fail()) {
+		return 0;
+	}
+	unsigned long long hash = 14695981039346656037ULL;
+	char buffer[4096];
+	while (input.read(buffer, sizeof(buffer)) || input.gcount() > 0) {
+		hashBytes(hash, buffer, (size_t)input.gcount());
+	}
+	
+	//Anything else that changes the bake belongs in the key too
+	float params[] = {height, sunDirection[0], sunDirection[1],
+					  sunDirection[2], (float)SCAN_DISTANCE, SHADOW_SHARPNESS,
+					  (float)NUM_SKY_DIRECTIONS};
+	hashBytes(hash, params, sizeof(params));
+	return hash != 0 ? hash : 1;
+}
+
+bool TerrainLightmap::save(const char* filename,
+						   unsigned long long key) const {
+	ofstream output;
+	output.open(filename, ofstream::binary);
+	if (output.fail()) {
+		return false;
+	}
+	int size[2] = {w, l};
+	float direction[3] = {sunDir[0], sunDir[1], sunDir[2]};
+	output.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	output.write((const char*)&key, sizeof(key));
+	output.write((const char*)size, sizeof(size));
+	output.write((const char*)direction, sizeof(direction));
+	output.write((const char*)&sky[0], sky.size() * sizeof(float));
+	output.write((const char*)&sun[0], sun.size() * sizeof(float));
+	return !output.fail();
+}
+
+TerrainLightmap* TerrainLightmap::load(const char* filename,
+									   unsigned long long key) {
+	ifstream input;
+	input.open(filename, ifstream::binary);
+	if (input.fail()) {
+		return NULL;
+	}
+	char magic[sizeof(CACHE_MAGIC)];
+	unsigned long long fileKey;
+	int size[2];
+	float direction[3];
+	input.read(magic, sizeof(magic));
+	input.read((char*)&fileKey, sizeof(fileKey));
+	input.read((char*)size, sizeof(size));
+	input.read((char*)direction, sizeof(direction));
+	if (input.fail() || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+		fileKey != key || size[0] <= 0 || size[1] <= 0 ||
+		size[0] > 16384 || size[1] > 16384) {
+		return NULL;
+	}
+	
+	TerrainLightmap* lightmap = new TerrainLightmap(size[0], size[1]);
+	lightmap->sunDir = Vec3f(direction[0], direction[1], direction[2]);
+	input.read((char*)&lightmap->sky[0], lightmap->sky.size() * sizeof(float));
+	input.read((char*)&lightmap->sun[0], lightmap->sun.size() * sizeof(float));
+	if (input.fail()) {
+		delete lightmap;
+		return NULL;
+	}
+	return lightmap;
+}
+
+TerrainLightmap* TerrainLightmap::loadOrBake(Terrain* terrain,
+											 const char* heightmapFile,
+											 float height,
+											 const Vec3f &sunDirection,
+											 ThreadPool* pool) {
+	string cacheFile = string(heightmapFile) + ".light";
+	unsigned long long key = cacheKey(heightmapFile, height, sunDirection);
+	TerrainLightmap* lightmap = NULL;
+	if (key != 0) {
+		lightmap = load(cacheFile.c_str(), key);
+	}
+	if (lightmap != NULL && lightmap->w == terrain->width() &&
+		lightmap->l == terrain->length()) {
+		return lightmap;
+	}
+	delete lightmap;
+	
+	lightmap = new TerrainLightmap(terrain, sunDirection, pool);
+	if (key != 0) {
+		//If the cache can't be written, the next startup just bakes again
+		lightmap->save(cacheFile.c_str(), key);
+	}
+	return lightmap;
+}
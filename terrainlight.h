@@ -0,0 +1,92 @@
+#ifndef TERRAIN_LIGHT_H_INCLUDED
+#define TERRAIN_LIGHT_H_INCLUDED
+
+#include <vector>
+
+#include "terrain.h"
+#include "threadpool.h"
+#include "vec3f.h"
+
+/* Light baked for each vertex of a terrain: how much of the sky it sees, and
+ * how much sun reaches it.  Both come from horizon scans over the heights.
+ * Ambient occlusion scans in 16 directions and averages how much of each
+ * direction's sky isn't hidden by the highest point in it.  The sun's light is
+ * the cosine of its angle to the normal, faded out as the horizon towards it
+ * rises past it, which gives shadows with soft edges.
+ *
+ * The terrain and the sun don't move, so the bake is done once and cached in
+ * a file next to the heightmap, keyed by a hash of the heightmap and the sun,
+ * so that later startups read it instead.
+ */
+class TerrainLightmap {
+	private:
+		int w;
+		int l;
+		Vec3f sunDir; //Towards the sun, unit length
+		std::vector<float> sky; //How much sky each vertex sees, from 0 to 1
+		std::vector<float> sun; //How much sunlight reaches each vertex
+		
+		TerrainLightmap(int w2, int l2);
+	public:
+		//How far the scans look, in terrain units
+		static const int SCAN_DISTANCE = 32;
+		
+		/* Bakes the light for the terrain, with sunDirection pointing towards
+		 * the sun in terrain space.  If pool isn't NULL, rows are baked on
+		 * it.  Gives the same result either way.
+		 */
+		TerrainLightmap(Terrain* terrain, const Vec3f &sunDirection,
+						ThreadPool* pool = NULL);
+		
+		int width() const {
+			return w;
+		}
+		
+		int length() const {
+			return l;
+		}
+		
+		//Returns the direction towards the sun, unit length
+		const Vec3f &sunDirection() const {
+			return sunDir;
+		}
+		
+		//Returns how much of the sky the vertex at (x, z) sees, from 0 to 1
+		float skyLight(int x, int z) const {
+			return sky[z * w + x];
+		}
+		
+		//Returns the cosine of the sun's angle to the vertex's normal, times
+		//how much of the sun the vertex sees
+		float sunLight(int x, int z) const {
+			return sun[z * w + x];
+		}
+		
+		/* Returns a key for the bake of a heightmap file with a sun, which
+		 * changes if either does, or 0 if the file can't be read.  The scale
+		 * of the heights is part of the key too.
+		 */
+		static unsigned long long cacheKey(const char* heightmapFile,
+										   float height,
+										   const Vec3f &sunDirection);
+		//Writes the lightmap to a file, tagged with key.  Returns false if it
+		//couldn't be written.
+		bool save(const char* filename, unsigned long long key) const;
+		//Reads a lightmap that save wrote with the same key, or returns NULL
+		//if the file is missing, damaged or has another key
+		static TerrainLightmap* load(const char* filename,
+									 unsigned long long key);
+		
+		/* Returns the lightmap for a terrain loaded from heightmapFile with
+		 * the given height.  It's read from heightmapFile + ".light" if that
+		 * was baked for the same heightmap and sun; otherwise it's baked and
+		 * saved there for next time.
+		 */
+		static TerrainLightmap* loadOrBake(Terrain* terrain,
+										   const char* heightmapFile,
+										   float height,
+										   const Vec3f &sunDirection,
+										   ThreadPool* pool = NULL);
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <vector>
+
+#include "terrainmesh.h"
+#include "vec3f.h"
+
+using namespace std;
+
+namespace {
+	//Rows of vertices painted together as one job
+	const int ROWS_PER_JOB = 16;
+	
+	const TerrainPalette DEFAULT_PALETTE = {
+		{{0.59f, 0.27f, 0.08f},  //Dirt
+		 {0.3f, 0.9f, 0.0f},     //Grass
+		 {0.0f, 0.0f, 0.8f}},    //Water
+		{0.42f, 0.4f, 0.38f}, {0.2f, 0.32f},
+		{0.85f, 0.8f, 0.72f}, {0.8f, 0.95f},
+		0.5f, 0.5f
+	};
+	
+	//Returns 0 below low, 1 above high, and a smooth ramp between them
+	float ramp(float value, float low, float high) {
+		if (high <= low) {
+			return value >= high ? 1.0f : 0.0f;
+		}
+		float t = (value - low) / (high - low);
+		t = t < 0 ? 0 : (t > 1 ? 1 : t);
+		return t * t * (3 - 2 * t);
+	}
+	
+	//Returns the splat map's pixel for the terrain vertex at (x, z)
+	const unsigned char* splatPixel(const Image* splatMap, int x, int z,
+									int width, int length) {
+		int sx = width > 1 ? (x * (splatMap->width - 1) + (width - 1) / 2) /
+			(width - 1) : 0;
+		int sz = length > 1 ? (z * (splatMap->height - 1) + (length - 1) / 2) /
+			(length - 1) : 0;
+		return (const unsigned char*)splatMap->pixels +
+			3 * (sz * splatMap->width + sx);
+	}
+}
+
+const TerrainPalette &defaultTerrainPalette() {
+	return DEFAULT_PALETTE;
+}
+
+TerrainMesh::TerrainMesh(Terrain* terrain, const Image* splatMap,
+						 const TerrainPalette &palette,
+						 const TerrainLightmap* lightmap, ThreadPool* pool) {
+	int w = terrain->width();
+	int l = terrain->length();
+	terrain->computeNormals(); //Before the threads read them
+	float minHeight = terrain->getHeight(0, 0);
+	float maxHeight = minHeight;
+	for(int z = 0; z < l; z++) {
+		for(int x = 0; x < w; x++) {
+			minHeight = min(minHeight, terrain->getHeight(x, z));
+			maxHeight = max(maxHeight, terrain->getHeight(x, z));
+		}
+	}
+	
+	verts.resize(w * l * 9);
+	int numJobs = (l + ROWS_PER_JOB - 1) / ROWS_PER_JOB;
+	auto paint = [&](int job) {
+		paintRows(terrain, splatMap, palette, lightmap, minHeight, maxHeight,
+				  job * ROWS_PER_JOB, min(l, (job + 1) * ROWS_PER_JOB));
+	};
+	if (pool != NULL) {
+		pool->parallelFor(numJobs, paint);
+	}
+	else {
+		for(int job = 0; job < numJobs; job++) {
+			paint(job);
+		}
+	}
+	
+	//Two triangles per square, wound the way the old strips were
+	indices.reserve((w - 1) * (l - 1) * 6);
+	for(int z = 0; z < l - 1; z++) {
+		for(int x = 0; x < w - 1; x++) {
+			unsigned int corner = z * w + x;
+			const unsigned int square[6] = {corner, corner + w, corner + 1,
+											corner + 1, corner + w,
+											corner + w + 1};
+			indices.insert(indices.end(), square, square + 6);
+		}
+	}
+}
+
+void TerrainMesh::paintRows(Terrain* terrain, const Image* splatMap,
+							const TerrainPalette &palette,
+							const TerrainLightmap* lightmap, float minHeight,
+							float maxHeight, int firstRow, int lastRow) {
+	int w = terrain->width();
+	int l = terrain->length();
+	float heightRange = maxHeight > minHeight ? maxHeight - minHeight : 1.0f;
+	//The terrain's normals aren't unit length.  The shading only needs them
+	//to be nearly so, so a row is normalized at a time.
+	vector<float> nx(w);
+	vector<float> ny(w);
+	vector<float> nz(w);
+	for(int z = firstRow; z < lastRow; z++) {
+		for(int x = 0; x < w; x++) {
+			Vec3f normal = terrain->getNormal(x, z);
+			float* vert = &verts[9 * (z * w + x)];
+			vert[0] = (float)x;
+			vert[1] = terrain->getHeight(x, z);
+			vert[2] = (float)z;
+			for(int i = 0; i < 3; i++) {
+				vert[3 + i] = normal[i];
+			}
+			nx[x] = normal[0];
+			ny[x] = normal[1];
+			nz[x] = normal[2];
+		}
+		normalizeFast(&nx[0], &ny[0], &nz[0], w);
+		
+		for(int x = 0; x < w; x++) {
+			float* vert = &verts[9 * (z * w + x)];
+			float height = vert[1];
+			Vec3f normal(nx[x], ny[x], nz[x]);
+			
+			float weights[3] = {1, 0, 0};
+			if (splatMap != NULL) {
+				const unsigned char* pixel = splatPixel(splatMap, x, z, w, l);
+				float total = (float)(pixel[0] + pixel[1] + pixel[2]);
+				if (total > 0) {
+					for(int i = 0; i < 3; i++) {
+						weights[i] = pixel[i] / total;
+					}
+				}
+			}
+			float color[3];
+			for(int i = 0; i < 3; i++) {
+				color[i] = palette.layers[0][i] * weights[0] +
+					palette.layers[1][i] * weights[1] +
+					palette.layers[2][i] * weights[2];
+			}
+			
+			float slope = 1 - normal[1];
+			float rock = ramp(slope, palette.rockSlope[0], palette.rockSlope[1]);
+			float peak = ramp((height - minHeight) / heightRange,
+							  palette.peakHeight[0], palette.peakHeight[1]);
+			for(int i = 0; i < 3; i++) {
+				color[i] += (palette.rock[i] - color[i]) * rock;
+				color[i] += (palette.peak[i] - color[i]) * peak;
+				vert[6 + i] = color[i];
+			}
+			
+			if (lightmap != NULL) {
+				float baked = palette.skyLight * lightmap->skyLight(x, z) +
+					palette.sunLight * lightmap->sunLight(x, z);
+				float unshadowed = palette.skyLight + palette.sunLight *
+					max(0.0f, normal.dot(lightmap->sunDirection()));
+				float scale = unshadowed > 0 ? baked / unshadowed : 0;
+				for(int i = 0; i < 3; i++) {
+					vert[6 + i] *= scale;
+				}
+			}
+		}
+	}
+}
+
+void TerrainMesh::draw(const RenderBackend* backend) const {
+	if (backend == NULL) {
+		backend = openGLBackend();
+	}
+	TriangleBatch batch = {&verts[0], (int)verts.size() / 9, 9, 3, 6, -1,
+						   &indices[0], (int)indices.size()};
+	backend->drawTriangles(batch);
+}
@@ -0,0 +1,82 @@
+#ifndef TERRAIN_MESH_H_INCLUDED
+#define TERRAIN_MESH_H_INCLUDED
+
+#include <vector>
+
+#include "imageloader.h"
+#include "renderqueue.h"
+#include "terrain.h"
+#include "terrainlight.h"
+#include "threadpool.h"
+
+/* How the terrain is coloured.  A splat map gives each vertex a mix of the
+ * three base layers, in proportion to its red, green and blue; without one,
+ * every vertex is the first layer.  Rules then blend in rock on steep slopes
+ * and a peak colour high up.  Slopes are measured as 1 minus the y of the
+ * normal, so 0 is flat and 1 is a cliff, and heights as a fraction of the way
+ * from the lowest point of the terrain to the highest.  Each rule's colour
+ * fades in from the first of its two values to the second.  skyLight and
+ * sunLight are how bright the ambient light and the sun are when the terrain
+ * is drawn, which a lightmap needs to know.
+ */
+struct TerrainPalette {
+	float layers[3][3];
+	float rock[3];
+	float rockSlope[2];
+	float peak[3];
+	float peakHeight[2];
+	float skyLight;
+	float sunLight;
+};
+
+//Returns the palette the game uses: dirt, grass and water layers, grey rock
+//on the steepest slopes and pale peaks, lit as brightly as the game's lights
+const TerrainPalette &defaultTerrainPalette();
+
+/* The terrain's triangles, built once from its heights and normals, so that
+ * drawing it is one indexed batch rather than a strip of immediate mode calls
+ * per row.  Each vertex's colour is baked in from the palette, so how the
+ * terrain is painted costs nothing per frame.  Doesn't use OpenGL to build,
+ * so it may be made on any thread.
+ */
+class TerrainMesh {
+	private:
+		std::vector<float> verts; //x, y, z, nx, ny, nz, r, g, b for each vertex
+		std::vector<unsigned int> indices;
+		
+		void paintRows(Terrain* terrain, const Image* splatMap,
+					   const TerrainPalette &palette,
+					   const TerrainLightmap* lightmap, float minHeight,
+					   float maxHeight, int firstRow, int lastRow);
+	public:
+		/* Builds the mesh, painted by splatMap, which is stretched over the
+		 * whole terrain, and the palette's rules.  splatMap may be NULL.  If
+		 * lightmap isn't NULL, each colour is scaled by the baked light over
+		 * the light the palette's sky and sun would give the vertex unshadowed,
+		 * so that drawn lit by them, it gets the baked light, and other
+		 * lights such as the headlight still light it.  If pool isn't NULL,
+		 * the vertices are painted on it.
+		 */
+		TerrainMesh(Terrain* terrain, const Image* splatMap = NULL,
+					const TerrainPalette &palette = defaultTerrainPalette(),
+					const TerrainLightmap* lightmap = NULL,
+					ThreadPool* pool = NULL);
+		
+		int numVertices() const {
+			return (int)verts.size() / 9;
+		}
+		
+		//Returns the interleaved vertex data, nine floats per vertex
+		const float* vertices() const {
+			return &verts[0];
+		}
+		
+		int numTriangles() const {
+			return (int)indices.size() / 3;
+		}
+		
+		//Draws the mesh through backend, or through OpenGL if it's NULL
+		void draw(const RenderBackend* backend = NULL) const;
+};
+
+#endif
@@ -91,7 +91,11 @@
  */
 
 #include <fstream>
+#include <list>
 #include <math.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
 
 #ifdef __APPLE__
 #include <OpenGL/OpenGL.h>
@@ -100,6 +104,7 @@
 #include <GL/glut.h>
 #endif
 
+#include "glstate.h"
 #include "text3d.h"
 
 using namespace std;
@@ -217,12 +222,161 @@ namespace {
 	
 	const float PI_TIMES_2_OVER_65536 = 2 * 3.1415926535f / 65536.0f;
 	
+	//Collects triangles from a series of vertices in the style of glBegin,
+	//converting triangle strips into separate triangles
+	class TriangleBuilder {
+		private:
+			vector<float> &out; //Gets six floats per vertex
+			bool strip;
+			int count; //The number of vertices since the last begin
+			float prev[3][6];
+			
+			void emit(const float* a, const float* b, const float* c) {
+				out.insert(out.end(), a, a + 6);
+				out.insert(out.end(), b, b + 6);
+				out.insert(out.end(), c, c + 6);
+			}
+		public:
+			TriangleBuilder(vector<float> &out1) :
+				out(out1), strip(false), count(0) {
+			}
+			
+			//Starts a new GL_TRIANGLES or GL_TRIANGLE_STRIP primitive
+			void begin(bool isStrip) {
+				strip = isStrip;
+				count = 0;
+			}
+			
+			void vertex(const float* v) {
+				if (strip) {
+					//Every other triangle in a strip is wound the other way
+					if (count >= 2) {
+						if (count % 2 == 0) {
+							emit(prev[0], prev[1], v);
+						}
+						else {
+							emit(prev[1], prev[0], v);
+						}
+					}
+					memcpy(prev[0], prev[1], sizeof(prev[0]));
+					memcpy(prev[1], v, sizeof(prev[1]));
+				}
+				else if (count % 3 == 2) {
+					emit(prev[0], prev[1], v);
+				}
+				else {
+					memcpy(prev[count % 3], v, sizeof(prev[0]));
+				}
+				count++;
+			}
+	};
+	
+	/* Reads one part of a character model, appending its triangles to tris as
+	 * (x, y, z, nx, ny, nz) vertices.  Vertices on the front face have z = 0
+	 * and vertices on the back face have z = -1.  Back face vertices and
+	 * normals are only allowed in the 3D part.
+	 */
+	void readPart(ifstream &input,
+				  const float* verts,
+				  int numVerts,
+				  bool is3DPart,
+				  vector<float> &tris) {
+		char buffer[2];
+		input.read(buffer, 2);
+		unsigned short opcode = toUShort(buffer);
+		if (opcode != OP_TRIANGLES && opcode != OP_TRIANGLE_STRIP) {
+			throw T3DLoadException("Invalid font file");
+		}
+		TriangleBuilder builder(tris);
+		builder.begin(opcode == OP_TRIANGLE_STRIP);
+		
+		float vertex[6] = {0, 0, 0, 0, 0, 1};
+		
+		//Prevents excessive iteration or infinite loops on invalid font files
+		int limit = 10000;
+		
+		while(true) {
+			input.read(buffer, 2);
+			if (input.fail()) {
+				throw T3DLoadException("Invalid font file");
+			}
+			opcode = toUShort(buffer);
+			switch(opcode) {
+				case OP_TRIANGLES:
+					builder.begin(false);
+					break;
+				case OP_TRIANGLE_STRIP:
+					builder.begin(true);
+					break;
+				case OP_NORMAL: {
+					if (!is3DPart) {
+						throw T3DLoadException("Invalid font file");
+					}
+					input.read(buffer, 2);
+					float angle = toUShort(buffer) * PI_TIMES_2_OVER_65536;
+					vertex[3] = cos(angle);
+					vertex[4] = sin(angle);
+					vertex[5] = 0;
+					break;
+				}
+				case OP_END_PART:
+					return;
+				default: {
+					int index = opcode;
+					vertex[2] = 0;
+					if (index >= numVerts) {
+						if (!is3DPart || index >= 2 * numVerts) {
+							throw T3DLoadException("Invalid font file");
+						}
+						index -= numVerts;
+						vertex[2] = -1;
+					}
+					vertex[0] = verts[2 * index];
+					vertex[1] = verts[2 * index + 1];
+					builder.vertex(vertex);
+					break;
+				}
+			}
+			
+			if (--limit == 0) {
+				throw T3DLoadException("Invalid font file");
+			}
+		}
+	}
+	
+	/* Appends the triangles in src to dest, with z mapped to zScale * z +
+	 * zOffset and the normal's z multiplied by zScale, the way glTranslatef
+	 * and glScalef would.  If reverse is true, the winding of each triangle is
+	 * reversed, which has the same effect as drawing it with glFrontFace(GL_CW)
+	 * instead of GL_CCW.
+	 */
+	void appendTransformed(const vector<float> &src,
+						   float zScale, float zOffset,
+						   bool reverse,
+						   vector<float> &dest) {
+		for(size_t i = 0; i + 18 <= src.size(); i += 18) {
+			for(int j = 0; j < 3; j++) {
+				const float* v = &src[i + 6 * (reverse && j > 0 ? 3 - j : j)];
+				dest.push_back(v[0]);
+				dest.push_back(v[1]);
+				dest.push_back(zScale * v[2] + zOffset);
+				dest.push_back(v[3]);
+				dest.push_back(v[4]);
+				dest.push_back(zScale * v[5]);
+			}
+		}
+	}
+	
 	class T3DFont {
 		private:
 			float spaceWidth;
 			float widths[94];
-			GLuint displayListId2D;
-			GLuint displayListId3D;
+			//The triangles of the characters, as (x, y, z, nx, ny, nz)
+			//vertices.  Character i uses vertices start[i] to start[i + 1].
+			vector<float> verts2D;
+			vector<float> verts3D;
+			int start2D[95];
+			int start3D[95];
 		public:
 			//Loads the specified font file into a new T3DFont object
 			T3DFont(ifstream &input) {
@@ -242,8 +396,8 @@ namespace {
 				input.read(buffer, 5);
 				spaceWidth = toFloat(buffer);
 				
-				displayListId2D = glGenLists(94);
-				displayListId3D = glGenLists(94);
+				vector<float> face;
+				vector<float> sides;
 				for(int i = 0; i < 94; i++) {
 					input.read(buffer, 5);
 					float scale = toFloat(buffer) / 65536;
@@ -266,132 +420,27 @@ namespace {
 					}
 					
 					//Face part of the model
-					glNewList(displayListId2D + i, GL_COMPILE);
-					
-					glNormal3f(0, 0, 1);
-					
-					input.read(buffer, 2);
-					unsigned short opcode = toUShort(buffer);
-					switch(opcode) {
-						case OP_TRIANGLES:
-							glBegin(GL_TRIANGLES);
-							break;
-						case OP_TRIANGLE_STRIP:
-							glBegin(GL_TRIANGLE_STRIP);
-							break;
-						default:
-							throw T3DLoadException("Invalid font file");
-					}
-					
-					//Prevents excessive iteration or infinite loops on invalid
-					//font files
-					int limit = 10000;
-					
-					while(true) {
-						input.read(buffer, 2);
-						opcode = toUShort(buffer);
-						switch(opcode) {
-							case OP_TRIANGLES:
-								glEnd();
-								glBegin(GL_TRIANGLES);
-								break;
-							case OP_TRIANGLE_STRIP:
-								glEnd();
-								glBegin(GL_TRIANGLE_STRIP);
-								break;
-							case OP_END_PART:
-								goto BreakOuter;
-							default:
-								glVertex3f(verts2[2 * opcode],
-										   verts2[2 * opcode + 1],
-										   0);
-								break;
-						}
-						
-						if (--limit == 0) {
-							glEndList();
-							throw T3DLoadException("Invalid font file");
-						}
-					}
-BreakOuter:
-					glEnd();
-					glEndList();
-					
-					//3D part of the model
-					glNewList(displayListId3D + i, GL_COMPILE);
-					glPushMatrix();
-					glTranslatef(0, 0, 0.5f);
-					glFrontFace(GL_CW);
-					glCallList(displayListId2D + i);
-					glTranslatef(0, 0, -1);
-					glScalef(1, 1, -1);
-					glFrontFace(GL_CCW);
-					glCallList(displayListId2D + i);
-					glFrontFace(GL_CW);
+					face.clear();
+					readPart(input, verts2, numVerts, false, face);
+					start2D[i] = (int)verts2D.size() / 6;
+					verts2D.insert(verts2D.end(), face.begin(), face.end());
 					
-					input.read(buffer, 2);
-					opcode = toUShort(buffer);
-					switch(opcode) {
-						case OP_TRIANGLES:
-							glBegin(GL_TRIANGLES);
-							break;
-						case OP_TRIANGLE_STRIP:
-							glBegin(GL_TRIANGLE_STRIP);
-							break;
-						default:
-							throw T3DLoadException("Invalid font file");
-					}
-					
-					limit = 10000;
-					while(true) {
-						input.read(buffer, 2);
-						opcode = toUShort(buffer);
-						switch(opcode) {
-							case OP_TRIANGLES:
-								glEnd();
-								glBegin(GL_TRIANGLES);
-								break;
-							case OP_TRIANGLE_STRIP:
-								glEnd();
-								glBegin(GL_TRIANGLE_STRIP);
-								break;
-							case OP_NORMAL:
-								input.read(buffer, 2);
-								float angle;
-								angle = toUShort(buffer) *
-									PI_TIMES_2_OVER_65536;
-								float x, y;
-								x = cos(angle);
-								y = sin(angle);
-								glNormal3f(x, y, 0);
-								break;
-							case OP_END_PART:
-								goto BreakOuter2;
-							default:
-								if (opcode < numVerts) {
-									glVertex3f(verts2[2 * opcode],
-											   verts2[2 * opcode + 1],
-											   0);
-								}
-								else {
-									glVertex3f(verts2[2 * (opcode - numVerts)],
-											   verts2[2 * (opcode - numVerts) +
-													  1],
-											   -1);
-								}
-								break;
-						}
-						
-						if (--limit == 0) {
-							glEndList();
-							throw T3DLoadException("Invalid font file");
-						}
-					}
-BreakOuter2:
-					glEnd();
-					glPopMatrix();
-					glEndList();
+					/* 3D part of the model.  This bakes in what the old
+					 * display lists did: the face is drawn at z = 0.5 with
+					 * glFrontFace(GL_CW), then again under
+					 * glTranslatef(0, 0, -0.5) and glScalef(1, 1, -1) with
+					 * GL_CCW, and the sides under the same transformation
+					 * with GL_CW.
+					 */
+					sides.clear();
+					readPart(input, verts2, numVerts, true, sides);
+					start3D[i] = (int)verts3D.size() / 6;
+					appendTransformed(face, 1, 0.5f, true, verts3D);
+					appendTransformed(face, -1, -0.5f, false, verts3D);
+					appendTransformed(sides, -1, -0.5f, true, verts3D);
 				}
+				start2D[94] = (int)verts2D.size() / 6;
+				start3D[94] = (int)verts3D.size() / 6;
 				
 				if (input.fail()) {
 					throw T3DLoadException("Invalid font file");
@@ -402,15 +451,26 @@ BreakOuter2:
 				}
 			}
 			
-			void draw2D(char c) {
-				if (c >= 33 && c <= 126) {
-					glCallList(displayListId2D + c - '!');
+			//Appends the triangles for c, centered at (x, y, 0), to verts
+			void append(char c, float x, float y, bool is3D,
+						vector<float> &verts) {
+				if (c < 33 || c > 126) {
+					return;
 				}
-			}
-			
-			void draw3D(char c) {
-				if (c >= 33 && c <= 126) {
-					glCallList(displayListId3D + c - '!');
+				const vector<float> &src = is3D ? verts3D : verts2D;
+				const int* start = is3D ? start3D : start2D;
+				const float* v = &src[0] + 6 * start[c - 33];
+				const float* end = &src[0] + 6 * start[c - 32];
+				size_t offset = verts.size();
+				verts.resize(offset + (end - v));
+				float* dest = &verts[offset];
+				for(; v < end; v += 6, dest += 6) {
+					dest[0] = v[0] + x;
+					dest[1] = v[1] + y;
+					dest[2] = v[2];
+					dest[3] = v[3];
+					dest[4] = v[4];
+					dest[5] = v[5];
 				}
 			}
 			
@@ -426,83 +486,201 @@ BreakOuter2:
 	
 	T3DFont* font = NULL; //The font used to draw 2D and 3D characters
 	
-	void draw2D(char c) {
-		font->draw2D(c);
-	}
-	
-	void draw3D(char c) {
-		font->draw3D(c);
-	}
-	
-	void drawLine(const char* str, int hAlign, void (*drawFunc)(char)) {
-		glPushMatrix();
-		if (hAlign >= 0) {
-			float width = 0;
-			for(int i = 0; str[i] != '\n' && str[i] != '\0'; i++) {
-				width += font->width(str[i]);
-			}
-			glTranslatef(hAlign > 0 ? -width : -width / 2, 0, 0);
+	//Measures str into layout, reusing layout's memory
+	void layoutString(string_view str, float lineHeight, T3DLayout &layout) {
+		size_t end = str.find('\0');
+		if (end != string_view::npos) {
+			str = str.substr(0, end);
 		}
 		
-		for(int i = 0; str[i] != '\n' && str[i] != '\0'; i++) {
+		layout.text.assign(str.data(), str.size());
+		layout.lineHeight = lineHeight;
+		layout.lineStarts.clear();
+		layout.lineWidths.clear();
+		layout.offsets.resize(str.size());
+		layout.width = 0;
+		
+		float x = 0;
+		layout.lineStarts.push_back(0);
+		for(size_t i = 0; i < str.size(); i++) {
+			if (str[i] == '\n') {
+				layout.lineWidths.push_back(x);
+				layout.lineStarts.push_back((int)i + 1);
+				layout.offsets[i] = x;
+				x = 0;
+				continue;
+			}
+			
 			float width = font->width(str[i]);
-			glTranslatef(width / 2, 0, 0);
-			drawFunc(str[i]);
-			glTranslatef(width / 2, 0, 0);
+			layout.offsets[i] = x + width / 2;
+			x += width;
 		}
+		layout.lineWidths.push_back(x);
 		
-		glPopMatrix();
+		for(size_t i = 0; i < layout.lineWidths.size(); i++) {
+			if (layout.lineWidths[i] > layout.width) {
+				layout.width = layout.lineWidths[i];
+			}
+		}
+		layout.height = lineHeight * (layout.lineWidths.size() - 1) + 1;
 	}
 	
-	void draw(const char* str,
-			  int hAlign, int vAlign,
-			  float lineHeight,
-			  void (*drawFunc)(char)) {
-		GLint shadeModel;
-		glGetIntegerv(GL_SHADE_MODEL, &shadeModel);
-		glShadeModel(GL_SMOOTH);
-		GLboolean lightsEnabled;
-		glGetBooleanv(GL_LIGHTING, &lightsEnabled);
-		GLboolean normalsWereNormalized;
-		glGetBooleanv(GL_NORMALIZE, &normalsWereNormalized);
-		if (lightsEnabled) {
-			glEnable(GL_NORMALIZE);
-		}
-		else {
-			glDisable(GL_NORMALIZE);
-		}
+	//Replaces verts with the triangles for the layout, positioned the way
+	//t3dDraw2D or t3dDraw3D draws it
+	void buildMesh(const T3DLayout &layout,
+				   int hAlign, int vAlign,
+				   bool is3D,
+				   vector<float> &verts) {
+		verts.clear();
 		
-		glPushMatrix();
+		float y = -0.5f;
 		if (vAlign >= 0) {
-			int numLines = 1;
-			for(int i = 0; str[i] != '\0'; i++) {
-				if (str[i] == '\n') {
-					numLines++;
-				}
+			y += vAlign > 0 ? layout.height : layout.height / 2;
+		}
+		
+		int numLines = (int)layout.lineStarts.size();
+		for(int line = 0; line < numLines; line++) {
+			float x = 0;
+			if (hAlign >= 0) {
+				float width = layout.lineWidths[line];
+				x = hAlign > 0 ? -width : -width / 2;
 			}
 			
-			float height = lineHeight * (numLines - 1) + 1;
-			glTranslatef(0, vAlign > 0 ? height : height / 2, 0);
+			int end = line + 1 < numLines ?
+				layout.lineStarts[line + 1] - 1 : (int)layout.text.size();
+			for(int i = layout.lineStarts[line]; i < end; i++) {
+				font->append(layout.text[i], x + layout.offsets[i], y, is3D,
+							 verts);
+			}
+			y -= layout.lineHeight;
 		}
+	}
+	
+	/* A least recently used cache of layouts, and the last mesh made from
+	 * each, for the functions that take strings.  A HUD that draws the same
+	 * few strings every frame finds them here, so it doesn't measure or
+	 * build anything.
+	 */
+	class LayoutCache {
+		private:
+			struct Entry {
+				T3DLayout layout;
+				vector<float> verts;
+				bool hasMesh; //Whether verts is up to date
+				bool is3D;
+				int hAlign;
+				int vAlign;
+			};
+			
+			list<Entry> entries; //Most recently used first
+			unordered_map<string_view, list<Entry>::iterator> index;
+			size_t capacity;
+		public:
+			LayoutCache() : capacity(64) {
+			}
+			
+			void setCapacity(size_t capacity1) {
+				capacity = capacity1 > 0 ? capacity1 : 1;
+				while (entries.size() > capacity) {
+					index.erase(entries.back().layout.text);
+					entries.pop_back();
+				}
+			}
+			
+			void clear() {
+				index.clear();
+				entries.clear();
+			}
+			
+			//Returns the entry for the string, measuring it if needed.  If
+			//lineHeight is negative, any line height will do.
+			Entry &find(string_view str, float lineHeight) {
+				size_t end = str.find('\0');
+				if (end != string_view::npos) {
+					str = str.substr(0, end);
+				}
+				
+				unordered_map<string_view, list<Entry>::iterator>::iterator it =
+					index.find(str);
+				if (it != index.end()) {
+					entries.splice(entries.begin(), entries, it->second);
+					Entry &entry = entries.front();
+					if (lineHeight >= 0 && entry.layout.lineHeight != lineHeight) {
+						index.erase(it);
+						layoutString(str, lineHeight, entry.layout);
+						entry.hasMesh = false;
+						index[entry.layout.text] = entries.begin();
+					}
+					return entry;
+				}
+				
+				//Reuse the least recently used entry's memory if we're full
+				if (entries.size() >= capacity) {
+					index.erase(entries.back().layout.text);
+					entries.splice(entries.begin(), entries, --entries.end());
+				}
+				else {
+					entries.push_front(Entry());
+				}
+				Entry &entry = entries.front();
+				layoutString(str, lineHeight >= 0 ? lineHeight : 1.5f,
+							 entry.layout);
+				entry.hasMesh = false;
+				index[entry.layout.text] = entries.begin();
+				return entry;
+			}
+			
+			//Returns the triangles for the string, building them if needed
+			const vector<float> &mesh(string_view str,
+									  int hAlign, int vAlign,
+									  float lineHeight,
+									  bool is3D) {
+				Entry &entry = find(str, lineHeight);
+				if (!entry.hasMesh || entry.is3D != is3D ||
+					entry.hAlign != hAlign || entry.vAlign != vAlign) {
+					buildMesh(entry.layout, hAlign, vAlign, is3D, entry.verts);
+					entry.hasMesh = true;
+					entry.is3D = is3D;
+					entry.hAlign = hAlign;
+					entry.vAlign = vAlign;
+				}
+				return entry.verts;
+			}
+	};
+	
+	LayoutCache cache;
+	
+	//Draws the triangles in a single call, with the state that the old
+	//character display lists used
+	void drawMesh(const vector<float> &verts, bool is3D, float depth) {
+		GLenum shadeModel = glsGetShadeModel();
+		bool normalsWereNormalized = glsIsEnabled(GL_NORMALIZE);
+		bool wasCulling = glsIsEnabled(GL_CULL_FACE);
+		GLenum frontFace = glsGetFrontFace();
+		glsShadeModel(GL_SMOOTH);
+		glsSetEnabled(GL_NORMALIZE, glsIsEnabled(GL_LIGHTING));
+		glsSetEnabled(GL_CULL_FACE, is3D);
+		glsFrontFace(GL_CCW);
 		
-		glTranslatef(0, -0.5f, 0);
-		drawLine(str, hAlign, drawFunc);
-		for(int i = 0; str[i] != '\0'; i++) {
-			if (str[i] == '\n') {
-				glTranslatef(0, -lineHeight, 0);
-				drawLine(str + i + 1, hAlign, drawFunc);
+		if (!verts.empty()) {
+			glPushMatrix();
+			if (is3D) {
+				glScalef(1, 1, depth);
 			}
+			glEnableClientState(GL_VERTEX_ARRAY);
+			glEnableClientState(GL_NORMAL_ARRAY);
+			glVertexPointer(3, GL_FLOAT, 6 * sizeof(float), &verts[0]);
+			glNormalPointer(GL_FLOAT, 6 * sizeof(float), &verts[3]);
+			glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(verts.size() / 6));
+			glDisableClientState(GL_NORMAL_ARRAY);
+			glDisableClientState(GL_VERTEX_ARRAY);
+			glPopMatrix();
 		}
 		
-		glPopMatrix();
-		
-		glShadeModel(shadeModel);
-		if (normalsWereNormalized) {
-			glEnable(GL_NORMALIZE);
-		}
-		else {
-			glDisable(GL_NORMALIZE);
-		}
+		glsShadeModel(shadeModel);
+		glsSetEnabled(GL_NORMALIZE, normalsWereNormalized);
+		glsSetEnabled(GL_CULL_FACE, wasCulling);
+		glsFrontFace(frontFace);
 	}
 }
 
@@ -516,77 +694,84 @@ void t3dInit() {
 }
 
 void t3dCleanup() {
+	cache.clear();
 	delete font;
+	font = NULL;
 }
 
-void t3dDraw2D(string str, int hAlign, int vAlign, float lineHeight) {
-	GLboolean wasCulling;
-	glGetBooleanv(GL_CULL_FACE, &wasCulling);
-	glDisable(GL_CULL_FACE);
-	
-	draw(str.c_str(), hAlign, vAlign, lineHeight, draw2D);
-	
-	if (wasCulling) {
-		glEnable(GL_CULL_FACE);
-	}
+void t3dDraw2D(string_view str, int hAlign, int vAlign, float lineHeight) {
+	drawMesh(cache.mesh(str, hAlign, vAlign, lineHeight, false), false, 1);
 }
 
-void t3dDraw3D(string str,
+void t3dDraw3D(string_view str,
 			   int hAlign, int vAlign,
 			   float depth,
 			   float lineHeight) {
-	GLboolean wasCulling;
-	glGetBooleanv(GL_CULL_FACE, &wasCulling);
-	glEnable(GL_CULL_FACE);
-	GLint frontFace;
-	glGetIntegerv(GL_FRONT_FACE, &frontFace);
-	
-	glPushMatrix();
-	glScalef(1, 1, depth);
-	draw(str.c_str(), hAlign, vAlign, lineHeight, draw3D);
-	glPopMatrix();
-	
-	if (!wasCulling) {
-		glDisable(GL_CULL_FACE);
-	}
-	glFrontFace(frontFace);
+	drawMesh(cache.mesh(str, hAlign, vAlign, lineHeight, true), true, depth);
 }
 
-float t3dDrawWidth(string str) {
-	float bestWidth = 0;
-	int i = 0;
-	while (str[i] != '\0') {
-		float width = 0;
-		while (str[i] != '\n' && str[i] != '\0') {
-			width += font->width(str[i]);
-			i++;
-		}
-		if (width > bestWidth) {
-			bestWidth = width;
-		}
-		if (str[i] != '\0') {
-			i++;
-		}
-	}
-	return bestWidth;
+void t3dDraw2D(const T3DLayout &layout, int hAlign, int vAlign) {
+	//Reused so that this doesn't allocate memory once it has grown enough
+	static vector<float> verts;
+	buildMesh(layout, hAlign, vAlign, false, verts);
+	drawMesh(verts, false, 1);
 }
 
-float t3dDrawHeight(string str, float lineHeight) {
-	int numLines = 1;
-	for(int i = 0; str[i] != '\0'; i++) {
-		if (str[i] == '\n') {
-			numLines++;
-		}
-	}
-	
-	return (numLines - 1) * lineHeight + 1;
+void t3dDraw3D(const T3DLayout &layout, int hAlign, int vAlign, float depth) {
+	static vector<float> verts;
+	buildMesh(layout, hAlign, vAlign, true, verts);
+	drawMesh(verts, true, depth);
 }
 
+T3DLayout t3dMakeLayout(string_view str, float lineHeight) {
+	T3DLayout layout;
+	layoutString(str, lineHeight, layout);
+	return layout;
+}
 
+T3DMesh* t3dMake2D(const T3DLayout &layout, int hAlign, int vAlign) {
+	T3DMesh* mesh = new T3DMesh();
+	buildMesh(layout, hAlign, vAlign, false, mesh->vertices);
+	mesh->is3D = false;
+	mesh->depth = 1;
+	return mesh;
+}
 
+T3DMesh* t3dMake3D(const T3DLayout &layout,
+				   int hAlign, int vAlign,
+				   float depth) {
+	T3DMesh* mesh = new T3DMesh();
+	buildMesh(layout, hAlign, vAlign, true, mesh->vertices);
+	mesh->is3D = true;
+	mesh->depth = depth;
+	return mesh;
+}
 
+T3DMesh* t3dMake2D(string_view str,
+				   int hAlign, int vAlign,
+				   float lineHeight) {
+	return t3dMake2D(t3dMakeLayout(str, lineHeight), hAlign, vAlign);
+}
 
+T3DMesh* t3dMake3D(string_view str,
+				   int hAlign, int vAlign,
+				   float depth,
+				   float lineHeight) {
+	return t3dMake3D(t3dMakeLayout(str, lineHeight), hAlign, vAlign, depth);
+}
 
+void t3dDrawMesh(const T3DMesh* mesh) {
+	drawMesh(mesh->vertices, mesh->is3D, mesh->depth);
+}
 
+float t3dDrawWidth(string_view str) {
+	return cache.find(str, -1).layout.width;
+}
 
+float t3dDrawHeight(string_view str, float lineHeight) {
+	return cache.find(str, lineHeight).layout.height;
+}
 
+void t3dSetCacheSize(int numStrings) {
+	cache.setCapacity(numStrings);
+}
@@ -26,6 +26,8 @@
 #define TEXT_3D_H_INCLUDED
 
 #include <string>
+#include <string_view>
+#include <vector>
 
 //Initializes 3D text.  Must be called before other functions in this header.
 void t3dInit();
@@ -51,7 +53,7 @@ void t3dCleanup();
  * 
  * All unprintable ASCII characters (other than '\n') are drawn as spaces.
  */
-void t3dDraw2D(std::string str,
+void t3dDraw2D(std::string_view str,
 			   int hAlign, int vAlign,
 			   float lineHeight = 1.5f);
 /* Draws the specified string, using OpenGL, using polygons as a right prism,
@@ -74,24 +76,81 @@ void t3dDraw2D(std::string str,
  * 
  * All unprintable ASCII characters (other than '\n') are drawn as spaces.
  */
-void t3dDraw3D(std::string str,
+void t3dDraw3D(std::string_view str,
 			   int hAlign, int vAlign,
 			   float depth,
 			   float lineHeight = 1.5f);
+
+/* The measurements of a string, as the functions in this header draw it: where
+ * its lines start, how wide each line is and where each character goes.
+ * Measuring a string once and keeping its layout saves measuring it every time
+ * it is drawn.  Made by t3dMakeLayout.
+ */
+class T3DLayout {
+	public:
+		std::string text;
+		float lineHeight;
+		//The index in text of the first character of each line
+		std::vector<int> lineStarts;
+		std::vector<float> lineWidths;
+		//The distance from the start of its line to the center of each
+		//character
+		std::vector<float> offsets;
+		float width;  //The width of the widest line, as in t3dDrawWidth
+		float height; //As in t3dDrawHeight
+};
+
+//Measures the specified string.  The line height is as in t3dDraw2D.
+T3DLayout t3dMakeLayout(std::string_view str, float lineHeight = 1.5f);
+//Draws a measured string, as t3dDraw2D and t3dDraw3D would draw its text
+void t3dDraw2D(const T3DLayout &layout, int hAlign, int vAlign);
+void t3dDraw3D(const T3DLayout &layout, int hAlign, int vAlign, float depth);
+
+/* The functions that take strings keep the layouts, and the triangles, for the
+ * strings they have seen most recently, so that redrawing the same string is
+ * cheap.  This sets how many strings are kept; the default is 64.
+ */
+void t3dSetCacheSize(int numStrings);
+//A string that has been converted to triangles, so that it can be drawn again
+//and again with a single draw call.  Made by t3dMake2D and t3dMake3D.
+class T3DMesh {
+	public:
+		//(x, y, z, nx, ny, nz) for each vertex of each triangle
+		std::vector<float> vertices;
+		bool is3D;
+		float depth;
+};
+
+//Returns a mesh that draws the specified string as t3dDraw2D would
+T3DMesh* t3dMake2D(std::string_view str,
+				   int hAlign, int vAlign,
+				   float lineHeight = 1.5f);
+T3DMesh* t3dMake2D(const T3DLayout &layout, int hAlign, int vAlign);
+//Returns a mesh that draws the specified string as t3dDraw3D would
+T3DMesh* t3dMake3D(std::string_view str,
+				   int hAlign, int vAlign,
+				   float depth,
+				   float lineHeight = 1.5f);
+T3DMesh* t3dMake3D(const T3DLayout &layout,
+				   int hAlign, int vAlign,
+				   float depth);
+//Draws a mesh made by t3dMake2D or t3dMake3D
+void t3dDrawMesh(const T3DMesh* mesh);
+
 /* Returns the draw width of the specified string, as a multiple of the height
  * of the font.  The height of the font is the "normal" height of capital
  * letters, rather than the distance from the top of "normal" capital letters to
  * the bottom of lowercase letters like "p".  The width is the same as the width
  * of the longest line.
  */
-float t3dDrawWidth(std::string str);
+float t3dDrawWidth(std::string_view str);
 /* Returns the draw height of the specified string, as a multiple of the height
  * of the font.  The height of the font is the "normal" height of capital
  * letters, rather than the distance from the top of "normal" capital letters to
  * the bottom of lowercase letters like "p".  The draw is lineHeight times one
  * fewer than the number of lines in the string, plus 1.
  */
-float t3dDrawHeight(std::string str, float lineHeight = 1.5f);
+float t3dDrawHeight(std::string_view str, float lineHeight = 1.5f);
 
 //Indicates that an exception occurred when setting up 3D text
 class T3DLoadException {
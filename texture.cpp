@@ -0,0 +1,123 @@
+#include "glstate.h"
+#include "texture.h"
+
+using namespace std;
+
+Image* halveImage(const Image* image) {
+	int width = image->width / 2 > 0 ? image->width / 2 : 1;
+	int height = image->height / 2 > 0 ? image->height / 2 : 1;
+	char* pixels = new char[width * height * 3];
+	
+	const unsigned char* src = (const unsigned char*)image->pixels;
+	unsigned char* dest = (unsigned char*)pixels;
+	int srcRow = image->width * 3;
+	for(int y = 0; y < height; y++) {
+		const unsigned char* row1 = src + srcRow * (2 * y);
+		const unsigned char* row2 =
+			src + srcRow * (2 * y + 1 < image->height ? 2 * y + 1 : 2 * y);
+		for(int x = 0; x < width; x++) {
+			int x1 = 3 * (2 * x);
+			int x2 = 3 * (2 * x + 1 < image->width ? 2 * x + 1 : 2 * x);
+			for(int c = 0; c < 3; c++) {
+				*dest++ = (unsigned char)((row1[x1 + c] + row1[x2 + c] +
+										   row2[x1 + c] + row2[x2 + c] +
+										   2) / 4);
+			}
+		}
+	}
+	
+	return new Image(pixels, width, height);
+}
+
+vector<Image*> buildMipmaps(const Image* image) {
+	vector<Image*> levels;
+	const Image* level = image;
+	while (level->width > 1 || level->height > 1) {
+		level = halveImage(level);
+		levels.push_back((Image*)level);
+	}
+	return levels;
+}
+
+TextureManager::TextureManager() {
+	
+}
+
+GLuint TextureManager::load(const char* filename) {
+	GLuint textureId = find(filename);
+	if (textureId != 0) {
+		return textureId;
+	}
+	
+	Image* image = loadBMP(filename);
+	if (image == NULL) {
+		return 0;
+	}
+	textureId = upload(filename, image);
+	delete image;
+	return textureId;
+}
+
+GLuint TextureManager::upload(const char* name, const Image* image) {
+	GLuint textureId = find(name);
+	if (textureId != 0) {
+		return textureId;
+	}
+	
+	glGenTextures(1, &textureId);
+	bind(textureId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+					GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	
+	//Rows of RGB pixels aren't padded to four bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D,
+				 0,
+				 GL_RGB,
+				 image->width, image->height,
+				 0,
+				 GL_RGB,
+				 GL_UNSIGNED_BYTE,
+				 image->pixels);
+	vector<Image*> mipmaps = buildMipmaps(image);
+	for(size_t i = 0; i < mipmaps.size(); i++) {
+		glTexImage2D(GL_TEXTURE_2D,
+					 i + 1,
+					 GL_RGB,
+					 mipmaps[i]->width, mipmaps[i]->height,
+					 0,
+					 GL_RGB,
+					 GL_UNSIGNED_BYTE,
+					 mipmaps[i]->pixels);
+		delete mipmaps[i];
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	
+	textures[name] = textureId;
+	return textureId;
+}
+
+GLuint TextureManager::find(const char* name) const {
+	map<string, GLuint>::const_iterator it = textures.find(name);
+	return it != textures.end() ? it->second : 0;
+}
+
+void TextureManager::bind(GLuint textureId) {
+	glsBindTexture(textureId);
+}
+
+void TextureManager::clear() {
+	for(map<string, GLuint>::iterator it = textures.begin();
+		it != textures.end(); it++) {
+		glsDeleteTextures(1, &it->second);
+	}
+	textures.clear();
+}
+
+TextureManager &textureManager() {
+	static TextureManager manager;
+	return manager;
+}
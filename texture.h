@@ -0,0 +1,57 @@
+#ifndef TEXTURE_H_INCLUDED
+#define TEXTURE_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef __APPLE__
+#include <OpenGL/OpenGL.h>
+#include <GLUT/glut.h>
+#else
+#include <GL/glut.h>
+#endif
+
+#include "imageloader.h"
+
+/* Returns the next level of a mipmap chain for the image: half the width and
+ * height (rounded down, but at least 1), where each pixel is the average of
+ * the corresponding 2x2 box of pixels.  For odd sizes, the last row or column
+ * is repeated.  Does not use OpenGL.
+ */
+Image* halveImage(const Image* image);
+//Returns the mipmap chain below the image, from half its size down to 1x1.
+//The caller owns the returned images.
+std::vector<Image*> buildMipmaps(const Image* image);
+
+/* Owns the game's textures.  Textures are cached by file name, so loading the
+ * same file twice returns the same texture.  Every texture gets a full mipmap
+ * chain, built on the CPU, and its filtering is set up once, when it is made.
+ * Textures are bound through the GL state cache, so binding the bound texture
+ * again costs nothing.
+ */
+class TextureManager {
+	private:
+		std::map<std::string, GLuint> textures;
+	public:
+		TextureManager();
+		
+		//Returns the texture for the specified bitmap file, loading it if it
+		//isn't cached.  Returns 0 if the file couldn't be loaded.
+		GLuint load(const char* filename);
+		//Returns the texture cached under name, or makes image into a texture
+		//and caches it under name.  The image isn't deleted.
+		GLuint upload(const char* name, const Image* image);
+		//Returns the texture cached under name, or 0 if there isn't one
+		GLuint find(const char* name) const;
+		
+		//Binds the texture to GL_TEXTURE_2D, unless it's already bound
+		void bind(GLuint textureId);
+		//Deletes every texture
+		void clear();
+};
+
+//Returns the texture manager for the GL context
+TextureManager &textureManager();
+
+#endif
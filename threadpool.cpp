@@ -0,0 +1,144 @@
+#include <atomic>
+#include <memory>
+
+#include "threadpool.h"
+
+using namespace std;
+
+namespace {
+	//The indices that one thread of a parallelFor starts with.  Each is on its
+	//own cache line, so that threads claiming indices don't slow each other.
+	struct alignas(64) Share {
+		atomic<int> next;
+		int end;
+	};
+	
+	//The state of a parallelFor.  Workers hold on to it with a shared_ptr,
+	//because a worker may only get to its job after the loop has finished.
+	struct ParallelFor {
+		function<void(int)> body;
+		unique_ptr<Share[]> shares;
+		int numShares;
+		int count;
+		atomic<int> numDone;
+		std::mutex mutex;
+		condition_variable finished;
+	};
+	
+	//Runs indices from the given share until it's empty, then steals from the
+	//other shares in turn
+	void drain(ParallelFor &job, int first) {
+		for(int s = 0; s < job.numShares; s++) {
+			Share &share = job.shares[(first + s) % job.numShares];
+			int numRun = 0;
+			while (true) {
+				int i = share.next.fetch_add(1);
+				if (i >= share.end) {
+					break;
+				}
+				job.body(i);
+				numRun++;
+			}
+			if (numRun > 0 &&
+				job.numDone.fetch_add(numRun) + numRun == job.count) {
+				lock_guard<std::mutex> lock(job.mutex);
+				job.finished.notify_all();
+			}
+		}
+	}
+}
+
+ThreadPool::ThreadPool(int numThreads) : busy(0), stopping(false) {
+	if (numThreads <= 0) {
+		numThreads = (int)thread::hardware_concurrency();
+		if (numThreads <= 0) {
+			numThreads = 1;
+		}
+	}
+	for(int i = 0; i < numThreads; i++) {
+		threads.push_back(thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+}
+
+void ThreadPool::run(function<void()> job) {
+	{
+		lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(job);
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::wait() {
+	unique_lock<std::mutex> lock(mutex);
+	while (!jobs.empty() || busy > 0) {
+		idle.wait(lock);
+	}
+}
+
+void ThreadPool::parallelFor(int count, function<void(int)> body) {
+	int numShares = size() + 1;
+	if (numShares > count) {
+		numShares = count;
+	}
+	if (numShares <= 1) {
+		for(int i = 0; i < count; i++) {
+			body(i);
+		}
+		return;
+	}
+	
+	shared_ptr<ParallelFor> job = make_shared<ParallelFor>();
+	job->body = body;
+	job->shares.reset(new Share[numShares]);
+	job->numShares = numShares;
+	job->count = count;
+	job->numDone = 0;
+	for(int s = 0; s < numShares; s++) {
+		job->shares[s].next = (int)((long long)count * s / numShares);
+		job->shares[s].end = (int)((long long)count * (s + 1) / numShares);
+	}
+	
+	for(int s = 1; s < numShares; s++) {
+		run([job, s]() {
+			drain(*job, s);
+		});
+	}
+	drain(*job, 0);
+	
+	unique_lock<std::mutex> lock(job->mutex);
+	while (job->numDone < count) {
+		job->finished.wait(lock);
+	}
+}
+
+void ThreadPool::workerLoop() {
+	unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		while (jobs.empty() && !stopping) {
+			wake.wait(lock);
+		}
+		if (jobs.empty()) {
+			return; //Stopping, and nothing left to do
+		}
+		
+		function<void()> job = jobs.front();
+		jobs.pop_front();
+		busy++;
+		lock.unlock();
+		job();
+		lock.lock();
+		busy--;
+		idle.notify_all();
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef THREAD_POOL_H_INCLUDED
+#define THREAD_POOL_H_INCLUDED
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//A fixed set of worker threads that run queued jobs in FIFO order
+class ThreadPool {
+	private:
+		std::vector<std::thread> threads;
+		std::deque<std::function<void()> > jobs;
+		std::mutex mutex;
+		std::condition_variable wake; //Signalled when a job is queued
+		std::condition_variable idle; //Signalled when a job finishes
+		int busy; //The number of jobs being run right now
+		bool stopping;
+		
+		void workerLoop();
+	public:
+		//Starts numThreads workers, or one per hardware thread if numThreads
+		//is 0
+		explicit ThreadPool(int numThreads = 0);
+		//Finishes the queued jobs and stops the workers
+		~ThreadPool();
+		
+		int size() const {
+			return (int)threads.size();
+		}
+		
+		//Queues a job to be run on one of the workers
+		void run(std::function<void()> job);
+		//Blocks until every queued job has finished
+		void wait();
+		/* Calls body(i) for every i from 0 to count - 1, on the workers and
+		 * the calling thread, and returns once every call has finished.  The
+		 * indices are split evenly between the threads up front, and a thread
+		 * that runs out of its own indices steals ones that another thread
+		 * hasn't started yet, so uneven work still keeps every thread busy.
+		 * Each index should be a sizeable piece of work, such as a chunk of
+		 * an array, rather than a single element.
+		 */
+		void parallelFor(int count, std::function<void(int)> body);
+};
+
+#endif
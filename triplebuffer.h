@@ -0,0 +1,59 @@
+#ifndef TRIPLE_BUFFER_H_INCLUDED
+#define TRIPLE_BUFFER_H_INCLUDED
+
+#include <atomic>
+
+/* Hands the latest of a stream of values from one thread to another without
+ * locks.  The writer fills writeSlot() and publishes it; the reader calls
+ * update() and then reads readSlot(), which stays untouched until its next
+ * update().  There are three slots, one each for the writer and the reader
+ * and one between them, so neither ever waits for the other, and the reader
+ * skips any values that were replaced before it got to them.
+ *
+ * Slots are reused, so the writer must set every part of a value it
+ * publishes, but anything a value holds, such as a vector's memory, is kept
+ * from one use of a slot to the next.
+ */
+template<class T>
+class TripleBuffer {
+	private:
+		//Set in middle when the writer has published a value there that the
+		//reader hasn't taken yet
+		static const int FRESH = 4;
+		
+		T slots[3];
+		std::atomic<int> middle; //The slot between the two, plus FRESH
+		int back;                //The writer's slot
+		int front;               //The reader's slot
+	public:
+		TripleBuffer() : middle(1), back(0), front(2) {
+			
+		}
+		
+		//Returns the slot to fill with the next value.  Writer only.
+		T &writeSlot() {
+			return slots[back];
+		}
+		
+		//Makes the value in writeSlot() the latest.  Writer only.
+		void publish() {
+			back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 3;
+		}
+		
+		//Takes the latest value, if there's been one since the last update,
+		//and returns whether there was.  Reader only.
+		bool update() {
+			if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+				return false;
+			}
+			front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+			return true;
+		}
+		
+		//Returns the value the last update took.  Reader only.
+		const T &readSlot() const {
+			return slots[front];
+		}
+};
+
+#endif
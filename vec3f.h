@@ -26,37 +26,174 @@
 #define VEC3F_H_INCLUDED
 
 #include <iostream>
+#include <math.h>
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+/* A 3D vector.  Everything is defined here so that it can be inlined into
+ * the loops that use it, and everything that doesn't need a square root is
+ * constexpr.  A Vec3f is exactly three floats, so arrays of them can be
+ * handed straight to OpenGL.
+ */
 class Vec3f {
 	private:
 		float v[3];
 	public:
-		Vec3f();
-		Vec3f(float x, float y, float z);
-		
-		float &operator[](int index);
-		float operator[](int index) const;
-		
-		Vec3f operator*(float scale) const;
-		Vec3f operator/(float scale) const;
-		Vec3f operator+(const Vec3f &other) const;
-		Vec3f operator-(const Vec3f &other) const;
-		Vec3f operator-() const;
-		
-		const Vec3f &operator*=(float scale);
-		const Vec3f &operator/=(float scale);
-		const Vec3f &operator+=(const Vec3f &other);
-		const Vec3f &operator-=(const Vec3f &other);
-		
-		float magnitude() const;
-		float magnitudeSquared() const;
-		Vec3f normalize() const;
-		float dot(const Vec3f &other) const;
-		Vec3f cross(const Vec3f &other) const;
+		Vec3f() = default;
+		
+		constexpr Vec3f(float x, float y, float z) : v{x, y, z} {
+			
+		}
+		
+		constexpr float &operator[](int index) {
+			return v[index];
+		}
+		
+		constexpr float operator[](int index) const {
+			return v[index];
+		}
+		
+		constexpr Vec3f operator*(float scale) const {
+			return Vec3f(v[0] * scale, v[1] * scale, v[2] * scale);
+		}
+		
+		constexpr Vec3f operator/(float scale) const {
+			return Vec3f(v[0] / scale, v[1] / scale, v[2] / scale);
+		}
+		
+		constexpr Vec3f operator+(const Vec3f &other) const {
+			return Vec3f(v[0] + other.v[0], v[1] + other.v[1], v[2] + other.v[2]);
+		}
+		
+		constexpr Vec3f operator-(const Vec3f &other) const {
+			return Vec3f(v[0] - other.v[0], v[1] - other.v[1], v[2] - other.v[2]);
+		}
+		
+		constexpr Vec3f operator-() const {
+			return Vec3f(-v[0], -v[1], -v[2]);
+		}
+		
+		constexpr const Vec3f &operator*=(float scale) {
+			v[0] *= scale;
+			v[1] *= scale;
+			v[2] *= scale;
+			return *this;
+		}
+		
+		constexpr const Vec3f &operator/=(float scale) {
+			v[0] /= scale;
+			v[1] /= scale;
+			v[2] /= scale;
+			return *this;
+		}
+		
+		constexpr const Vec3f &operator+=(const Vec3f &other) {
+			v[0] += other.v[0];
+			v[1] += other.v[1];
+			v[2] += other.v[2];
+			return *this;
+		}
+		
+		constexpr const Vec3f &operator-=(const Vec3f &other) {
+			v[0] -= other.v[0];
+			v[1] -= other.v[1];
+			v[2] -= other.v[2];
+			return *this;
+		}
+		
+		float magnitude() const {
+			return sqrtf(magnitudeSquared());
+		}
+		
+		constexpr float magnitudeSquared() const {
+			return v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+		}
+		
+		Vec3f normalize() const {
+			float m = magnitude();
+			return Vec3f(v[0] / m, v[1] / m, v[2] / m);
+		}
+		
+		constexpr float dot(const Vec3f &other) const {
+			return v[0] * other.v[0] + v[1] * other.v[1] + v[2] * other.v[2];
+		}
+		
+		constexpr Vec3f cross(const Vec3f &other) const {
+			return Vec3f(v[1] * other.v[2] - v[2] * other.v[1],
+						 v[2] * other.v[0] - v[0] * other.v[2],
+						 v[0] * other.v[1] - v[1] * other.v[0]);
+		}
 };
 
-Vec3f operator*(float scale, const Vec3f &v);
-std::ostream &operator<<(std::ostream &output, const Vec3f &v);
+constexpr Vec3f operator*(float scale, const Vec3f &v) {
+	return v * scale;
+}
+
+//Returns a * scale + b, without making the intermediate vector
+constexpr Vec3f scaleAdd(const Vec3f &a, float scale, const Vec3f &b) {
+	return Vec3f(a[0] * scale + b[0], a[1] * scale + b[1], a[2] * scale + b[2]);
+}
+
+//Returns the point the fraction t of the way from a to b
+constexpr Vec3f lerp(const Vec3f &a, const Vec3f &b, float t) {
+	return Vec3f(a[0] * (1 - t) + b[0] * t,
+				 a[1] * (1 - t) + b[1] * t,
+				 a[2] * (1 - t) + b[2] * t);
+}
+
+/* Scales each of the count vectors (x[i], y[i], z[i]) to length 1, to about
+ * 22 bits rather than 24, using the processor's reciprocal square root
+ * estimate plus a Newton step instead of a square root and a divide.  With
+ * SSE, four vectors are done at once.  Zero vectors stay zero.  The estimate
+ * differs between processors, so this is only for things that are drawn, not
+ * for anything the simulation reads.
+ */
+inline void normalizeFast(float* x, float* y, float* z, int count) {
+	int i = 0;
+#ifdef __SSE__
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 threeHalves = _mm_set1_ps(1.5f);
+	for(; i + 4 <= count; i += 4) {
+		__m128 x4 = _mm_loadu_ps(x + i);
+		__m128 y4 = _mm_loadu_ps(y + i);
+		__m128 z4 = _mm_loadu_ps(z + i);
+		__m128 m2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x4, x4),
+										  _mm_mul_ps(y4, y4)),
+							   _mm_mul_ps(z4, z4));
+		__m128 r = _mm_rsqrt_ps(m2);
+		r = _mm_mul_ps(r, _mm_sub_ps(threeHalves,
+									 _mm_mul_ps(_mm_mul_ps(half, m2),
+												_mm_mul_ps(r, r))));
+		r = _mm_and_ps(r, _mm_cmpgt_ps(m2, zero));
+		_mm_storeu_ps(x + i, _mm_mul_ps(x4, r));
+		_mm_storeu_ps(y + i, _mm_mul_ps(y4, r));
+		_mm_storeu_ps(z + i, _mm_mul_ps(z4, r));
+	}
+#endif
+	for(; i < count; i++) {
+		float m2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+		if (m2 <= 0) {
+			continue;
+		}
+#ifdef __SSE__
+		float r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(m2)));
+		r = r * (1.5f - 0.5f * m2 * (r * r));
+#else
+		float r = 1 / sqrtf(m2);
+#endif
+		x[i] *= r;
+		y[i] *= r;
+		z[i] *= r;
+	}
+}
+
+inline std::ostream &operator<<(std::ostream &output, const Vec3f &v) {
+	output << '(' << v[0] << ", " << v[1] << ", " << v[2] << ')';
+	return output;
+}
 
 
 
@@ -0,0 +1,144 @@
+#ifndef VEC4F_H_INCLUDED
+#define VEC4F_H_INCLUDED
+
+#include "vec3f.h"
+
+//Defining MATH_NO_SIMD makes Vec4f use plain float math even with SSE
+#if defined(__SSE__) && !defined(MATH_NO_SIMD)
+#define VEC4F_SSE
+#endif
+
+/* A 4D vector, e.g. a homogeneous point or a column of a Mat4f.  It's kept
+ * 16-byte aligned so that where SSE is available each operation is a single
+ * instruction on the whole vector.
+ */
+class Vec4f {
+	private:
+		alignas(16) float v[4];
+	public:
+		Vec4f() = default;
+		
+		constexpr Vec4f(float x, float y, float z, float w) : v{x, y, z, w} {
+			
+		}
+		
+		constexpr Vec4f(const Vec3f &xyz, float w) :
+			v{xyz[0], xyz[1], xyz[2], w} {
+			
+		}
+		
+#ifdef VEC4F_SSE
+		Vec4f(__m128 simd) {
+			_mm_store_ps(v, simd);
+		}
+		
+		__m128 simd() const {
+			return _mm_load_ps(v);
+		}
+#endif
+		
+		constexpr float &operator[](int index) {
+			return v[index];
+		}
+		
+		constexpr float operator[](int index) const {
+			return v[index];
+		}
+		
+		//Returns the first three components
+		constexpr Vec3f xyz() const {
+			return Vec3f(v[0], v[1], v[2]);
+		}
+		
+		const float* data() const {
+			return v;
+		}
+		
+		Vec4f operator+(const Vec4f &other) const {
+#ifdef VEC4F_SSE
+			return Vec4f(_mm_add_ps(simd(), other.simd()));
+#else
+			return Vec4f(v[0] + other.v[0], v[1] + other.v[1],
+						 v[2] + other.v[2], v[3] + other.v[3]);
+#endif
+		}
+		
+		Vec4f operator-(const Vec4f &other) const {
+#ifdef VEC4F_SSE
+			return Vec4f(_mm_sub_ps(simd(), other.simd()));
+#else
+			return Vec4f(v[0] - other.v[0], v[1] - other.v[1],
+						 v[2] - other.v[2], v[3] - other.v[3]);
+#endif
+		}
+		
+		//Multiplies component by component
+		Vec4f operator*(const Vec4f &other) const {
+#ifdef VEC4F_SSE
+			return Vec4f(_mm_mul_ps(simd(), other.simd()));
+#else
+			return Vec4f(v[0] * other.v[0], v[1] * other.v[1],
+						 v[2] * other.v[2], v[3] * other.v[3]);
+#endif
+		}
+		
+		Vec4f operator*(float scale) const {
+#ifdef VEC4F_SSE
+			return Vec4f(_mm_mul_ps(simd(), _mm_set1_ps(scale)));
+#else
+			return Vec4f(v[0] * scale, v[1] * scale, v[2] * scale, v[3] * scale);
+#endif
+		}
+		
+		Vec4f operator-() const {
+			return *this * -1.0f;
+		}
+		
+		const Vec4f &operator+=(const Vec4f &other) {
+			*this = *this + other;
+			return *this;
+		}
+		
+		const Vec4f &operator-=(const Vec4f &other) {
+			*this = *this - other;
+			return *this;
+		}
+		
+		const Vec4f &operator*=(float scale) {
+			*this = *this * scale;
+			return *this;
+		}
+		
+		float dot(const Vec4f &other) const {
+#ifdef VEC4F_SSE
+			__m128 p = _mm_mul_ps(simd(), other.simd());
+			p = _mm_add_ps(p, _mm_movehl_ps(p, p));
+			p = _mm_add_ss(p, _mm_shuffle_ps(p, p, 1));
+			return _mm_cvtss_f32(p);
+#else
+			return v[0] * other.v[0] + v[1] * other.v[1] +
+				v[2] * other.v[2] + v[3] * other.v[3];
+#endif
+		}
+};
+
+inline Vec4f operator*(float scale, const Vec4f &v) {
+	return v * scale;
+}
+
+//Returns a * scale + b, without making the intermediate vector
+inline Vec4f scaleAdd(const Vec4f &a, float scale, const Vec4f &b) {
+#ifdef VEC4F_SSE
+	return Vec4f(_mm_add_ps(_mm_mul_ps(a.simd(), _mm_set1_ps(scale)), b.simd()));
+#else
+	return Vec4f(a[0] * scale + b[0], a[1] * scale + b[1],
+				 a[2] * scale + b[2], a[3] * scale + b[3]);
+#endif
+}
+
+inline std::ostream &operator<<(std::ostream &output, const Vec4f &v) {
+	output << '(' << v[0] << ", " << v[1] << ", " << v[2] << ", " << v[3] << ')';
+	return output;
+}
+
+#endif
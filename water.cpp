@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <math.h>
+
+#include "water.h"
+
+using namespace std;
+
+namespace {
+	//The colour water shows when it's seen from straight above, and the
+	//colour of the sky it reflects
+	const float DEEP_COLOR[3] = {0.05f, 0.2f, 0.55f};
+	const float SKY_COLOR[3] = {0.3f, 0.4f, 0.55f};
+	//How much light water reflects when it's seen from straight above
+	const float REFLECTANCE = 0.02f;
+}
+
+void WaterRegion::draw(const RenderBackend* backend) const {
+	if (backend == NULL) {
+		backend = openGLBackend();
+	}
+	TriangleBatch batch = {&verts[0], (int)verts.size() / 6, 6, 3, -1, -1,
+						   &indices[0], (int)indices.size()};
+	backend->drawTriangles(batch);
+}
+
+WaterMap::WaterMap(Terrain* terrain, float level, int minVertices) {
+	w = terrain->width();
+	l = terrain->length();
+	
+	//Flood fill the vertices under the water.  Regions that turn out too
+	//small are filled with -2, so they aren't filled again.
+	vector<short> vertexRegions(w * l, -1);
+	vector<int> stack;
+	for(int start = 0; start < w * l; start++) {
+		if (vertexRegions[start] != -1 ||
+			terrain->getHeight(start % w, start / w) >= level) {
+			continue;
+		}
+		
+		short index = (short)regions.size();
+		vertexRegions[start] = index;
+		stack.push_back(start);
+		vector<int> filled;
+		while (!stack.empty()) {
+			int vertex = stack.back();
+			stack.pop_back();
+			filled.push_back(vertex);
+			int x = vertex % w;
+			int z = vertex / w;
+			const int NEIGHBOURS[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+			for(int i = 0; i < 4; i++) {
+				int nx = x + NEIGHBOURS[i][0];
+				int nz = z + NEIGHBOURS[i][1];
+				if (nx < 0 || nx >= w || nz < 0 || nz >= l ||
+					vertexRegions[nz * w + nx] != -1 ||
+					terrain->getHeight(nx, nz) >= level) {
+					continue;
+				}
+				vertexRegions[nz * w + nx] = index;
+				stack.push_back(nz * w + nx);
+			}
+		}
+		
+		if ((int)filled.size() < minVertices || index == 32767) {
+			for(int i = 0; i < (int)filled.size(); i++) {
+				vertexRegions[filled[i]] = -2;
+			}
+			continue;
+		}
+		WaterRegion region;
+		region.level = level;
+		region.numVertices = (int)filled.size();
+		region.maxDepth = 0;
+		for(int i = 0; i < 3; i++) {
+			region.center[i] = 0; //Found with the surface
+		}
+		for(int i = 0; i < (int)filled.size(); i++) {
+			float depth = level - terrain->getHeight(filled[i] % w,
+													 filled[i] / w);
+			region.maxDepth = max(region.maxDepth, depth);
+		}
+		regions.push_back(region);
+	}
+	
+	//Each square with a corner under water belongs to the first region among
+	//its corners
+	cellRegions.assign((w - 1) * (l - 1), -1);
+	for(int z = 0; z < l - 1; z++) {
+		for(int x = 0; x < w - 1; x++) {
+			const int corners[4] = {z * w + x, z * w + x + 1, (z + 1) * w + x,
+									(z + 1) * w + x + 1};
+			for(int i = 0; i < 4; i++) {
+				if (vertexRegions[corners[i]] >= 0) {
+					cellRegions[z * (w - 1) + x] = vertexRegions[corners[i]];
+					break;
+				}
+			}
+		}
+	}
+	
+	for(int i = 0; i < (int)regions.size(); i++) {
+		buildSurface(regions[i], i);
+	}
+}
+
+void WaterMap::buildSurface(WaterRegion &region, int index) {
+	//Find the squares the region covers
+	int minX = w;
+	int minZ = l;
+	int maxX = -1;
+	int maxZ = -1;
+	for(int z = 0; z < l - 1; z++) {
+		for(int x = 0; x < w - 1; x++) {
+			if (cellRegions[z * (w - 1) + x] == index) {
+				minX = min(minX, x);
+				minZ = min(minZ, z);
+				maxX = max(maxX, x);
+				maxZ = max(maxZ, z);
+			}
+		}
+	}
+	
+	//One vertex per corner of the covered squares, shared between them
+	int spanX = maxX - minX + 2;
+	int spanZ = maxZ - minZ + 2;
+	vector<int> corners(spanX * spanZ, -1);
+	float sum[2] = {0, 0};
+	int numCells = 0;
+	for(int z = minZ; z <= maxZ; z++) {
+		for(int x = minX; x <= maxX; x++) {
+			if (cellRegions[z * (w - 1) + x] != index) {
+				continue;
+			}
+			
+			unsigned int square[4];
+			for(int i = 0; i < 4; i++) {
+				int cx = x + i % 2;
+				int cz = z + i / 2;
+				int &corner = corners[(cz - minZ) * spanX + cx - minX];
+				if (corner < 0) {
+					corner = (int)region.verts.size() / 6;
+					const float vert[6] = {(float)cx, region.level, (float)cz,
+										   0, 1, 0};
+					region.verts.insert(region.verts.end(), vert, vert + 6);
+				}
+				square[i] = (unsigned int)corner;
+			}
+			//Wound the same way as the terrain's squares
+			const unsigned int triangles[6] = {square[0], square[2], square[1],
+											   square[1], square[2], square[3]};
+			region.indices.insert(region.indices.end(), triangles,
+								  triangles + 6);
+			sum[0] += x + 0.5f;
+			sum[1] += z + 0.5f;
+			numCells++;
+		}
+	}
+	region.center[0] = sum[0] / numCells;
+	region.center[1] = region.level;
+	region.center[2] = sum[1] / numCells;
+}
+
+int WaterMap::regionAt(float x, float z) const {
+	int cx = (int)x;
+	int cz = (int)z;
+	cx = cx < 0 ? 0 : (cx > w - 2 ? w - 2 : cx);
+	cz = cz < 0 ? 0 : (cz > l - 2 ? l - 2 : cz);
+	return cellRegions[cz * (w - 1) + cx];
+}
+
+void waterColor(const WaterRegion &region, const float* eye, float* color) {
+	float dx = eye[0] - region.center[0];
+	float dy = eye[1] - region.center[1];
+	float dz = eye[2] - region.center[2];
+	float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+	float cosine = distance > 0 ? fabsf(dy) / distance : 1;
+	
+	//Schlick's approximation of the Fresnel term
+	float grazing = 1 - cosine;
+	float fresnel = REFLECTANCE + (1 - REFLECTANCE) *
+		grazing * grazing * grazing * grazing * grazing;
+	for(int i = 0; i < 3; i++) {
+		color[i] = DEEP_COLOR[i] + (SKY_COLOR[i] - DEEP_COLOR[i]) * fresnel;
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef WATER_H_INCLUDED
+#define WATER_H_INCLUDED
+
+#include <vector>
+
+#include "renderqueue.h"
+#include "terrain.h"
+#include "vec3f.h"
+
+/* A body of water: a set of terrain vertices below the water level that
+ * touch each other, under one flat surface.  The surface covers every square
+ * of the terrain with a corner under water, and the terrain hides the parts
+ * of it that are above the ground at the shore.
+ */
+struct WaterRegion {
+	float level;      //The height of the surface
+	int numVertices;  //The terrain vertices under the water
+	float center[3];  //The middle of the surface
+	float maxDepth;   //The depth at the deepest vertex
+	std::vector<float> verts; //x, y, z, nx, ny, nz for each surface vertex
+	std::vector<unsigned int> indices;
+	
+	int numTriangles() const {
+		return (int)indices.size() / 3;
+	}
+	
+	//Draws the surface through backend, or through OpenGL if it's NULL, in
+	//the material's colour
+	void draw(const RenderBackend* backend = NULL) const;
+};
+
+/* The water on a terrain.  Every vertex below the water level is under
+ * water, and a flood fill joins them into regions, dropping those too small
+ * to be more than puddles.  The regions and their surfaces are found once,
+ * so each frame only costs a draw per region, and finding the water over a
+ * point is a lookup in a grid.  Doesn't use OpenGL, so it may be made on any
+ * thread.
+ */
+class WaterMap {
+	private:
+		int w;
+		int l;
+		std::vector<short> cellRegions; //Each square's region, or -1 if dry
+		std::vector<WaterRegion> regions;
+		
+		void buildSurface(WaterRegion &region, int index);
+	public:
+		/* Finds the water on the terrain with its surface at level.  Sets of
+		 * touching vertices under it that number fewer than minVertices are
+		 * left dry.
+		 */
+		WaterMap(Terrain* terrain, float level, int minVertices);
+		
+		int numRegions() const {
+			return (int)regions.size();
+		}
+		
+		const WaterRegion &region(int index) const {
+			return regions[index];
+		}
+		
+		//Returns the region over the square that holds (x, z), or -1 if the
+		//square is dry.  Takes constant time.
+		int regionAt(float x, float z) const;
+		
+		//Returns the height of the water's surface over (x, z) through
+		//level, or false if there's no water there
+		bool surfaceAt(float x, float z, float &level) const {
+			int index = regionAt(x, z);
+			if (index < 0) {
+				return false;
+			}
+			level = regions[index].level;
+			return true;
+		}
+};
+
+/* Returns the colour of a region's surface seen from eye: its own colour,
+ * blended with the sky it reflects by the Fresnel term for the angle it's
+ * seen at from the region's middle, so far off water mirrors the sky and
+ * water underfoot shows its own colour.  It takes constant time per region,
+ * so it can be worked out every frame.
+ */
+void waterColor(const WaterRegion &region, const float* eye, float* color);
+
+#endif